@@ -848,10 +848,13 @@ public:
    * @param timeout the timeout of each network operation in seconds.  If it is not more than 0,
    * no timeout is specified.
    * @param name the name of the server.  If it is an empty string, the host name is specified.
+   * @param opts the optional features by bitwise-or: ThreadedServer::OEDGE for edge-triggered
+   * notification of each session.
    */
-  void set_network(const std::string& expr, double timeout = -1, const std::string& name = "") {
+  void set_network(const std::string& expr, double timeout = -1, const std::string& name = "",
+                   uint32_t opts = 0) {
     _assert_(true);
-    if (timeout > 0) serv_.set_network(expr, timeout);
+    if (timeout > 0) serv_.set_network(expr, timeout, opts);
     if (name.empty()) {
       name_ = Socket::get_local_host_name();
       if (name.empty()) name_ = "localhost";
@@ -881,12 +884,14 @@ public:
    * Set the worker to process each request.
    * @param worker the worker object.
    * @param thnum the number of worker threads.
+   * @param rcnum the number of reactor threads.  If it is more than 1, each reactor owns a
+   * server socket bound with the SO_REUSEPORT option and an event poller of its own.
    */
-  void set_worker(Worker* worker, size_t thnum = 1) {
+  void set_worker(Worker* worker, size_t thnum = 1, size_t rcnum = 1) {
     _assert_(true);
     worker_.serv_ = this;
     worker_.worker_ = worker;
-    serv_.set_worker(&worker_, thnum);
+    serv_.set_worker(&worker_, thnum, rcnum);
   }
   /**
    * Start the service.
@@ -1315,8 +1320,13 @@ private:
         ++it;
       }
       kc::strprintf(&data, "\r\n");
-      if (body) data.append(resbody);
-      return sess->send(data.data(), data.size());
+      if (!body || resbody.empty()) return sess->send(data.data(), data.size());
+      struct ::iovec iov[2];
+      iov[0].iov_base = (void*)data.data();
+      iov[0].iov_len = data.size();
+      iov[1].iov_base = (void*)resbody.data();
+      iov[1].iov_len = resbody.size();
+      return sess->sendv(iov, sizeof(iov) / sizeof(*iov));
     }
     void append_server_headers(std::string* str) {
       _assert_(str);
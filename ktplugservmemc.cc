@@ -338,6 +338,8 @@ private:
       std::vector<std::string>::const_iterator it = tokens.begin();
       std::vector<std::string>::const_iterator itend = tokens.end();
       std::string result;
+      std::vector<size_t> marks;
+      std::vector<struct ::iovec> values;
       while (it != itend) {
         opcounts_[thid][CNTGET]++;
         size_t vsiz;
@@ -348,18 +350,40 @@ private:
             flags = kc::readfixnum(vbuf + vsiz - sizeof(flags), sizeof(flags));
             vsiz -= sizeof(flags);
           }
+          if (!values.empty()) result.append("\r\n");
           kc::strprintf(&result, "VALUE %s %u %llu\r\n",
                         it->c_str(), flags, (unsigned long long)vsiz);
-          result.append(vbuf, vsiz);
-          result.append("\r\n");
-          delete[] vbuf;
+          marks.push_back(result.size());
+          struct ::iovec value;
+          value.iov_base = vbuf;
+          value.iov_len = vsiz;
+          values.push_back(value);
         } else {
           opcounts_[thid][CNTGETMISS]++;
         }
         ++it;
       }
+      if (!values.empty()) result.append("\r\n");
       kc::strprintf(&result, "END\r\n");
-      if (!sess->send(result.data(), result.size())) err = true;
+      std::vector<struct ::iovec> iovs;
+      iovs.reserve(values.size() * 2 + 1);
+      size_t pos = 0;
+      for (size_t i = 0; i < values.size(); i++) {
+        struct ::iovec head;
+        head.iov_base = (void*)(result.data() + pos);
+        head.iov_len = marks[i] - pos;
+        iovs.push_back(head);
+        iovs.push_back(values[i]);
+        pos = marks[i];
+      }
+      struct ::iovec tail;
+      tail.iov_base = (void*)(result.data() + pos);
+      tail.iov_len = result.size() - pos;
+      iovs.push_back(tail);
+      if (!sess->sendv(&iovs[0], iovs.size())) err = true;
+      for (size_t i = 0; i < values.size(); i++) {
+        delete[] (char*)values[i].iov_base;
+      }
       return !err;
     }
     // process the delete command
@@ -607,6 +607,7 @@ public:
   enum BinaryMagic {
     BMNOP = 0xb0,                        ///< no operation
     BMREPLICATION = 0xb1,                ///< replication
+    BMREPLBATCH = 0xb2,                  ///< batched replication
     BMPLAYSCRIPT = 0xb4,                 ///< call a scripting procedure
     BMSETBULK = 0xb8,                    ///< set in bulk
     BMREMOVEBULK = 0xb9,                 ///< remove in bulk
@@ -1925,14 +1926,34 @@ public:
    * Opening options.
    */
   enum Option {
-    WHITESID = 1 << 0                    ///< fetch messages of the specified SID only
+    WHITESID = 1 << 0,                   ///< fetch messages of the specified SID only
+    BATCH = 1 << 1,                      ///< fetch messages in batched frames
+    COMPRESS = 1 << 2,                   ///< fetch batched frames compressed
+    FORMAT = 1 << 3,                     ///< check the format of records
+    FORMATACK = 1 << 4                   ///< require the format of records of the server
+  };
+  /**
+   * Message in a frame.
+   */
+  struct Message {
+    const char* buf;                     ///< pointer to the message
+    size_t size;                         ///< size of the message
+    uint64_t ts;                         ///< time stamp
   };
   /**
    * Default constructor.
    */
-  explicit ReplicationClient() : sock_(), alive_(false) {
+  explicit ReplicationClient() :
+    sock_(), alive_(false), fbuf_(NULL), fcap_(0), msgs_(), midx_(0), comp_() {
     _assert_(true);
   }
+  /**
+   * Destructor.
+   */
+  ~ReplicationClient() {
+    _assert_(true);
+    delete[] fbuf_;
+  }
   /**
    * Open the connection.
    * @param host the name or the address of the server.  If it is an empty string, the local host
@@ -1943,11 +1964,18 @@ public:
    * @param ts the maximum time stamp of already read logs.
    * @param sid the server ID number.
    * @param opts the optional features by bitwise-or: ReplicationClient::WHITESID to fetch
-   * messages whose server ID number is the specified one only.
+   * messages whose server ID number is the specified one only, ReplicationClient::BATCH to
+   * fetch messages packed in batched frames, ReplicationClient::COMPRESS to fetch batched
+   * frames compressed with ZLIB, ReplicationClient::FORMAT to make the server refuse the
+   * connection if the format of records differs, ReplicationClient::FORMATACK to refuse the
+   * server unless it confirms the same format of records.
+   * @param fmt the digest of the formats of records of the local databases, which is checked
+   * with ReplicationClient::FORMAT and ReplicationClient::FORMATACK.
    * @return true on success, or false on failure.
+   * @note Servers which do not support batched frames send each message in a frame of its own.
    */
   bool open(const std::string& host = "", int32_t port = DEFPORT, double timeout = -1,
-            uint64_t ts = 0, uint16_t sid = 0, uint32_t opts = 0) {
+            uint64_t ts = 0, uint16_t sid = 0, uint32_t opts = 0, uint16_t fmt = 0) {
     _assert_(true);
     const std::string& thost = host.empty() ? Socket::get_local_host_name() : host;
     const std::string& addr = Socket::get_host_address(thost);
@@ -1958,6 +1986,10 @@ public:
     if (!sock_.open(expr)) return false;
     uint32_t flags = 0;
     if (opts & WHITESID) flags |= WHITESID;
+    if (opts & BATCH) flags |= BATCH;
+    if (opts & COMPRESS) flags |= BATCH | COMPRESS;
+    if (opts & FORMAT) flags |= FORMAT | ((uint32_t)fmt << 16);
+    if (opts & FORMATACK) flags |= FORMAT | FORMATACK | ((uint32_t)fmt << 16);
     char tbuf[1+sizeof(flags)+sizeof(ts)+sizeof(sid)];
     char* wp = tbuf;
     *(wp++) = RemoteDB::BMREPLICATION;
@@ -1971,6 +2003,13 @@ public:
       sock_.close();
       return false;
     }
+    if (flags & FORMATACK) {
+      char fbuf[sizeof(fmt)];
+      if (!sock_.receive(fbuf, sizeof(fbuf)) || kc::readfixnum(fbuf, sizeof(fbuf)) != fmt) {
+        sock_.close();
+        return false;
+      }
+    }
     alive_ = true;
     return true;
   }
@@ -1995,40 +2034,123 @@ public:
     _assert_(sp && tsp);
     *sp = 0;
     *tsp = 0;
+    if (midx_ >= msgs_.size()) {
+      midx_ = 0;
+      if (!read_frame(&msgs_, tsp) || msgs_.empty()) return NULL;
+    }
+    const Message& msg = msgs_[midx_++];
+    char* mbuf = new char[msg.size];
+    std::memcpy(mbuf, msg.buf, msg.size);
+    *sp = msg.size;
+    *tsp = msg.ts;
+    return mbuf;
+  }
+  /**
+   * Read the messages of the next frame.
+   * @param msgs a vector into which the messages are stored.  The regions of the messages are
+   * owned by the object and they are valid until the next reading.
+   * @param tsp the pointer to the variable into which the time stamp of the frame is assigned.
+   * @return true on success, or false on failure.
+   * @note A frame of no operation yields no message.  This method should not be mixed with the
+   * read method.
+   */
+  bool read_frame(std::vector<Message>* msgs, uint64_t* tsp) {
+    _assert_(msgs && tsp);
+    msgs->clear();
+    *tsp = 0;
     int32_t magic = sock_.receive_byte();
     if (magic == RemoteDB::BMREPLICATION) {
       char hbuf[sizeof(uint64_t)+sizeof(uint32_t)];
       if (!sock_.receive(hbuf, sizeof(hbuf))) {
         alive_ = false;
-        return NULL;
+        return false;
       }
       const char* rp = hbuf;
       uint64_t ts = kc::readfixnum(rp, sizeof(uint64_t));
       rp += sizeof(uint64_t);
       size_t msiz = kc::readfixnum(rp, sizeof(uint32_t));
-      rp += sizeof(uint32_t);
-      char* mbuf = new char[msiz];
-      if (!sock_.receive(mbuf, msiz)) {
-        delete[] mbuf;
+      reserve(msiz);
+      if (!sock_.receive(fbuf_, msiz)) {
         alive_ = false;
-        return NULL;
+        return false;
       }
-      *sp = msiz;
+      Message msg = { fbuf_, msiz, ts };
+      msgs->push_back(msg);
       *tsp = ts;
-      return mbuf;
+      return true;
+    } else if (magic == RemoteDB::BMREPLBATCH) {
+      char hbuf[sizeof(uint64_t)+sizeof(uint32_t)*3];
+      if (!sock_.receive(hbuf, sizeof(hbuf))) {
+        alive_ = false;
+        return false;
+      }
+      const char* rp = hbuf;
+      uint64_t ts = kc::readfixnum(rp, sizeof(uint64_t));
+      rp += sizeof(uint64_t);
+      size_t num = kc::readfixnum(rp, sizeof(uint32_t));
+      rp += sizeof(uint32_t);
+      size_t rsiz = kc::readfixnum(rp, sizeof(uint32_t));
+      rp += sizeof(uint32_t);
+      size_t zsiz = kc::readfixnum(rp, sizeof(uint32_t));
+      if (zsiz > 0) {
+        char* zbuf = new char[zsiz];
+        if (!sock_.receive(zbuf, zsiz)) {
+          delete[] zbuf;
+          alive_ = false;
+          return false;
+        }
+        size_t dsiz;
+        char* dbuf = comp_.decompress(zbuf, zsiz, &dsiz);
+        delete[] zbuf;
+        if (!dbuf || dsiz != rsiz) {
+          delete[] dbuf;
+          alive_ = false;
+          return false;
+        }
+        delete[] fbuf_;
+        fbuf_ = dbuf;
+        fcap_ = dsiz;
+      } else {
+        reserve(rsiz);
+        if (!sock_.receive(fbuf_, rsiz)) {
+          alive_ = false;
+          return false;
+        }
+      }
+      rp = fbuf_;
+      const char* ep = fbuf_ + rsiz;
+      for (size_t i = 0; i < num; i++) {
+        if (ep - rp < (int64_t)(sizeof(uint64_t) + sizeof(uint32_t))) {
+          alive_ = false;
+          return false;
+        }
+        uint64_t mts = kc::readfixnum(rp, sizeof(uint64_t));
+        rp += sizeof(uint64_t);
+        size_t msiz = kc::readfixnum(rp, sizeof(uint32_t));
+        rp += sizeof(uint32_t);
+        if ((size_t)(ep - rp) < msiz) {
+          alive_ = false;
+          return false;
+        }
+        Message msg = { rp, msiz, mts };
+        msgs->push_back(msg);
+        rp += msiz;
+      }
+      *tsp = ts;
+      return true;
     } else if (magic == RemoteDB::BMNOP) {
       char hbuf[sizeof(uint64_t)];
       if (!sock_.receive(hbuf, sizeof(hbuf))) {
         alive_ = false;
-        return NULL;
+        return false;
       }
       *tsp = kc::readfixnum(hbuf, sizeof(uint64_t));
       char c = RemoteDB::BMREPLICATION;
       sock_.send(&c, 1);
-    } else {
-      alive_ = false;
+      return true;
     }
-    return NULL;
+    alive_ = false;
+    return false;
   }
   /**
    * Check whether the connection is alive.
@@ -2039,10 +2161,37 @@ public:
     return alive_;
   }
 private:
+  /**
+   * Secure the capacity of the frame buffer.
+   * @param size the required size.
+   */
+  void reserve(size_t size) {
+    _assert_(true);
+    if (size <= fcap_) return;
+    delete[] fbuf_;
+    fcap_ = size > FRAMEUNIT ? size : FRAMEUNIT;
+    fbuf_ = new char[fcap_];
+  }
+  /** The unit size of the frame buffer. */
+  static const size_t FRAMEUNIT = 8192;
+  /** Dummy constructor to forbid the use. */
+  ReplicationClient(const ReplicationClient&);
+  /** Dummy Operator to forbid the use. */
+  ReplicationClient& operator =(const ReplicationClient&);
   /** The client socket. */
   Socket sock_;
   /** The alive flag. */
   bool alive_;
+  /** The frame buffer. */
+  char* fbuf_;
+  /** The capacity of the frame buffer. */
+  size_t fcap_;
+  /** The messages of the current frame. */
+  std::vector<Message> msgs_;
+  /** The index of the next message in the current frame. */
+  size_t midx_;
+  /** The compressor of batched frames. */
+  kc::ZLIBCompressor<kc::ZLIB::RAW> comp_;
 };
 
 
@@ -416,10 +416,12 @@ public:
    * @param expr an expression of the address and the port of the server.
    * @param timeout the timeout of each network operation in seconds.  If it is not more than 0,
    * no timeout is specified.
+   * @param opts the optional features by bitwise-or: ThreadedServer::OEDGE for edge-triggered
+   * notification of each session.
    */
-  void set_network(const std::string& expr, double timeout = -1) {
+  void set_network(const std::string& expr, double timeout = -1, uint32_t opts = 0) {
     _assert_(true);
-    serv_.set_network(expr, timeout);
+    serv_.set_network(expr, timeout, "", opts);
   }
   /**
    * Set the logger to process each log message.
@@ -436,12 +438,14 @@ public:
    * Set the worker to process each request.
    * @param worker the worker object.
    * @param thnum the number of worker threads.
+   * @param rcnum the number of reactor threads.  If it is more than 1, each reactor owns a
+   * server socket bound with the SO_REUSEPORT option and an event poller of its own.
    */
-  void set_worker(Worker* worker, size_t thnum = 1) {
+  void set_worker(Worker* worker, size_t thnum = 1, size_t rcnum = 1) {
     _assert_(true);
     worker_.serv_ = this;
     worker_.worker_ = worker;
-    serv_.set_worker(&worker_, thnum);
+    serv_.set_worker(&worker_, thnum, rcnum);
   }
   /**
    * Start the service.
@@ -45,15 +45,19 @@ static void killserver(int signum);
 static int32_t run(int argc, char** argv);
 static int32_t proc(const std::vector<std::string>& dbpaths,
                     const char* host, int32_t port, double tout, int32_t thnum,
-                    const char* logpath, uint32_t logkinds,
+                    int32_t rthnum, bool et, const char* logpath, uint32_t logkinds,
                     const char* ulogpath, int64_t ulim, double uasi,
                     int32_t sid, int32_t omode, double asi, bool ash,
-                    const char* bgspath, double bgsi, kc::Compressor* bgscomp, bool dmn,
+                    const char* bgspath, double bgsi, kc::Compressor* bgscomp,
+                    int32_t bgsthnum, bool dmn,
                     const char* pidpath, const char* cmdpath, const char* scrpath,
                     const char* mhost, int32_t mport, const char* rtspath, double riv,
+                    bool rcomp, int32_t rathnum,
                     const char* plsvpath, const char* plsvex, const char* pldbpath);
-static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp,
+static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp, int32_t bgsthnum,
                        kt::TimedDB* dbs, int32_t dbnum, kt::RPCServer* serv);
+static uint16_t dbformat(kt::TimedDB* dbs, int32_t dbnum);
+static bool dbstrict(kt::TimedDB* dbs, int32_t dbnum);
 
 
 // logger implementation
@@ -139,12 +143,15 @@ private:
 // replication slave implemantation
 class Slave : public kc::Thread {
   friend class Worker;
+  friend class Master;
 public:
   // constructor
   explicit Slave(uint16_t sid, const char* rtspath, const char* host, int32_t port, double riv,
-                 kt::RPCServer* serv, kt::TimedDB* dbs, int32_t dbnum,
-                 kt::UpdateLogger* ulog, DBUpdateLogger* ulogdbs) :
-    lock_(), sid_(sid), rtspath_(rtspath), host_(""), port_(port), riv_(riv),
+                 uint32_t ropts, int32_t athnum, kt::RPCServer* serv,
+                 kt::TimedDB* dbs, int32_t dbnum, kt::UpdateLogger* ulog,
+                 DBUpdateLogger* ulogdbs) :
+    lock_(), sid_(sid), rtspath_(rtspath), host_(""), port_(port), riv_(riv), ropts_(ropts),
+    athnum_(athnum), appliers_(NULL),
     serv_(serv), dbs_(dbs), dbnum_(dbnum), ulog_(ulog), ulogdbs_(ulogdbs),
     wrts_(kc::UINT64MAX), rts_(0), alive_(true), hup_(false) {
     if (host) host_ = host;
@@ -186,6 +193,87 @@ public:
 private:
   static const int32_t DUMMYFREQ = 256;
   static const size_t RTSFILESIZ = 21;
+  static const size_t APPLYQMAX = 65536;
+  // record to be applied
+  struct Record {
+    std::string mbuf;
+    uint16_t sid;
+    uint16_t dbid;
+    uint64_t ts;
+  };
+  // parallel applier of replicated records
+  class Applier : public kc::Thread {
+  public:
+    // constructor
+    explicit Applier() : slave_(NULL), mutex_(), cond_(), queue_(), pend_(0), alive_(true) {}
+    // push a record
+    void push(const char* rbuf, size_t rsiz, uint16_t rsid, uint16_t rdbid, uint64_t ts) {
+      kc::ScopedMutex lock(&mutex_);
+      while (queue_.size() >= APPLYQMAX) {
+        cond_.wait(&mutex_, 0.1);
+      }
+      Record rec;
+      queue_.push_back(rec);
+      Record& last = queue_.back();
+      last.mbuf.append(rbuf, rsiz);
+      last.sid = rsid;
+      last.dbid = rdbid;
+      last.ts = ts;
+      if (pend_ < 1) pend_ = ts;
+      cond_.broadcast();
+    }
+    // get the time stamp of the oldest record not applied yet, or 0 if all are applied
+    uint64_t pending() {
+      kc::ScopedMutex lock(&mutex_);
+      return pend_;
+    }
+    // wait for all records to be applied
+    void drain() {
+      kc::ScopedMutex lock(&mutex_);
+      while (pend_ > 0) {
+        cond_.wait(&mutex_, 0.1);
+      }
+    }
+    // stop the applier
+    void stop() {
+      kc::ScopedMutex lock(&mutex_);
+      alive_ = false;
+      cond_.broadcast();
+    }
+  private:
+    // apply records
+    void run(void) {
+      Record rec;
+      while (true) {
+        mutex_.lock();
+        while (queue_.empty() && alive_) {
+          cond_.wait(&mutex_, 0.1);
+        }
+        if (queue_.empty()) {
+          mutex_.unlock();
+          break;
+        }
+        rec.mbuf.swap(queue_.front().mbuf);
+        rec.sid = queue_.front().sid;
+        rec.dbid = queue_.front().dbid;
+        queue_.pop_front();
+        cond_.broadcast();
+        mutex_.unlock();
+        slave_->apply_one(rec.mbuf.data(), rec.mbuf.size(), rec.sid, rec.dbid);
+        mutex_.lock();
+        pend_ = queue_.empty() ? 0 : queue_.front().ts;
+        cond_.broadcast();
+        mutex_.unlock();
+      }
+    }
+    friend class Slave;
+    Slave* slave_;
+    kc::Mutex mutex_;
+    kc::CondVar cond_;
+    std::deque<Record> queue_;
+    uint64_t pend_;
+    bool alive_;
+  };
   // perform replication
   void run(void) {
     if (!rtspath_) return;
@@ -197,6 +285,13 @@ private:
     }
     rts_ = read_rts(&rtsfile);
     write_rts(&rtsfile, rts_);
+    if (athnum_ > 1) {
+      appliers_ = new Applier[athnum_];
+      for (int32_t i = 0; i < athnum_; i++) {
+        appliers_[i].slave_ = this;
+        appliers_[i].start();
+      }
+    }
     kc::Thread::sleep(0.2);
     bool deferred = false;
     while (true) {
@@ -214,43 +309,48 @@ private:
           lock_.unlock();
         }
         kt::ReplicationClient rc;
-        if (rc.open(host, port, 60, rts_, sid_)) {
+        if (rc.open(host, port, 60, rts_, sid_, ropts_, dbformat(dbs_, dbnum_))) {
           serv_->log(Logger::SYSTEM, "replication started: host=%s port=%d rts=%llu",
                      host.c_str(), port, (unsigned long long)rts_);
           hup_ = false;
           double rivsum = 0;
+          uint64_t lts = 0;
+          std::vector<kt::ReplicationClient::Message> msgs;
           while (alive_ && !hup_ && rc.alive()) {
-            size_t msiz;
             uint64_t mts;
-            char* mbuf = rc.read(&msiz, &mts);
-            if (mbuf) {
-              if (msiz > 0) {
-                size_t rsiz;
-                uint16_t rsid, rdbid;
-                const char* rbuf = DBUpdateLogger::parse(mbuf, msiz, &rsiz, &rsid, &rdbid);
-                if (rbuf && rsid != sid_ && rdbid < dbnum_) {
-                  kt::TimedDB* db = dbs_ + rdbid;
-                  DBUpdateLogger* ulogdb = ulogdbs_ ? ulogdbs_ + rdbid : NULL;
-                  if (ulogdb) ulogdb->set_rsid(rsid);
-                  if (!db->recover(rbuf, rsiz)) {
-                    const kc::BasicDB::Error& e = db->error();
-                    serv_->log(Logger::ERROR, "recovering a database failed: %s: %s",
-                               e.name(), e.message());
-                  }
-                  if (ulogdb) ulogdb->clear_rsid();
-                }
-                rivsum += riv_;
+            if (!rc.read_frame(&msgs, &mts)) continue;
+            if (mts > lts) lts = mts;
+            if (!msgs.empty()) {
+              if (appliers_) {
+                dispatch(msgs);
               } else {
-                rivsum += riv_ * DUMMYFREQ / 4;
+                apply(msgs);
+              }
+              std::vector<kt::ReplicationClient::Message>::iterator it = msgs.begin();
+              std::vector<kt::ReplicationClient::Message>::iterator itend = msgs.end();
+              while (it != itend) {
+                rivsum += it->size > 0 ? riv_ : riv_ * DUMMYFREQ / 4;
+                ++it;
               }
-              delete[] mbuf;
-              while (rivsum > 100 && alive_ && !hup_ && rc.alive()) {
-                kc::Thread::sleep(0.1);
-                rivsum -= 100;
+              while (rivsum > 10 && alive_ && !hup_ && rc.alive()) {
+                kc::Thread::sleep(0.01);
+                rivsum -= 10;
+              }
+            }
+            if (appliers_) {
+              for (int32_t i = 0; i < athnum_; i++) {
+                uint64_t pts = appliers_[i].pending();
+                if (pts > 0 && pts - 1 < mts) mts = pts - 1;
               }
             }
             if (mts > rts_) rts_ = mts;
           }
+          if (appliers_) {
+            for (int32_t i = 0; i < athnum_; i++) {
+              appliers_[i].drain();
+            }
+          }
+          if (lts > rts_) rts_ = lts;
           rc.close();
           serv_->log(Logger::SYSTEM, "replication finished: host=%s port=%d",
                      host.c_str(), port);
@@ -268,8 +368,88 @@ private:
         break;
       }
     }
+    if (appliers_) {
+      for (int32_t i = 0; i < athnum_; i++) {
+        appliers_[i].stop();
+        appliers_[i].join();
+      }
+      delete[] appliers_;
+      appliers_ = NULL;
+    }
     if (!rtsfile.close()) serv_->log(Logger::ERROR, "closing the RTS file failed");
   }
+  // apply the messages of a frame
+  void apply(const std::vector<kt::ReplicationClient::Message>& msgs) {
+    bool tran = msgs.size() > 1;
+    std::vector<bool> trans(dbnum_, false);
+    std::vector<kt::ReplicationClient::Message>::const_iterator it = msgs.begin();
+    std::vector<kt::ReplicationClient::Message>::const_iterator itend = msgs.end();
+    while (it != itend) {
+      size_t rsiz;
+      uint16_t rsid, rdbid;
+      const char* rbuf = it->size > 0 ?
+        DBUpdateLogger::parse(it->buf, it->size, &rsiz, &rsid, &rdbid) : NULL;
+      if (rbuf && rsid != sid_ && rdbid < dbnum_) {
+        kt::TimedDB* db = dbs_ + rdbid;
+        if (tran && !trans[rdbid]) {
+          if (db->begin_transaction()) {
+            trans[rdbid] = true;
+          } else {
+            const kc::BasicDB::Error& e = db->error();
+            serv_->log(Logger::ERROR, "beginning a transaction failed: %s: %s",
+                       e.name(), e.message());
+            tran = false;
+          }
+        }
+        apply_one(rbuf, rsiz, rsid, rdbid);
+      }
+      ++it;
+    }
+    for (int32_t i = 0; i < dbnum_; i++) {
+      if (trans[i] && !dbs_[i].end_transaction(true)) {
+        const kc::BasicDB::Error& e = dbs_[i].error();
+        serv_->log(Logger::ERROR, "committing a transaction failed: %s: %s",
+                   e.name(), e.message());
+      }
+    }
+  }
+  // dispatch the messages of a frame to the appliers
+  void dispatch(const std::vector<kt::ReplicationClient::Message>& msgs) {
+    std::vector<kt::ReplicationClient::Message>::const_iterator it = msgs.begin();
+    std::vector<kt::ReplicationClient::Message>::const_iterator itend = msgs.end();
+    while (it != itend) {
+      size_t rsiz;
+      uint16_t rsid, rdbid;
+      const char* rbuf = it->size > 0 ?
+        DBUpdateLogger::parse(it->buf, it->size, &rsiz, &rsid, &rdbid) : NULL;
+      if (rbuf && rsid != sid_ && rdbid < dbnum_) {
+        size_t ksiz;
+        const char* kbuf = kt::TimedDB::update_log_key(rbuf, rsiz, &ksiz);
+        if (kbuf) {
+          uint32_t idx = (kc::hashmurmur(kbuf, ksiz) + rdbid) % athnum_;
+          appliers_[idx].push(rbuf, rsiz, rsid, rdbid, it->ts);
+        } else {
+          for (int32_t i = 0; i < athnum_; i++) {
+            appliers_[i].drain();
+          }
+          apply_one(rbuf, rsiz, rsid, rdbid);
+        }
+      }
+      ++it;
+    }
+  }
+  // apply a record
+  void apply_one(const char* rbuf, size_t rsiz, uint16_t rsid, uint16_t rdbid) {
+    kt::TimedDB* db = dbs_ + rdbid;
+    DBUpdateLogger* ulogdb = ulogdbs_ ? ulogdbs_ + rdbid : NULL;
+    if (ulogdb) ulogdb->set_rsid(rsid);
+    if (!db->recover(rbuf, rsiz)) {
+      const kc::BasicDB::Error& e = db->error();
+      serv_->log(Logger::ERROR, "recovering a database failed: %s: %s",
+                 e.name(), e.message());
+    }
+    if (ulogdb) ulogdb->clear_rsid();
+  }
   // read the replication time stamp
   uint64_t read_rts(kc::File* file) {
     char buf[RTSFILESIZ];
@@ -290,6 +470,9 @@ private:
   std::string host_;
   int32_t port_;
   double riv_;
+  const uint32_t ropts_;
+  const int32_t athnum_;
+  Applier* appliers_;
   kt::RPCServer* const serv_;
   kt::TimedDB* const dbs_;
   const int32_t dbnum_;
@@ -302,6 +485,250 @@ private:
 };
 
 
+// replication master implementation
+class Master : public kc::Thread {
+public:
+  // constructor
+  explicit Master(kt::UpdateLogger* ulog, double tout) :
+    lock_(), ulog_(ulog), tout_(tout), adds_(), alive_(true), comp_() {}
+  // stop the master
+  void stop() {
+    kc::ScopedSpinLock lock(&lock_);
+    alive_ = false;
+  }
+  // add a session of a slave
+  bool add(kt::ThreadedServer* serv, kt::ThreadedServer::Session* sess,
+           kt::UpdateLogger::Reader* ulrd, uint16_t sid, uint32_t flags) {
+    kc::ScopedSpinLock lock(&lock_);
+    if (!alive_) return false;
+    Stream* st = new Stream;
+    st->serv = serv;
+    st->sess = sess;
+    st->ulrd = ulrd;
+    st->sid = sid;
+    st->flags = flags;
+    st->rts = 0;
+    st->miss = 0;
+    st->nopt = 0;
+    st->ackt = 0;
+    st->sendt = 0;
+    adds_.push_back(st);
+    return true;
+  }
+private:
+  static const int32_t BATCHNUM = 256;
+  static const size_t FRAMEMAX = 1 << 18;
+  static const size_t ZMINSIZ = 256;
+  static const size_t PENDMAX = 1 << 20;
+  // replication stream to a slave
+  struct Stream {
+    kt::ThreadedServer* serv;
+    kt::ThreadedServer::Session* sess;
+    kt::UpdateLogger::Reader* ulrd;
+    uint16_t sid;
+    uint32_t flags;
+    uint64_t rts;
+    int32_t miss;
+    double nopt;
+    double ackt;
+    double sendt;
+    std::string fbuf;
+  };
+  // perform replication
+  void run(void) {
+    std::vector<Stream*> streams;
+    bool alive = true;
+    while (alive) {
+      lock_.lock();
+      streams.insert(streams.end(), adds_.begin(), adds_.end());
+      adds_.clear();
+      alive = alive_;
+      lock_.unlock();
+      uint64_t fcnt = ulog_ ? ulog_->flush_count() : 0;
+      bool busy = false;
+      std::vector<Stream*>::iterator it = streams.begin();
+      while (it != streams.end()) {
+        Stream* st = *it;
+        if (alive && !st->serv->aborted() && feed(st, &busy)) {
+          ++it;
+        } else {
+          finish(st);
+          it = streams.erase(it);
+        }
+      }
+      if (alive && !busy) {
+        if (ulog_ && !streams.empty()) {
+          ulog_->wait(fcnt, 0.1);
+        } else {
+          kc::Thread::sleep(0.1);
+        }
+      }
+    }
+  }
+  // send update logs to a slave
+  bool feed(Stream* st, bool* busy) {
+    kt::ThreadedServer::Session* sess = st->sess;
+    if (!st->serv->session_detached(sess)) return true;
+    size_t psiz = sess->pending_size();
+    if (psiz > 0) {
+      if (!sess->flush()) return false;
+      double now = kc::time();
+      if (sess->pending_size() < psiz || st->sendt <= 0) st->sendt = now;
+      if (sess->pending_size() > 0) {
+        if (tout_ > 0 && now > st->sendt + tout_) return false;
+        if (st->ackt > 0) return true;
+      } else {
+        st->sendt = 0;
+      }
+    }
+    if (st->ackt > 0) {
+      if (!sess->check_input()) return tout_ <= 0 || kc::time() < st->ackt + tout_;
+      if (sess->receive_byte() != kt::RemoteDB::BMREPLICATION) return false;
+      st->ackt = 0;
+    }
+    if (sess->pending_size() >= PENDMAX) return true;
+    if (st->flags & kt::ReplicationClient::BATCH) return feed_batch(st, busy);
+    char stack[kc::NUMBUFSIZ+RECBUFSIZ*4];
+    for (int32_t i = 0; i < BATCHNUM && sess->pending_size() < PENDMAX; i++) {
+      size_t msiz;
+      uint64_t mts;
+      char* mbuf = st->ulrd->read(&msiz, &mts);
+      if (!mbuf) return send_nop(st);
+      *busy = true;
+      bool err = false;
+      if (check(st, mbuf, msiz)) {
+        st->miss = 0;
+        size_t nsiz = 1 + sizeof(uint64_t) + sizeof(uint32_t) + msiz;
+        char* nbuf = nsiz > sizeof(stack) ? new char[nsiz] : stack;
+        char* wp = nbuf;
+        *(wp++) = kt::RemoteDB::BMREPLICATION;
+        kc::writefixnum(wp, mts, sizeof(uint64_t));
+        wp += sizeof(uint64_t);
+        kc::writefixnum(wp, msiz, sizeof(uint32_t));
+        wp += sizeof(uint32_t);
+        std::memcpy(wp, mbuf, msiz);
+        if (!sess->send(nbuf, nsiz)) err = true;
+        if (nbuf != stack) delete[] nbuf;
+      } else {
+        st->miss++;
+        if (st->miss >= Slave::DUMMYFREQ) {
+          char hbuf[1+sizeof(uint64_t)+sizeof(uint32_t)];
+          char* wp = hbuf;
+          *(wp++) = kt::RemoteDB::BMREPLICATION;
+          kc::writefixnum(wp, mts, sizeof(uint64_t));
+          wp += sizeof(uint64_t);
+          kc::writefixnum(wp, 0, sizeof(uint32_t));
+          if (!sess->send(hbuf, sizeof(hbuf))) err = true;
+          st->miss = 0;
+        }
+      }
+      if (mts > st->rts) st->rts = mts;
+      delete[] mbuf;
+      if (err) return false;
+    }
+    return true;
+  }
+  // send update logs to a slave in a batched frame
+  bool feed_batch(Stream* st, bool* busy) {
+    std::string& fbuf = st->fbuf;
+    fbuf.clear();
+    uint32_t num = 0;
+    uint64_t fts = 0;
+    char nbuf[sizeof(uint64_t)+sizeof(uint32_t)];
+    while (num < (uint32_t)BATCHNUM && fbuf.size() < FRAMEMAX) {
+      size_t msiz;
+      uint64_t mts;
+      char* mbuf = st->ulrd->read(&msiz, &mts);
+      if (!mbuf) break;
+      if (check(st, mbuf, msiz)) {
+        char* wp = nbuf;
+        kc::writefixnum(wp, mts, sizeof(uint64_t));
+        wp += sizeof(uint64_t);
+        kc::writefixnum(wp, msiz, sizeof(uint32_t));
+        fbuf.append(nbuf, sizeof(nbuf));
+        fbuf.append(mbuf, msiz);
+        num++;
+      }
+      if (mts > fts) fts = mts;
+      delete[] mbuf;
+    }
+    if (fts < 1) return send_nop(st);
+    *busy = true;
+    if (fts > st->rts) st->rts = fts;
+    char* zbuf = NULL;
+    size_t zsiz = 0;
+    if ((st->flags & kt::ReplicationClient::COMPRESS) && fbuf.size() >= ZMINSIZ) {
+      zbuf = comp_.compress(fbuf.data(), fbuf.size(), &zsiz);
+      if (zbuf && zsiz >= fbuf.size()) {
+        delete[] zbuf;
+        zbuf = NULL;
+      }
+      if (!zbuf) zsiz = 0;
+    }
+    char hbuf[1+sizeof(uint64_t)+sizeof(uint32_t)*3];
+    char* wp = hbuf;
+    *(wp++) = kt::RemoteDB::BMREPLBATCH;
+    kc::writefixnum(wp, fts, sizeof(uint64_t));
+    wp += sizeof(uint64_t);
+    kc::writefixnum(wp, num, sizeof(uint32_t));
+    wp += sizeof(uint32_t);
+    kc::writefixnum(wp, fbuf.size(), sizeof(uint32_t));
+    wp += sizeof(uint32_t);
+    kc::writefixnum(wp, zsiz, sizeof(uint32_t));
+    struct ::iovec iov[2];
+    iov[0].iov_base = hbuf;
+    iov[0].iov_len = sizeof(hbuf);
+    iov[1].iov_base = zbuf ? zbuf : (char*)fbuf.data();
+    iov[1].iov_len = zbuf ? zsiz : fbuf.size();
+    bool err = !st->sess->sendv(iov, 2);
+    delete[] zbuf;
+    return !err;
+  }
+  // check whether a log message is to be sent to a slave
+  bool check(Stream* st, const char* mbuf, size_t msiz) {
+    size_t rsiz;
+    uint16_t rsid = 0;
+    uint16_t rdbid = 0;
+    const char* rbuf = DBUpdateLogger::parse(mbuf, msiz, &rsiz, &rsid, &rdbid);
+    if (!rbuf) return false;
+    if (st->flags & kt::ReplicationClient::WHITESID) return rsid == st->sid;
+    return rsid != st->sid;
+  }
+  // send a no-operation frame to a drained slave
+  bool send_nop(Stream* st) {
+    double now = kc::time();
+    if (now < st->nopt + 0.1) return true;
+    uint64_t cc = kt::UpdateLogger::clock_pure();
+    if (cc > 1000000000) cc -= 1000000000;
+    if (cc < st->rts) cc = st->rts;
+    char hbuf[1+sizeof(uint64_t)];
+    char* wp = hbuf;
+    *(wp++) = kt::RemoteDB::BMNOP;
+    kc::writefixnum(wp, cc, sizeof(uint64_t));
+    if (!st->sess->send(hbuf, sizeof(hbuf))) return false;
+    st->nopt = now;
+    st->ackt = now;
+    return true;
+  }
+  // finish a stream
+  void finish(Stream* st) {
+    st->serv->log(kt::ThreadedServer::Logger::SYSTEM, "a slave was disconnected: sid=%u",
+                  st->sid);
+    if (!st->ulrd->close())
+      st->serv->log(kt::ThreadedServer::Logger::ERROR, "closing an update log reader failed");
+    delete st->ulrd;
+    st->serv->close_session(st->sess);
+    delete st;
+  }
+  kc::SpinLock lock_;
+  kt::UpdateLogger* const ulog_;
+  const double tout_;
+  std::vector<Stream*> adds_;
+  bool alive_;
+  kc::ZLIBCompressor<kc::ZLIB::RAW> comp_;
+};
+
+
 // plug-in server driver
 class PlugInDriver : public kc::Thread {
 public:
@@ -326,6 +753,72 @@ private:
 };
 
 
+// database opener implementation
+class DBOpener : public kc::Thread {
+public:
+  // constructor
+  explicit DBOpener(const std::vector<std::string>& dbpaths, kt::TimedDB* dbs, int32_t omode,
+                    const std::vector<std::string>& sspaths, kc::Compressor* bgscomp,
+                    int32_t bgsthnum, kt::RPCServer* serv,
+                    kc::AtomicInt64* cur, kc::AtomicInt64* errcnt) :
+    dbpaths_(dbpaths), dbs_(dbs), omode_(omode), sspaths_(sspaths), bgscomp_(bgscomp),
+    bgsthnum_(bgsthnum), serv_(serv), cur_(cur), errcnt_(errcnt) {}
+private:
+  // open databases until every one is taken
+  void run(void) {
+    int32_t dbnum = dbpaths_.size();
+    while (errcnt_->get() < 1) {
+      int32_t idx = cur_->add(1);
+      if (idx >= dbnum) break;
+      if (!open(idx)) errcnt_->add(1);
+    }
+  }
+  // open a database and apply its snapshot
+  bool open(int32_t idx) {
+    kt::TimedDB* db = dbs_ + idx;
+    const std::string& dbpath = dbpaths_[idx];
+    serv_->log(Logger::SYSTEM, "opening a database: path=%s", dbpath.c_str());
+    double stime = kc::time();
+    if (!db->open(dbpath, omode_)) {
+      const kc::BasicDB::Error& e = db->error();
+      serv_->log(Logger::ERROR, "could not open a database file: %s: %s: %s",
+                 dbpath.c_str(), e.name(), e.message());
+      return false;
+    }
+    serv_->log(Logger::SYSTEM, "opened a database: db=%d count=%lld size=%lld time=%.3f",
+               idx, (long long)db->count(), (long long)db->size(), kc::time() - stime);
+    const std::string& sspath = sspaths_[idx];
+    if (sspath.empty()) return true;
+    uint64_t ssts;
+    int64_t sscount, sssize;
+    if (kt::TimedDB::status_snapshot_atomic(sspath, &ssts, &sscount, &sssize)) {
+      serv_->log(Logger::SYSTEM,
+                 "applying a snapshot file: db=%d ts=%llu count=%lld size=%lld",
+                 idx, (unsigned long long)ssts, (long long)sscount, (long long)sssize);
+      stime = kc::time();
+      if (db->load_snapshot_atomic(sspath, bgscomp_, NULL, bgsthnum_)) {
+        serv_->log(Logger::SYSTEM, "applied a snapshot file: db=%d count=%lld time=%.3f",
+                   idx, (long long)db->count(), kc::time() - stime);
+      } else {
+        const kc::BasicDB::Error& e = db->error();
+        serv_->log(Logger::ERROR, "could not apply a snapshot: %s: %s",
+                   e.name(), e.message());
+      }
+    }
+    return true;
+  }
+  const std::vector<std::string>& dbpaths_;
+  kt::TimedDB* const dbs_;
+  const int32_t omode_;
+  const std::vector<std::string>& sspaths_;
+  kc::Compressor* const bgscomp_;
+  const int32_t bgsthnum_;
+  kt::RPCServer* const serv_;
+  kc::AtomicInt64* const cur_;
+  kc::AtomicInt64* const errcnt_;
+};
+
+
 // worker implementation
 class Worker : public kt::RPCServer::Worker {
 private:
@@ -336,18 +829,21 @@ public:
   explicit Worker(int32_t thnum, kt::TimedDB* dbs, int32_t dbnum,
                   const std::map<std::string, int32_t>& dbmap, int32_t omode,
                   double asi, bool ash, const char* bgspath, double bgsi,
-                  kc::Compressor* bgscomp, kt::UpdateLogger* ulog, DBUpdateLogger* ulogdbs,
+                  kc::Compressor* bgscomp, int32_t bgsthnum,
+                  kt::UpdateLogger* ulog, DBUpdateLogger* ulogdbs,
                   const char* cmdpath, ScriptProcessor* scrprocs, OpCount* opcounts) :
     thnum_(thnum), dbs_(dbs), dbnum_(dbnum), dbmap_(dbmap),
     omode_(omode), asi_(asi), ash_(ash), bgspath_(bgspath), bgsi_(bgsi), bgscomp_(bgscomp),
-    ulog_(ulog), ulogdbs_(ulogdbs), cmdpath_(cmdpath), scrprocs_(scrprocs), opcounts_(opcounts),
-    idlecnt_(0), asnext_(0), bgsnext_(0), slave_(NULL) {
+    bgsthnum_(bgsthnum), ulog_(ulog), ulogdbs_(ulogdbs), cmdpath_(cmdpath), scrprocs_(scrprocs),
+    opcounts_(opcounts),
+    idlecnt_(0), asnext_(0), bgsnext_(0), slave_(NULL), master_(NULL) {
     asnext_ = kc::time() + asi_;
     bgsnext_ = kc::time() + bgsi_;
   }
   // set miscellaneous configuration
-  void set_misc_conf(Slave* slave) {
+  void set_misc_conf(Slave* slave, Master* master) {
     slave_ = slave;
+    master_ = master;
   }
 private:
   // process each request of RPC.
@@ -601,7 +1097,7 @@ private:
     }
     if (bgspath_ && bgsi_ > 0 && kc::time() >= bgsnext_) {
       serv->log(Logger::INFO, "snapshotting databases");
-      dosnapshot(bgspath_, bgscomp_, dbs_, dbnum_, serv);
+      dosnapshot(bgspath_, bgscomp_, bgsthnum_, dbs_, dbnum_, serv);
       bgsnext_ = kc::time() + bgsi_;
     }
   }
@@ -2021,88 +2517,45 @@ private:
     uint64_t ts = kc::readfixnum(rp, sizeof(ts));
     rp += sizeof(ts);
     uint16_t sid = kc::readfixnum(rp, sizeof(sid));
-    bool white = flags & kt::ReplicationClient::WHITESID;
+    uint16_t fmt = dbformat(dbs_, dbnum_);
+    if ((flags & kt::ReplicationClient::FORMAT) ? (flags >> 16) != fmt :
+        dbstrict(dbs_, dbnum_)) {
+      char c = kt::RemoteDB::BMERROR;
+      sess->send(&c, 1);
+      serv->log(kt::ThreadedServer::Logger::ERROR,
+                "a slave with different database options was refused: sid=%u", sid);
+      return false;
+    }
     bool err = false;
     if (ulog_) {
-      kt::UpdateLogger::Reader ulrd;
-      if (ulrd.open(ulog_, ts)) {
-        char c = kt::RemoteDB::BMREPLICATION;
-        if (sess->send(&c, 1)) {
-          serv->log(kt::ThreadedServer::Logger::SYSTEM, "a slave was connected: ts=%llu sid=%u",
-                    (unsigned long long)ts, sid);
-          char stack[kc::NUMBUFSIZ+RECBUFSIZ*4];
-          uint64_t rts = 0;
-          int32_t miss = 0;
-          while (!err && !serv->aborted()) {
-            size_t msiz;
-            uint64_t mts;
-            char* mbuf = ulrd.read(&msiz, &mts);
-            if (mbuf) {
-              size_t rsiz;
-              uint16_t rsid = 0;
-              uint16_t rdbid = 0;
-              const char* rbuf = DBUpdateLogger::parse(mbuf, msiz, &rsiz, &rsid, &rdbid);
-              if (white) {
-                if (rsid != sid) rbuf = NULL;
-              } else {
-                if (rsid == sid) rbuf = NULL;
-              }
-              if (rbuf) {
-                miss = 0;
-                size_t nsiz = 1 + sizeof(uint64_t) + sizeof(uint32_t) + msiz;
-                char* nbuf = nsiz > sizeof(stack) ? new char[nsiz] : stack;
-                char* wp = nbuf;
-                *(wp++) = kt::RemoteDB::BMREPLICATION;
-                kc::writefixnum(wp, mts, sizeof(uint64_t));
-                wp += sizeof(uint64_t);
-                kc::writefixnum(wp, msiz, sizeof(uint32_t));
-                wp += sizeof(uint32_t);
-                std::memcpy(wp, mbuf, msiz);
-                if (!sess->send(nbuf, nsiz)) err = true;
-                if (nbuf != stack) delete[] nbuf;
-              } else {
-                miss++;
-                if (miss >= Slave::DUMMYFREQ) {
-                  char hbuf[1+sizeof(uint64_t)+sizeof(uint32_t)];
-                  char* wp = hbuf;
-                  *(wp++) = kt::RemoteDB::BMREPLICATION;
-                  kc::writefixnum(wp, mts, sizeof(uint64_t));
-                  wp += sizeof(uint64_t);
-                  kc::writefixnum(wp, 0, sizeof(uint32_t));
-                  if (!sess->send(hbuf, sizeof(hbuf))) err = true;
-                  miss = 0;
-                }
-              }
-              if (mts > rts) rts = mts;
-              delete[] mbuf;
-            } else {
-              uint64_t cc = kt::UpdateLogger::clock_pure();
-              if (cc > 1000000000) cc -= 1000000000;
-              if (cc < rts) cc = rts;
-              char hbuf[1+sizeof(uint64_t)];
-              char* wp = hbuf;
-              *(wp++) = kt::RemoteDB::BMNOP;
-              kc::writefixnum(wp, cc, sizeof(uint64_t));
-              if (!sess->send(hbuf, sizeof(hbuf)) ||
-                  sess->receive_byte() != kt::RemoteDB::BMREPLICATION)
-                err = true;
-              kc::Thread::sleep(0.1);
-            }
-          }
-          serv->log(kt::ThreadedServer::Logger::SYSTEM, "a slave was disconnected: sid=%u", sid);
-          if (!ulrd.close()) {
-            serv->log(kt::ThreadedServer::Logger::ERROR, "closing an update log reader failed");
-            err = true;
+      kt::UpdateLogger::Reader* ulrd = new kt::UpdateLogger::Reader;
+      if (ulrd->open(ulog_, ts)) {
+        char rbuf[1+sizeof(fmt)];
+        size_t rsiz = 1;
+        rbuf[0] = kt::RemoteDB::BMREPLICATION;
+        if (flags & kt::ReplicationClient::FORMATACK) {
+          kc::writefixnum(rbuf + rsiz, fmt, sizeof(fmt));
+          rsiz += sizeof(fmt);
+        }
+        if (sess->send(rbuf, rsiz)) {
+          serv->detach_session(sess);
+          if (master_->add(serv, sess, ulrd, sid, flags)) {
+            serv->log(kt::ThreadedServer::Logger::SYSTEM,
+                      "a slave was connected: ts=%llu sid=%u", (unsigned long long)ts, sid);
+            return true;
           }
-        } else {
-          err = true;
         }
+        if (!ulrd->close()) {
+          serv->log(kt::ThreadedServer::Logger::ERROR, "closing an update log reader failed");
+        }
+        err = true;
       } else {
         serv->log(kt::ThreadedServer::Logger::ERROR, "opening an update log reader failed");
         char c = kt::RemoteDB::BMERROR;
         sess->send(&c, 1);
         err = true;
       }
+      delete ulrd;
     } else {
       char c = kt::RemoteDB::BMERROR;
       sess->send(&c, 1);
@@ -2343,6 +2796,8 @@ private:
     char* obuf = (char*)kc::xmalloc(oasiz);
     size_t osiz = 1 + sizeof(uint32_t);
     std::memset(obuf, 0, osiz);
+    std::vector<size_t> marks;
+    std::vector<struct ::iovec> values;
     for (uint32_t i = 0; !err && i < rnum; i++) {
       char hbuf[sizeof(uint16_t)+sizeof(uint32_t)];
       if (sess->receive(hbuf, sizeof(hbuf))) {
@@ -2362,8 +2817,8 @@ private:
               char* vbuf = db->get(kbuf, ksiz, &vsiz, &xt);
               if (vbuf) {
                 hits++;
-                size_t usiz = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) +
-                  sizeof(int64_t) + ksiz + vsiz;
+                size_t usiz = sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint32_t) +
+                  sizeof(int64_t) + ksiz;
                 if (osiz + usiz > oasiz) {
                   oasiz = oasiz * 2 + usiz;
                   obuf = (char*)kc::xrealloc(obuf, oasiz);
@@ -2378,9 +2833,11 @@ private:
                 osiz += sizeof(int64_t);
                 std::memcpy(obuf + osiz, kbuf, ksiz);
                 osiz += ksiz;
-                std::memcpy(obuf + osiz, vbuf, vsiz);
-                osiz += vsiz;
-                delete[] vbuf;
+                marks.push_back(osiz);
+                struct ::iovec value;
+                value.iov_base = vbuf;
+                value.iov_len = vsiz;
+                values.push_back(value);
               } else {
                 opcounts_[thid][CNTGETMISS]++;
                 if (db->error() != kc::BasicDB::Error::NOREC) err = true;
@@ -2403,7 +2860,27 @@ private:
     } else {
       *obuf = kt::RemoteDB::BMGETBULK;
       kc::writefixnum(obuf + 1, hits, sizeof(hits));
-      if (!sess->send(obuf, osiz)) err = true;
+      std::vector<struct ::iovec> iovs;
+      iovs.reserve(values.size() * 2 + 1);
+      size_t pos = 0;
+      for (size_t i = 0; i < values.size(); i++) {
+        struct ::iovec head;
+        head.iov_base = obuf + pos;
+        head.iov_len = marks[i] - pos;
+        iovs.push_back(head);
+        iovs.push_back(values[i]);
+        pos = marks[i];
+      }
+      if (osiz > pos) {
+        struct ::iovec head;
+        head.iov_base = obuf + pos;
+        head.iov_len = osiz - pos;
+        iovs.push_back(head);
+      }
+      if (!sess->sendv(&iovs[0], iovs.size())) err = true;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      delete[] (char*)values[i].iov_base;
     }
     kc::xfree(obuf);
     return !err;
@@ -2442,6 +2919,7 @@ private:
   const char* const bgspath_;
   const double bgsi_;
   kc::Compressor* const bgscomp_;
+  const int32_t bgsthnum_;
   kt::UpdateLogger* const ulog_;
   DBUpdateLogger* const ulogdbs_;
   const char* const cmdpath_;
@@ -2451,6 +2929,7 @@ private:
   double asnext_;
   double bgsnext_;
   Slave* slave_;
+  Master* master_;
 };
 
 
@@ -2475,11 +2954,12 @@ static void usage() {
   eprintf("%s: Kyoto Tycoon: a handy cache/storage server\n", g_progname);
   eprintf("\n");
   eprintf("usage:\n");
-  eprintf("  %s [-host str] [-port num] [-tout num] [-th num] [-log file] [-li|-ls|-le|-lz]"
-          " [-ulog dir] [-ulim num] [-uasi num] [-sid num] [-ord] [-oat|-oas|-onl|-otl|-onr]"
-          " [-asi num] [-ash] [-bgs dir] [-bgsi num] [-bgc str]"
+  eprintf("  %s [-host str] [-port num] [-tout num] [-th num] [-rth num] [-et] [-log file]"
+          " [-li|-ls|-le|-lz] [-ulog dir] [-ulim num] [-uasi num] [-sid num] [-ord]"
+          " [-oat|-oas|-onl|-otl|-onr]"
+          " [-asi num] [-ash] [-bgs dir] [-bgsi num] [-bgc str] [-bgsth num]"
           " [-dmn] [-pid file] [-cmd dir] [-scr file]"
-          " [-mhost str] [-mport num] [-rts file] [-riv num]"
+          " [-mhost str] [-mport num] [-rts file] [-riv num] [-rcomp] [-rath num]"
           " [-plsv file] [-plex str] [-pldb file] [db...]\n", g_progname);
   eprintf("\n");
   std::exit(1);
@@ -2505,6 +2985,8 @@ static int32_t run(int argc, char** argv) {
   int32_t port = kt::DEFPORT;
   double tout = DEFTOUT;
   int32_t thnum = DEFTHNUM;
+  int32_t rthnum = 1;
+  bool et = false;
   const char* logpath = NULL;
   uint32_t logkinds = kc::UINT32MAX;
   const char* ulogpath = NULL;
@@ -2517,6 +2999,7 @@ static int32_t run(int argc, char** argv) {
   const char* bgspath = NULL;
   double bgsi = DEFBGSI;
   kc::Compressor* bgscomp = NULL;
+  int32_t bgsthnum = DEFBGSTHNUM;
   bool dmn = false;
   const char* pidpath = NULL;
   const char* cmdpath = NULL;
@@ -2525,6 +3008,8 @@ static int32_t run(int argc, char** argv) {
   int32_t mport = kt::DEFPORT;
   const char* rtspath = NULL;
   double riv = DEFRIV;
+  bool rcomp = false;
+  int32_t rathnum = 1;
   const char* plsvpath = NULL;
   const char* plsvex = "";
   const char* pldbpath = NULL;
@@ -2544,6 +3029,11 @@ static int32_t run(int argc, char** argv) {
       } else if (!std::strcmp(argv[i], "-th")) {
         if (++i >= argc) usage();
         thnum = kc::atof(argv[i]);
+      } else if (!std::strcmp(argv[i], "-rth")) {
+        if (++i >= argc) usage();
+        rthnum = kc::atof(argv[i]);
+      } else if (!std::strcmp(argv[i], "-et")) {
+        et = true;
       } else if (!std::strcmp(argv[i], "-log")) {
         if (++i >= argc) usage();
         logpath = argv[i];
@@ -2601,6 +3091,9 @@ static int32_t run(int argc, char** argv) {
         } else if (!kc::stricmp(cn, "lzma") || !kc::stricmp(cn, "xz")) {
           bgscomp = new kc::LZMACompressor<kc::LZMA::RAW>;
         }
+      } else if (!std::strcmp(argv[i], "-bgsth")) {
+        if (++i >= argc) usage();
+        bgsthnum = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-dmn")) {
         dmn = true;
       } else if (!std::strcmp(argv[i], "-pid")) {
@@ -2624,6 +3117,11 @@ static int32_t run(int argc, char** argv) {
       } else if (!std::strcmp(argv[i], "-riv")) {
         if (++i >= argc) usage();
         riv = kc::atof(argv[i]);
+      } else if (!std::strcmp(argv[i], "-rcomp")) {
+        rcomp = true;
+      } else if (!std::strcmp(argv[i], "-rath")) {
+        if (++i >= argc) usage();
+        rathnum = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-plsv")) {
         if (++i >= argc) usage();
         plsvpath = argv[i];
@@ -2641,13 +3139,16 @@ static int32_t run(int argc, char** argv) {
       dbpaths.push_back(argv[i]);
     }
   }
-  if (port < 1 || thnum < 1 || mport < 1) usage();
+  if (port < 1 || thnum < 1 || rthnum < 1 || mport < 1 || rathnum < 1 || bgsthnum < 1) usage();
   if (thnum > THREADMAX) thnum = THREADMAX;
+  if (rthnum > THREADMAX) rthnum = THREADMAX;
+  if (rathnum > THREADMAX) rathnum = THREADMAX;
+  if (bgsthnum > THREADMAX) bgsthnum = THREADMAX;
   if (dbpaths.empty()) dbpaths.push_back(":");
-  int32_t rv = proc(dbpaths, host, port, tout, thnum, logpath, logkinds,
+  int32_t rv = proc(dbpaths, host, port, tout, thnum, rthnum, et, logpath, logkinds,
                     ulogpath, ulim, uasi, sid, omode, asi, ash, bgspath, bgsi, bgscomp,
-                    dmn, pidpath, cmdpath, scrpath, mhost, mport, rtspath, riv,
-                    plsvpath, plsvex, pldbpath);
+                    bgsthnum, dmn, pidpath, cmdpath, scrpath, mhost, mport, rtspath, riv,
+                    rcomp, rathnum, plsvpath, plsvex, pldbpath);
   delete bgscomp;
   return rv;
 }
@@ -2656,12 +3157,14 @@ static int32_t run(int argc, char** argv) {
 // drive the server process
 static int32_t proc(const std::vector<std::string>& dbpaths,
                     const char* host, int32_t port, double tout, int32_t thnum,
-                    const char* logpath, uint32_t logkinds,
+                    int32_t rthnum, bool et, const char* logpath, uint32_t logkinds,
                     const char* ulogpath, int64_t ulim, double uasi,
                     int32_t sid, int32_t omode, double asi, bool ash,
-                    const char* bgspath, double bgsi, kc::Compressor* bgscomp, bool dmn,
+                    const char* bgspath, double bgsi, kc::Compressor* bgscomp,
+                    int32_t bgsthnum, bool dmn,
                     const char* pidpath, const char* cmdpath, const char* scrpath,
                     const char* mhost, int32_t mport, const char* rtspath, double riv,
+                    bool rcomp, int32_t rathnum,
                     const char* plsvpath, const char* plsvex, const char* pldbpath) {
   g_daemon = false;
   if (dmn) {
@@ -2771,7 +3274,7 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
     }
   }
   std::string expr = kc::strprintf("%s:%d", addr.c_str(), port);
-  serv.set_network(expr, tout);
+  serv.set_network(expr, tout, et ? kt::ThreadedServer::OEDGE : 0);
   int32_t dbnum = dbpaths.size();
   kt::UpdateLogger* ulog = NULL;
   DBUpdateLogger* ulogdbs = NULL;
@@ -2789,8 +3292,6 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
   DBLogger dblogger(&logger, logkinds);
   std::map<std::string, int32_t> dbmap;
   for (int32_t i = 0; i < dbnum; i++) {
-    const std::string& dbpath = dbpaths[i];
-    serv.log(Logger::SYSTEM, "opening a database: path=%s", dbpath.c_str());
     if (logkinds != 0)
       dbs[i].tune_logger(&dblogger, kc::BasicDB::Logger::WARN | kc::BasicDB::Logger::ERROR);
     if (ulog) {
@@ -2798,21 +3299,8 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
       dbs[i].tune_update_trigger(ulogdbs + i);
     }
     if (pldbinit) dbs[i].set_internal_db(pldbinit());
-    if (!dbs[i].open(dbpath, omode)) {
-      const kc::BasicDB::Error& e = dbs[i].error();
-      serv.log(Logger::ERROR, "could not open a database file: %s: %s: %s",
-               dbpath.c_str(), e.name(), e.message());
-      delete[] dbs;
-      delete[] ulogdbs;
-      delete ulog;
-      return 1;
-    }
-    std::string path = dbs[i].path();
-    const char* rp = path.c_str();
-    const char* pv = std::strrchr(rp, kc::File::PATHCHR);
-    if (pv) rp = pv + 1;
-    dbmap[rp] = i;
   }
+  std::vector<std::string> sspaths(dbnum);
   if (bgspath) {
     kc::DirStream dir;
     if (dir.open(bgspath)) {
@@ -2822,26 +3310,40 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
         const char* pv = std::strrchr(nstr, kc::File::EXTCHR);
         int32_t idx = kc::atoi(nstr);
         if (*nstr >= '0' && *nstr <= '9' && pv && !kc::stricmp(pv + 1, BGSPATHEXT) &&
-            idx >= 0 && idx < dbnum) {
-          std::string path;
-          kc::strprintf(&path, "%s%c%s", bgspath, kc::File::PATHCHR, nstr);
-          uint64_t ssts;
-          int64_t sscount, sssize;
-          if (kt::TimedDB::status_snapshot_atomic(path, &ssts, &sscount, &sssize)) {
-            serv.log(Logger::SYSTEM,
-                     "applying a snapshot file: db=%d ts=%llu count=%lld size=%lld",
-                     idx, (unsigned long long)ssts, (long long)sscount, (long long)sssize);
-            if (!dbs[idx].load_snapshot_atomic(path, bgscomp)) {
-              const kc::BasicDB::Error& e = dbs[idx].error();
-              serv.log(Logger::ERROR, "could not apply a snapshot: %s: %s",
-                       e.name(), e.message());
-            }
-          }
-        }
+            idx >= 0 && idx < dbnum)
+          kc::strprintf(&sspaths[idx], "%s%c%s", bgspath, kc::File::PATHCHR, nstr);
       }
       dir.close();
     }
   }
+  int32_t opthnum = thnum < dbnum ? thnum : dbnum;
+  serv.log(Logger::SYSTEM, "opening databases: num=%d threads=%d", dbnum, opthnum);
+  kc::AtomicInt64 opcur(0);
+  kc::AtomicInt64 operrcnt(0);
+  std::vector<DBOpener*> openers;
+  for (int32_t i = 0; i < opthnum; i++) {
+    DBOpener* opener = new DBOpener(dbpaths, dbs, omode, sspaths, bgscomp, bgsthnum, &serv,
+                                    &opcur, &operrcnt);
+    opener->start();
+    openers.push_back(opener);
+  }
+  for (size_t i = 0; i < openers.size(); i++) {
+    openers[i]->join();
+    delete openers[i];
+  }
+  if (operrcnt.get() > 0) {
+    delete[] dbs;
+    delete[] ulogdbs;
+    delete ulog;
+    return 1;
+  }
+  for (int32_t i = 0; i < dbnum; i++) {
+    std::string path = dbs[i].path();
+    const char* rp = path.c_str();
+    const char* pv = std::strrchr(rp, kc::File::PATHCHR);
+    if (pv) rp = pv + 1;
+    dbmap[rp] = i;
+  }
   ScriptProcessor* scrprocs = NULL;
   if (scrpath) {
     serv.log(Logger::SYSTEM, "loading a script file: path=%s", scrpath);
@@ -2890,9 +3392,9 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
       opcounts[i][j] = 0;
     }
   }
-  Worker worker(thnum, dbs, dbnum, dbmap, omode, asi, ash, bgspath, bgsi, bgscomp,
+  Worker worker(thnum, dbs, dbnum, dbmap, omode, asi, ash, bgspath, bgsi, bgscomp, bgsthnum,
                 ulog, ulogdbs, cmdpath, scrprocs, opcounts);
-  serv.set_worker(&worker, thnum);
+  serv.set_worker(&worker, thnum, rthnum);
   if (pidpath) {
     char numbuf[kc::NUMBUFSIZ];
     size_t nsiz = std::sprintf(numbuf, "%d\n", g_procid);
@@ -2902,14 +3404,24 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
   while (true) {
     g_restart = false;
     g_serv = &serv;
-    Slave slave(sid, rtspath, mhost, mport, riv, &serv, dbs, dbnum, ulog, ulogdbs);
+    uint32_t ropts = kt::ReplicationClient::BATCH | kt::ReplicationClient::FORMAT;
+    if (dbstrict(dbs, dbnum)) ropts |= kt::ReplicationClient::FORMATACK;
+    if (rcomp) ropts |= kt::ReplicationClient::COMPRESS;
+    Slave slave(sid, rtspath, mhost, mport, riv, ropts, rathnum, &serv,
+                dbs, dbnum, ulog, ulogdbs);
     slave.start();
-    worker.set_misc_conf(&slave);
+    Master master(ulog, tout);
+    master.start();
+    worker.set_misc_conf(&slave, &master);
     PlugInDriver pldriver(plsv);
     if (plsv) pldriver.start();
     if (serv.start()) {
+      master.stop();
+      master.join();
       if (!serv.finish()) err = true;
     } else {
+      master.stop();
+      master.join();
       err = true;
     }
     kc::Thread::sleep(0.5);
@@ -2954,7 +3466,7 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
   }
   if (bgspath) {
     serv.log(Logger::SYSTEM, "snapshotting databases");
-    if (!dosnapshot(bgspath, bgscomp, dbs, dbnum, &serv)) err = true;
+    if (!dosnapshot(bgspath, bgscomp, bgsthnum, dbs, dbnum, &serv)) err = true;
   }
   delete[] scrprocs;
   for (int32_t i = 0; i < dbnum; i++) {
@@ -2986,7 +3498,7 @@ static int32_t proc(const std::vector<std::string>& dbpaths,
 
 
 // snapshot all databases
-static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp,
+static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp, int32_t bgsthnum,
                        kt::TimedDB* dbs, int32_t dbnum, kt::RPCServer* serv) {
   bool err = false;
   for (int32_t i = 0; i < dbnum; i++) {
@@ -2998,8 +3510,17 @@ static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp,
     kc::strprintf(&tmppath, "%s%ctmp", destpath.c_str(), kc::File::EXTCHR);
     int32_t cnt = 0;
     while (true) {
-      if (db->dump_snapshot_atomic(tmppath, bgscomp)) {
-        if (!kc::File::rename(tmppath, destpath)) {
+      double stime = kc::time();
+      if (db->dump_snapshot_atomic(tmppath, bgscomp, NULL, bgsthnum)) {
+        if (kc::File::rename(tmppath, destpath)) {
+          uint64_t ssts;
+          int64_t sscount, sssize;
+          if (kt::TimedDB::status_snapshot_atomic(destpath, &ssts, &sscount, &sssize))
+            serv->log(Logger::INFO,
+                      "saved a snapshot file: db=%d ts=%llu count=%lld size=%lld time=%.3f",
+                      i, (unsigned long long)ssts, (long long)sscount, (long long)sssize,
+                      kc::time() - stime);
+        } else {
           serv->log(Logger::ERROR, "renaming a file failed: %s: %s",
                     tmppath.c_str(), destpath.c_str());
         }
@@ -3025,5 +3546,24 @@ static bool dosnapshot(const char* bgspath, kc::Compressor* bgscomp,
 }
 
 
+// calculate the digest of the formats of records of all databases
+static uint16_t dbformat(kt::TimedDB* dbs, int32_t dbnum) {
+  std::string markers;
+  for (int32_t i = 0; i < dbnum; i++) {
+    markers.push_back(dbs[i].format_marker());
+  }
+  return kc::hashmurmur(markers.data(), markers.size());
+}
+
+
+// check whether any database has a format of records incompatible with the legacy format
+static bool dbstrict(kt::TimedDB* dbs, int32_t dbnum) {
+  for (int32_t i = 0; i < dbnum; i++) {
+    if (dbs[i].strict_format()) return true;
+  }
+  return false;
+}
+
+
 
 // END OF FILE
@@ -22,6 +22,11 @@ extern "C" {
 }
 #elif defined(_KT_EVENT_KQUEUE)
 #include <sys/event.h>
+#elif defined(_KT_EVENT_IOURING)
+extern "C" {
+#include <poll.h>
+#include <liburing.h>
+}
 #endif
 
 namespace kyototycoon {                  // common namespace
@@ -35,6 +40,8 @@ const int32_t NAMEBUFSIZ = 256;          ///< size of the name buffer
 const int32_t IOBUFSIZ = 4096;           ///< size of the IO buffer
 const double WAITTIME = 0.1;             ///< interval to check timeout
 const int32_t RECVMAXSIZ = 1 << 30;      ///< maximum size to receive
+const int32_t URINGDEPTH = 1024;         ///< depth of the submission queue of io_uring
+const int32_t IOVECUNIT = 64;            ///< number of I/O vectors sent at once
 }
 
 
@@ -51,6 +58,9 @@ struct SocketCore {
   char* buf;                             ///< receiving buffer
   const char* rp;                        ///< reading pointer
   const char* ep;                        ///< end pointer
+  std::string obuf;                      ///< sending buffer
+  size_t opos;                           ///< sent position in the sending buffer
+  int64_t olimit;                        ///< limit of the sending buffer
 };
 
 
@@ -76,6 +86,7 @@ struct PollerCore {
   int32_t fd;                            ///< file descriptor
   std::set<Pollable*> events;            ///< monitored events
   std::set<Pollable*> hits;              ///< notified file descriptors
+  std::map<Pollable*, uint32_t> edges;   ///< registered flags of edge-triggered events
   kc::SpinLock elock;                    ///< lock for events
   bool aborted;                          ///< flag for abortion
 #elif defined(_KT_EVENT_KQUEUE)
@@ -83,8 +94,21 @@ struct PollerCore {
   int32_t fd;                            ///< file descriptor
   std::set<Pollable*> events;            ///< monitored events
   std::set<Pollable*> hits;              ///< notified file descriptors
+  std::map<Pollable*, uint32_t> edges;   ///< registered flags of edge-triggered events
   kc::SpinLock elock;                    ///< lock for events
   bool aborted;                          ///< flag for abortion
+#elif defined(_KT_EVENT_IOURING)
+  const char* errmsg;                    ///< error message
+  bool open;                             ///< flag for open
+  struct ::io_uring ring;                ///< ring of io_uring
+  std::set<Pollable*> events;            ///< monitored events
+  std::set<Pollable*> hits;              ///< notified file descriptors
+  std::map<Pollable*, uint64_t> tags;    ///< tags of the current requests of events
+  std::map<uint64_t, std::pair<Pollable*, uint32_t> > polls;  ///< requested events by tags
+  uint64_t gen;                          ///< generation counter of tags
+  bool oneshot;                          ///< flag to use oneshot requests for edge trigger
+  kc::SpinLock elock;                    ///< lock for events and submission
+  bool aborted;                          ///< flag for abortion
 #else
   const char* errmsg;                    ///< error message
   bool open;                             ///< flag for open
@@ -168,6 +192,16 @@ static void sockseterrmsg(SocketCore* core, const char* msg);
 static int32_t sockgetc(SocketCore* core);
 
 
+/**
+ * Send the data in the sending buffer of a socket.
+ * @param core the inner condition of the socket.
+ * @param block true to wait until all data is sent, or false to send as far as possible
+ * without blocking.
+ * @return true on success, or false on failure.
+ */
+static bool sockflushout(SocketCore* core, bool block);
+
+
 /**
  * Set the error message of a server.
  * @param core the inner condition of the server.
@@ -184,6 +218,31 @@ static void servseterrmsg(ServerSocketCore* core, const char* msg);
 static void pollseterrmsg(PollerCore* core, const char* msg);
 
 
+#if defined(_KT_EVENT_IOURING)
+/**
+ * Queue a poll request of io_uring.
+ * @param core the inner condition of the poller.
+ * @param event the pollable event object.
+ * @param flags the event flags to be monitored.
+ * @return true on success, or false on failure.
+ * @note The lock for events must be held.  The request is not submitted.  The request is
+ * tagged with a new generation number so that a stale completion of a previous request is
+ * never taken for the current one.
+ */
+static bool pollprepuring(PollerCore* core, Pollable* event, uint32_t flags);
+
+
+/**
+ * Queue a removal request of a poll request of io_uring.
+ * @param core the inner condition of the poller.
+ * @param tag the tag of the poll request.
+ * @return true on success, or false on failure.
+ * @note The lock for events must be held.  The request is not submitted.
+ */
+static bool pollcanceluring(PollerCore* core, uint64_t tag);
+#endif
+
+
 /**
  * Default constructor.
  */
@@ -198,6 +257,8 @@ Socket::Socket() {
   core->rp = NULL;
   core->ep = NULL;
   core->evflags = 0;
+  core->opos = 0;
+  core->olimit = 0;
   opq_ = core;
   ignoresignal();
 }
@@ -315,6 +376,7 @@ bool Socket::close(bool grace) {
     return false;
   }
   bool err = false;
+  if (grace && core->opos < core->obuf.size() && !sockflushout(core, true)) err = true;
   int32_t flags = ::fcntl(core->fd, F_GETFL, NULL);
   if (::fcntl(core->fd, F_SETFL, flags | O_NONBLOCK) != 0) {
     sockseterrmsg(core, "fcntl failed");
@@ -351,6 +413,8 @@ bool Socket::close(bool grace) {
   core->buf = NULL;
   core->rp = NULL;
   core->ep = NULL;
+  core->obuf.clear();
+  core->opos = 0;
   core->aborted = false;
   return !err;
 }
@@ -361,58 +425,132 @@ bool Socket::close(bool grace) {
  */
 bool Socket::send(const void* buf, size_t size) {
   _assert_(buf && size <= kc::MEMMAXSIZ);
+  struct ::iovec iov;
+  iov.iov_base = (void*)buf;
+  iov.iov_len = size;
+  return sendv(&iov, 1);
+}
+
+
+/**
+ * Send data.
+ */
+bool Socket::send(const std::string& str) {
+  _assert_(true);
+  return send(str.data(), str.size());
+}
+
+
+/**
+ * Send data in multiple regions at once.
+ */
+bool Socket::sendv(const struct ::iovec* iov, size_t num) {
+  _assert_(iov && num <= kc::MEMMAXSIZ);
   SocketCore* core = (SocketCore*)opq_;
   if (core->fd < 1) {
     sockseterrmsg(core, "not opened");
     return false;
   }
-  const char* rp = (const char*)buf;
-  double ct = kc::time();
-  while (size > 0) {
-    int32_t wb = ::send(core->fd, rp, size, 0);
-    switch (wb) {
-      case -1: {
-        if (!checkerrnoretriable(errno)) {
-          sockseterrmsg(core, "send failed");
-          return false;
-        }
-        if (kc::time() > ct + core->timeout) {
-          sockseterrmsg(core, "operation timed out");
-          return false;
+  bool buffered = core->olimit > 0;
+  if (core->opos < core->obuf.size()) {
+    if (!sockflushout(core, !buffered)) return false;
+    if (core->opos < core->obuf.size()) {
+      size_t total = 0;
+      for (size_t i = 0; i < num; i++) {
+        total += iov[i].iov_len;
+      }
+      if ((int64_t)(core->obuf.size() - core->opos + total) <= core->olimit) {
+        core->obuf.erase(0, core->opos);
+        core->opos = 0;
+        for (size_t i = 0; i < num; i++) {
+          core->obuf.append((const char*)iov[i].iov_base, iov[i].iov_len);
         }
-        if (core->aborted) {
-          sockseterrmsg(core, "operation was aborted");
-          return false;
+        return true;
+      }
+      if (!sockflushout(core, true)) return false;
+    }
+  }
+  size_t idx = 0;
+  size_t off = 0;
+  double ct = kc::time();
+  while (idx < num) {
+    struct ::iovec vec[IOVECUNIT];
+    int32_t vnum = 0;
+    size_t end = idx;
+    while (end < num && vnum < IOVECUNIT) {
+      const char* base = (const char*)iov[end].iov_base;
+      size_t len = iov[end].iov_len;
+      if (end == idx) {
+        base += off;
+        len -= off;
+      }
+      if (len > 0) {
+        vec[vnum].iov_base = (void*)base;
+        vec[vnum].iov_len = len;
+        vnum++;
+      }
+      end++;
+    }
+    if (vnum < 1) break;
+    struct ::msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = vnum;
+    int32_t flags = buffered ? MSG_DONTWAIT : 0;
+#if defined(MSG_MORE)
+    if (end < num) flags |= MSG_MORE;
+#endif
+    int64_t wb = ::sendmsg(core->fd, &msg, flags);
+    if (wb < 0) {
+      int32_t ecode = errno;
+      if (!checkerrnoretriable(ecode)) {
+        sockseterrmsg(core, "sendmsg failed");
+        return false;
+      }
+      if (buffered && (ecode == EAGAIN || ecode == EWOULDBLOCK)) {
+        size_t rest = iov[idx].iov_len - off;
+        for (size_t i = idx + 1; i < num; i++) {
+          rest += iov[i].iov_len;
         }
-        if (!waitsocket(core->fd, 1, WAITTIME)) {
-          sockseterrmsg(core, "waitsocket failed");
-          return false;
+        if ((int64_t)rest <= core->olimit) {
+          core->obuf.append((const char*)iov[idx].iov_base + off, iov[idx].iov_len - off);
+          for (size_t i = idx + 1; i < num; i++) {
+            core->obuf.append((const char*)iov[i].iov_base, iov[i].iov_len);
+          }
+          return true;
         }
-        break;
+        buffered = false;
       }
-      case 0: {
-        break;
+      if (kc::time() > ct + core->timeout) {
+        sockseterrmsg(core, "operation timed out");
+        return false;
+      }
+      if (core->aborted) {
+        sockseterrmsg(core, "operation was aborted");
+        return false;
       }
-      default: {
-        rp += wb;
-        size -= wb;
+      if (!waitsocket(core->fd, 1, WAITTIME)) {
+        sockseterrmsg(core, "waitsocket failed");
+        return false;
+      }
+      continue;
+    }
+    size_t left = wb;
+    while (idx < num) {
+      size_t rem = iov[idx].iov_len - off;
+      if (rem > left) {
+        off += left;
         break;
       }
+      left -= rem;
+      idx++;
+      off = 0;
     }
   }
   return true;
 }
 
 
-/**
- * Send data.
- */
-bool Socket::send(const std::string& str) {
-  _assert_(true);
-  return send(str.data(), str.size());
-}
-
-
 /**
  * Send formatted data.
  */
@@ -537,6 +675,65 @@ size_t Socket::left_size() {
 }
 
 
+/**
+ * Check whether some data can be received without blocking.
+ */
+bool Socket::check_input() {
+  _assert_(true);
+  SocketCore* core = (SocketCore*)opq_;
+  if (core->fd < 0) {
+    sockseterrmsg(core, "not opened");
+    return false;
+  }
+  if (core->rp < core->ep) return true;
+  if (!core->buf) core->buf = new char[IOBUFSIZ];
+  int32_t rv = ::recv(core->fd, core->buf, IOBUFSIZ, MSG_DONTWAIT);
+  if (rv > 0) {
+    core->rp = core->buf;
+    core->ep = core->buf + rv;
+    return true;
+  }
+  core->rp = core->buf;
+  core->ep = core->buf;
+  if (rv < 0 && checkerrnoretriable(errno)) return false;
+  return true;
+}
+
+
+/**
+ * Set the limit of the sending buffer.
+ */
+void Socket::set_send_buffer(int64_t limit) {
+  _assert_(true);
+  SocketCore* core = (SocketCore*)opq_;
+  core->olimit = limit;
+}
+
+
+/**
+ * Get the size of left data in the sending buffer.
+ */
+size_t Socket::pending_size() {
+  _assert_(true);
+  SocketCore* core = (SocketCore*)opq_;
+  return core->obuf.size() - core->opos;
+}
+
+
+/**
+ * Send the data in the sending buffer as far as possible without blocking.
+ */
+bool Socket::flush() {
+  _assert_(true);
+  SocketCore* core = (SocketCore*)opq_;
+  if (core->fd < 1) {
+    sockseterrmsg(core, "not opened");
+    return false;
+  }
+  return sockflushout(core, false);
+}
+
+
 /**
  * Abort the current operation.
  */
@@ -698,7 +895,7 @@ const char* ServerSocket::error() {
 /**
  * Open a server socket.
  */
-bool ServerSocket::open(const std::string& expr) {
+bool ServerSocket::open(const std::string& expr, uint32_t opts) {
   _assert_(true);
   ServerSocketCore* core = (ServerSocketCore*)opq_;
   if (core->fd > 0) {
@@ -734,6 +931,19 @@ bool ServerSocket::open(const std::string& expr) {
   }
   int32_t optint = 1;
   ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char*)&optint, sizeof(optint));
+  if (opts & OREUSEPORT) {
+#if defined(SO_REUSEPORT)
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char*)&optint, sizeof(optint)) != 0) {
+      servseterrmsg(core, "setsockopt failed");
+      ::close(fd);
+      return false;
+    }
+#else
+    servseterrmsg(core, "SO_REUSEPORT is not supported");
+    ::close(fd);
+    return false;
+#endif
+  }
   if (::bind(fd, (struct sockaddr*)&sain, sizeof(sain)) != 0) {
     servseterrmsg(core, "bind failed");
     ::close(fd);
@@ -940,6 +1150,17 @@ Poller::Poller() {
   opq_ = core;
   ignoresignal();
   dummysighandler(0);
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = new PollerCore;
+  core->errmsg = NULL;
+  core->open = false;
+  core->gen = 0;
+  core->oneshot = false;
+  core->aborted = false;
+  opq_ = core;
+  ignoresignal();
+  dummysighandler(0);
 #else
   _assert_(true);
   PollerCore* core = new PollerCore;
@@ -968,6 +1189,11 @@ Poller::~Poller() {
   PollerCore* core = (PollerCore*)opq_;
   if (core->fd >= 0) close();
   delete core;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (core->open) close();
+  delete core;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -991,6 +1217,11 @@ const char* Poller::error() {
   PollerCore* core = (PollerCore*)opq_;
   if (!core->errmsg) return "no error";
   return core->errmsg;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->errmsg) return "no error";
+  return core->errmsg;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1032,6 +1263,24 @@ bool Poller::open() {
   }
   core->fd = fd;
   return true;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (core->open) {
+    pollseterrmsg(core, "already opened");
+    return false;
+  }
+  if (::io_uring_queue_init(URINGDEPTH, &core->ring, 0) != 0) {
+    pollseterrmsg(core, "io_uring_queue_init failed");
+    return false;
+  }
+  if (!(core->ring.features & IORING_FEAT_EXT_ARG)) {
+    pollseterrmsg(core, "io_uring without timed waiting is not supported");
+    ::io_uring_queue_exit(&core->ring);
+    return false;
+  }
+  core->open = true;
+  return true;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1063,6 +1312,7 @@ bool Poller::close() {
   }
   core->hits.clear();
   core->events.clear();
+  core->edges.clear();
   core->fd = -1;
   core->aborted = false;
   return !err;
@@ -1080,9 +1330,26 @@ bool Poller::close() {
   }
   core->hits.clear();
   core->events.clear();
+  core->edges.clear();
   core->fd = -1;
   core->aborted = false;
   return !err;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  ::io_uring_queue_exit(&core->ring);
+  core->hits.clear();
+  core->events.clear();
+  core->tags.clear();
+  core->polls.clear();
+  core->oneshot = false;
+  core->open = false;
+  core->aborted = false;
+  return true;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1114,7 +1381,7 @@ bool Poller::deposit(Pollable* event) {
   struct ::epoll_event ev;
   std::memset(&ev, 0, sizeof(ev));
   uint32_t flags = event->event_flags();
-  ev.events = EPOLLONESHOT;
+  ev.events = (flags & Pollable::EVEDGE) ? EPOLLET : EPOLLONESHOT;
   if (flags & Pollable::EVINPUT) ev.events |= EPOLLIN;
   if (flags & Pollable::EVOUTPUT) ev.events |= EPOLLOUT;
   if (flags & Pollable::EVEXCEPT) ev.events |= EPOLLHUP | EPOLLPRI;
@@ -1125,6 +1392,7 @@ bool Poller::deposit(Pollable* event) {
     return false;
   }
   core->events.insert(event);
+  if (flags & Pollable::EVEDGE) core->edges[event] = flags;
   core->elock.unlock();
   return true;
 #elif defined(_KT_EVENT_KQUEUE)
@@ -1135,19 +1403,39 @@ bool Poller::deposit(Pollable* event) {
     return false;
   }
   core->elock.lock();
-  struct ::kevent ev;
-  std::memset(&ev, 0, sizeof(ev));
+  struct ::kevent evs[2];
+  std::memset(evs, 0, sizeof(evs));
+  int32_t evnum = 0;
   uint32_t flags = event->event_flags();
-  uint32_t filter = 0;
-  if (flags & Pollable::EVINPUT) filter |= EVFILT_READ;
-  if (flags & Pollable::EVOUTPUT) filter |= EVFILT_WRITE;
-  EV_SET(&ev, event->descriptor(), filter, EV_ADD | EV_ONESHOT, 0, 0, event);
-  if (::kevent(core->fd, &ev, 1, NULL, 0, NULL) != 0) {
+  uint32_t mode = (flags & Pollable::EVEDGE) ? EV_CLEAR : EV_ONESHOT;
+  if (flags & Pollable::EVINPUT)
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_READ, EV_ADD | mode, 0, 0, event);
+  if (flags & Pollable::EVOUTPUT)
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_WRITE, EV_ADD | mode, 0, 0, event);
+  if (::kevent(core->fd, evs, evnum, NULL, 0, NULL) != 0) {
     pollseterrmsg(core, "kevent failed a");
     core->elock.unlock();
     return false;
   }
   core->events.insert(event);
+  if (flags & Pollable::EVEDGE) core->edges[event] = flags;
+  core->elock.unlock();
+  return true;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(event);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  core->elock.lock();
+  if (!pollprepuring(core, event, event->event_flags()) ||
+      ::io_uring_submit(&core->ring) < 0) {
+    pollseterrmsg(core, "io_uring_submit failed");
+    core->elock.unlock();
+    return false;
+  }
+  core->events.insert(event);
   core->elock.unlock();
   return true;
 #else
@@ -1183,6 +1471,7 @@ bool Poller::withdraw(Pollable* event) {
   bool err = false;
   core->elock.lock();
   core->events.erase(event);
+  core->edges.erase(event);
   if (::epoll_ctl(core->fd, EPOLL_CTL_DEL, event->descriptor(), NULL) != 0) {
     pollseterrmsg(core, "epoll_ctl failed");
     err = true;
@@ -1199,6 +1488,35 @@ bool Poller::withdraw(Pollable* event) {
   bool err = false;
   core->elock.lock();
   core->events.erase(event);
+  core->edges.erase(event);
+  core->elock.unlock();
+  return !err;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(event);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  bool err = false;
+  core->elock.lock();
+  core->events.erase(event);
+  uint64_t tag = 0;
+  std::map<Pollable*, uint64_t>::iterator tit = core->tags.find(event);
+  if (tit != core->tags.end()) {
+    tag = tit->second;
+    core->polls.erase(tag);
+    core->tags.erase(tit);
+  }
+  if (pollcanceluring(core, tag)) {
+    if (::io_uring_submit(&core->ring) < 0) {
+      pollseterrmsg(core, "io_uring_submit failed");
+      err = true;
+    }
+  } else {
+    pollseterrmsg(core, "io_uring_get_sqe failed");
+    err = true;
+  }
   core->elock.unlock();
   return !err;
 #else
@@ -1251,6 +1569,23 @@ Pollable* Poller::next() {
   core->hits.erase(item);
   core->elock.unlock();
   return item;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return NULL;
+  }
+  core->elock.lock();
+  if (core->hits.empty()) {
+    pollseterrmsg(core, "no event");
+    core->elock.unlock();
+    return NULL;
+  }
+  Pollable* item = *core->hits.begin();
+  core->hits.erase(item);
+  core->elock.unlock();
+  return item;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1283,11 +1618,16 @@ bool Poller::undo(Pollable* event) {
     pollseterrmsg(core, "not opened");
     return false;
   }
+  uint32_t flags = event->event_flags();
   core->elock.lock();
+  std::map<Pollable*, uint32_t>::iterator eit = core->edges.find(event);
+  if ((flags & Pollable::EVEDGE) && eit != core->edges.end() && eit->second == flags) {
+    core->elock.unlock();
+    return true;
+  }
   struct ::epoll_event ev;
   std::memset(&ev, 0, sizeof(ev));
-  uint32_t flags = event->event_flags();
-  ev.events = EPOLLONESHOT;
+  ev.events = (flags & Pollable::EVEDGE) ? EPOLLET : EPOLLONESHOT;
   if (flags & Pollable::EVINPUT) ev.events |= EPOLLIN;
   if (flags & Pollable::EVOUTPUT) ev.events |= EPOLLOUT;
   if (flags & Pollable::EVEXCEPT) ev.events |= EPOLLHUP | EPOLLPRI;
@@ -1297,6 +1637,11 @@ bool Poller::undo(Pollable* event) {
     core->elock.unlock();
     return false;
   }
+  if (flags & Pollable::EVEDGE) {
+    core->edges[event] = flags;
+  } else if (eit != core->edges.end()) {
+    core->edges.erase(eit);
+  }
   core->elock.unlock();
   return true;
 #elif defined(_KT_EVENT_KQUEUE)
@@ -1306,19 +1651,70 @@ bool Poller::undo(Pollable* event) {
     pollseterrmsg(core, "not opened");
     return false;
   }
-  core->elock.lock();
-  struct ::kevent ev;
-  std::memset(&ev, 0, sizeof(ev));
   uint32_t flags = event->event_flags();
-  uint32_t filter = 0;
-  if (flags & Pollable::EVINPUT) filter |= EVFILT_READ;
-  if (flags & Pollable::EVOUTPUT) filter |= EVFILT_WRITE;
-  EV_SET(&ev, event->descriptor(), filter, EV_ADD | EV_ONESHOT, 0, 0, event);
-  if (::kevent(core->fd, &ev, 1, NULL, 0, NULL) != 0) {
+  core->elock.lock();
+  std::map<Pollable*, uint32_t>::iterator eit = core->edges.find(event);
+  uint32_t oflags = eit != core->edges.end() ? eit->second : 0;
+  if ((flags & Pollable::EVEDGE) && oflags == flags) {
+    core->elock.unlock();
+    return true;
+  }
+  struct ::kevent evs[4];
+  std::memset(evs, 0, sizeof(evs));
+  int32_t evnum = 0;
+  uint32_t mode = (flags & Pollable::EVEDGE) ? EV_CLEAR : EV_ONESHOT;
+  if (flags & Pollable::EVINPUT) {
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_READ, EV_ADD | mode, 0, 0, event);
+  } else if (oflags & Pollable::EVINPUT) {
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_READ, EV_DELETE, 0, 0, event);
+  }
+  if (flags & Pollable::EVOUTPUT) {
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_WRITE, EV_ADD | mode, 0, 0, event);
+  } else if (oflags & Pollable::EVOUTPUT) {
+    EV_SET(evs + evnum++, event->descriptor(), EVFILT_WRITE, EV_DELETE, 0, 0, event);
+  }
+  if (::kevent(core->fd, evs, evnum, NULL, 0, NULL) != 0) {
     pollseterrmsg(core, "kevent failed");
     core->elock.unlock();
     return false;
   }
+  if (flags & Pollable::EVEDGE) {
+    core->edges[event] = flags;
+  } else if (eit != core->edges.end()) {
+    core->edges.erase(eit);
+  }
+  core->elock.unlock();
+  return true;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(event);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  uint32_t flags = event->event_flags();
+  core->elock.lock();
+  if ((flags & Pollable::EVEDGE) && !core->oneshot) {
+    std::map<Pollable*, uint64_t>::iterator tit = core->tags.find(event);
+    if (tit != core->tags.end()) {
+      std::map<uint64_t, std::pair<Pollable*, uint32_t> >::iterator pit =
+        core->polls.find(tit->second);
+      if (pit != core->polls.end() && pit->second.second == flags) {
+        core->elock.unlock();
+        return true;
+      }
+      if (!pollcanceluring(core, tit->second)) {
+        pollseterrmsg(core, "io_uring_get_sqe failed");
+        core->elock.unlock();
+        return false;
+      }
+    }
+  }
+  if (!pollprepuring(core, event, flags) || ::io_uring_submit(&core->ring) < 0) {
+    pollseterrmsg(core, "io_uring_submit failed");
+    core->elock.unlock();
+    return false;
+  }
   core->elock.unlock();
   return true;
 #else
@@ -1362,7 +1758,7 @@ bool Poller::wait(double timeout) {
       for (int32_t i = 0; i < rv; i++) {
         Pollable* item = (Pollable*)events[i].data.ptr;
         uint32_t epflags = events[i].events;
-        uint32_t flags = 0;
+        uint32_t flags = item->event_flags() & Pollable::EVEDGE;
         if (epflags & EPOLLIN) flags |= Pollable::EVINPUT;
         if (epflags & EPOLLOUT) flags |= Pollable::EVOUTPUT;
         if ((epflags & EPOLLHUP) || (epflags & EPOLLPRI)) flags |= Pollable::EVEXCEPT;
@@ -1412,10 +1808,10 @@ bool Poller::wait(double timeout) {
     if (rv > 0) {
       for (int32_t i = 0; i < rv; i++) {
         Pollable* item = (Pollable*)events[i].udata;
-        uint32_t filter = events[i].filter;
-        uint32_t flags = 0;
-        if (filter & EVFILT_READ) flags |= Pollable::EVINPUT;
-        if (filter & EVFILT_WRITE) flags |= Pollable::EVOUTPUT;
+        int32_t filter = events[i].filter;
+        uint32_t flags = item->event_flags() & Pollable::EVEDGE;
+        if (filter == EVFILT_READ) flags |= Pollable::EVINPUT;
+        if (filter == EVFILT_WRITE) flags |= Pollable::EVOUTPUT;
         core->elock.lock();
         if (core->hits.insert(item).second) {
           item->set_event_flags(flags);
@@ -1441,6 +1837,92 @@ bool Poller::wait(double timeout) {
     }
   }
   return false;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  if (timeout <= 0) timeout = kc::UINT32MAX;
+  core->hits.clear();
+  double ct = kc::time();
+  while (true) {
+    double integ, fract;
+    fract = std::modf(WAITTIME, &integ);
+    struct ::__kernel_timespec ts;
+    ts.tv_sec = integ;
+    ts.tv_nsec = fract * 999999000;
+    struct ::io_uring_cqe* cqe;
+    int32_t rv = ::io_uring_wait_cqe_timeout(&core->ring, &cqe, &ts);
+    if (rv == 0) {
+      struct ::io_uring_cqe* cqes[256];
+      core->elock.lock();
+      uint32_t num = ::io_uring_peek_batch_cqe(&core->ring, cqes, sizeof(cqes) / sizeof(*cqes));
+      bool rearm = false;
+      bool err = false;
+      for (uint32_t i = 0; i < num; i++) {
+        std::map<uint64_t, std::pair<Pollable*, uint32_t> >::iterator pit =
+          core->polls.find(cqes[i]->user_data);
+        if (pit == core->polls.end()) continue;
+        Pollable* item = pit->second.first;
+        uint32_t rflags = pit->second.second;
+        int32_t res = cqes[i]->res;
+        bool more = cqes[i]->flags & IORING_CQE_F_MORE;
+        uint32_t flags = rflags & Pollable::EVEDGE;
+        if (res < 0) {
+          if (res == -EINVAL && (rflags & Pollable::EVEDGE) && !core->oneshot) {
+            core->oneshot = true;
+            if (pollprepuring(core, item, rflags)) {
+              rearm = true;
+            } else {
+              err = true;
+            }
+            continue;
+          }
+          flags |= Pollable::EVEXCEPT;
+        } else {
+          if (res & POLLIN) flags |= Pollable::EVINPUT;
+          if (res & POLLOUT) flags |= Pollable::EVOUTPUT;
+          if ((res & POLLHUP) || (res & POLLPRI) || (res & POLLERR)) flags |= Pollable::EVEXCEPT;
+          if ((rflags & Pollable::EVEDGE) && !more && !core->oneshot) {
+            if (pollprepuring(core, item, rflags)) {
+              rearm = true;
+            } else {
+              err = true;
+            }
+          }
+        }
+        if (core->hits.insert(item).second) {
+          item->set_event_flags(flags);
+        } else {
+          uint32_t oflags = item->event_flags();
+          item->set_event_flags(oflags | flags);
+        }
+      }
+      ::io_uring_cq_advance(&core->ring, num);
+      if (err || (rearm && ::io_uring_submit(&core->ring) < 0)) {
+        pollseterrmsg(core, "io_uring_submit failed");
+        core->elock.unlock();
+        break;
+      }
+      core->elock.unlock();
+      if (!core->hits.empty()) return true;
+    } else if (rv == -ETIME || rv == -EINTR || rv == -EAGAIN) {
+      if (kc::time() > ct + timeout) {
+        pollseterrmsg(core, "operation timed out");
+        break;
+      }
+      if (core->aborted) {
+        pollseterrmsg(core, "operation was aborted");
+        break;
+      }
+    } else {
+      pollseterrmsg(core, "io_uring_wait_cqe_timeout failed");
+      break;
+    }
+  }
+  return false;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1620,6 +2102,25 @@ bool Poller::flush() {
   }
   core->elock.unlock();
   return true;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  core->elock.lock();
+  core->hits.clear();
+  std::set<Pollable*>::iterator it = core->events.begin();
+  std::set<Pollable*>::iterator itend = core->events.end();
+  while (it != itend) {
+    Pollable* item = *it;
+    item->set_event_flags(0);
+    core->hits.insert(item);
+    ++it;
+  }
+  core->elock.unlock();
+  return true;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1669,6 +2170,17 @@ int64_t Poller::count() {
   int64_t count = core->events.size();
   core->elock.unlock();
   return count;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return -1;
+  }
+  core->elock.lock();
+  int64_t count = core->events.size();
+  core->elock.unlock();
+  return count;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1706,6 +2218,15 @@ bool Poller::abort() {
   }
   core->aborted = true;
   return true;
+#elif defined(_KT_EVENT_IOURING)
+  _assert_(true);
+  PollerCore* core = (PollerCore*)opq_;
+  if (!core->open) {
+    pollseterrmsg(core, "not opened");
+    return false;
+  }
+  core->aborted = true;
+  return true;
 #else
   _assert_(true);
   PollerCore* core = (PollerCore*)opq_;
@@ -1877,8 +2398,9 @@ static int32_t sockgetc(SocketCore* core) {
     core->ep = core->buf;
   }
   double ct = kc::time();
+  bool flush = core->opos < core->obuf.size();
   while (true) {
-    int32_t rv = ::recv(core->fd, core->buf, IOBUFSIZ, 0);
+    int32_t rv = ::recv(core->fd, core->buf, IOBUFSIZ, flush ? MSG_DONTWAIT : 0);
     if (rv > 0) {
       core->rp = core->buf + 1;
       core->ep = core->buf + rv;
@@ -1888,6 +2410,11 @@ static int32_t sockgetc(SocketCore* core) {
       return -1;
     }
     if (!checkerrnoretriable(errno)) break;
+    if (flush) {
+      if (!sockflushout(core, true)) return -1;
+      flush = false;
+      continue;
+    }
     if (kc::time() > ct + core->timeout) {
       sockseterrmsg(core, "operation timed out");
       return -1;
@@ -1906,6 +2433,45 @@ static int32_t sockgetc(SocketCore* core) {
 }
 
 
+/**
+ * Send the data in the sending buffer of a socket.
+ */
+static bool sockflushout(SocketCore* core, bool block) {
+  _assert_(core);
+  double ct = kc::time();
+  while (core->opos < core->obuf.size()) {
+    int32_t wb = ::send(core->fd, core->obuf.data() + core->opos,
+                        core->obuf.size() - core->opos, block ? 0 : MSG_DONTWAIT);
+    if (wb > 0) {
+      core->opos += wb;
+      continue;
+    }
+    if (wb == 0) continue;
+    int32_t ecode = errno;
+    if (!checkerrnoretriable(ecode)) {
+      sockseterrmsg(core, "send failed");
+      return false;
+    }
+    if (!block && (ecode == EAGAIN || ecode == EWOULDBLOCK)) return true;
+    if (kc::time() > ct + core->timeout) {
+      sockseterrmsg(core, "operation timed out");
+      return false;
+    }
+    if (core->aborted) {
+      sockseterrmsg(core, "operation was aborted");
+      return false;
+    }
+    if (!waitsocket(core->fd, 1, WAITTIME)) {
+      sockseterrmsg(core, "waitsocket failed");
+      return false;
+    }
+  }
+  core->obuf.clear();
+  core->opos = 0;
+  return true;
+}
+
+
 /**
  * Set the error message of a server.
  */
@@ -1924,6 +2490,60 @@ static void pollseterrmsg(PollerCore* core, const char* msg) {
 }
 
 
+#if defined(_KT_EVENT_IOURING)
+/**
+ * Queue a poll request of io_uring.
+ */
+static bool pollprepuring(PollerCore* core, Pollable* event, uint32_t flags) {
+  _assert_(core && event);
+  struct ::io_uring_sqe* sqe = ::io_uring_get_sqe(&core->ring);
+  if (!sqe) {
+    if (::io_uring_submit(&core->ring) < 0) return false;
+    sqe = ::io_uring_get_sqe(&core->ring);
+    if (!sqe) return false;
+  }
+  uint32_t mask = 0;
+  if (flags & Pollable::EVINPUT) mask |= POLLIN;
+  if (flags & Pollable::EVOUTPUT) mask |= POLLOUT;
+  if (flags & Pollable::EVEXCEPT) mask |= POLLHUP | POLLPRI;
+  if ((flags & Pollable::EVEDGE) && !core->oneshot) {
+    ::io_uring_prep_poll_multishot(sqe, event->descriptor(), mask);
+  } else {
+    ::io_uring_prep_poll_add(sqe, event->descriptor(), mask);
+  }
+  uint64_t tag = ++core->gen;
+  std::map<Pollable*, uint64_t>::iterator it = core->tags.find(event);
+  if (it != core->tags.end()) {
+    core->polls.erase(it->second);
+    it->second = tag;
+  } else {
+    core->tags[event] = tag;
+  }
+  core->polls[tag] = std::make_pair(event, flags);
+  sqe->user_data = tag;
+  return true;
+}
+
+
+/**
+ * Queue a removal request of a poll request of io_uring.
+ */
+static bool pollcanceluring(PollerCore* core, uint64_t tag) {
+  _assert_(core);
+  struct ::io_uring_sqe* sqe = ::io_uring_get_sqe(&core->ring);
+  if (!sqe) {
+    if (::io_uring_submit(&core->ring) < 0) return false;
+    sqe = ::io_uring_get_sqe(&core->ring);
+    if (!sqe) return false;
+  }
+  ::io_uring_prep_rw(IORING_OP_POLL_REMOVE, sqe, -1, NULL, 0, 0);
+  sqe->addr = tag;
+  sqe->user_data = 0;
+  return true;
+}
+#endif
+
+
 }                                        // common namespace
 
 // END OF FILE
@@ -19,6 +19,8 @@
 #include <ktcommon.h>
 #include <ktutil.h>
 
+#include <sys/uio.h>
+
 namespace kyototycoon {                  // common namespace
 
 
@@ -34,7 +36,8 @@ public:
   enum EventFlag {
     EVINPUT = 1 << 0,                    ///< input
     EVOUTPUT = 1 << 1,                   ///< output
-    EVEXCEPT = 1 << 2                    ///< exception
+    EVEXCEPT = 1 << 2,                   ///< exception
+    EVEDGE = 1 << 3                      ///< edge trigger
   };
   /**
    * Default constructor.
@@ -53,7 +56,8 @@ public:
    * Set event flags.
    * @param flags specifies the event mode.  The following may be added by bitwise-or:
    * Pollable::EVINPUT for input events, Pollable::EVOUTPUT for output events, Pollable::EVEXCEPT
-   * for exception events.
+   * for exception events, Pollable::EVEDGE to keep the event registered and to be notified only
+   * when the state changes.
    */
   virtual void set_event_flags(uint32_t flags) = 0;
   /**
@@ -115,6 +119,14 @@ public:
    * @return true on success, or false on failure.
    */
   bool send(const std::string& str);
+  /**
+   * Send data in multiple regions at once.
+   * @param iov an array of the I/O vectors of the data regions to send.
+   * @param num the number of the elements of the array.
+   * @return true on success, or false on failure.
+   * @note The regions are gathered by the kernel without being copied into one buffer.
+   */
+  bool sendv(const struct ::iovec* iov, size_t num);
   /**
    * Send formatted data.
    * @param format the printf-like format string.  The conversion character `%' can be used with
@@ -163,6 +175,34 @@ public:
    * @return the size of left data in the receiving buffer.
    */
   size_t left_size();
+  /**
+   * Check whether some data can be received without blocking.
+   * @return true if some data is buffered or readable or if the stream is closed, or false if
+   * no data is available now.
+   * @note Readable data is moved into the receiving buffer.
+   */
+  bool check_input();
+  /**
+   * Set the limit of the sending buffer.
+   * @param limit the maximum size of the data kept in the sending buffer.  If it is not more
+   * than 0, the sending buffer is not used.
+   * @note If the sending buffer is used, data which can not be sent immediately is kept in the
+   * sending buffer and sending operations return without blocking.  If the sending buffer
+   * would exceed the limit, the buffered data is flushed with blocking.  Receiving operations
+   * flush the buffered data with blocking only when they would otherwise wait for input.
+   */
+  void set_send_buffer(int64_t limit);
+  /**
+   * Get the size of left data in the sending buffer.
+   * @return the size of left data in the sending buffer.
+   */
+  size_t pending_size();
+  /**
+   * Send the data in the sending buffer as far as possible without blocking.
+   * @return true on success, or false on failure.
+   * @note Data which can not be sent now is left in the sending buffer.
+   */
+  bool flush();
   /**
    * Abort the current operation.
    * @return true on success, or false on failure.
@@ -221,6 +261,12 @@ private:
  */
 class ServerSocket : public Pollable {
 public:
+  /**
+   * Open options.
+   */
+  enum Option {
+    OREUSEPORT = 1 << 0                  ///< share the port with other sockets
+  };
   /**
    * Default constructor.
    */
@@ -237,9 +283,11 @@ public:
   /**
    * Open a server socket.
    * @param expr an expression of the address and the port of the server.
+   * @param opts the optional features by bitwise-or: ServerSocket::OREUSEPORT to bind with the
+   * SO_REUSEPORT option so that several server sockets can share the same port.
    * @return true on success, or false on failure.
    */
-  bool open(const std::string& expr);
+  bool open(const std::string& expr, uint32_t opts = 0);
   /**
    * Close the socket.
    * @return true on success, or false on failure.
@@ -343,6 +391,9 @@ public:
    * Enable the next notification of a pollable event.
    * @param event the pollable event object.
    * @return true on success, or false on failure.
+   * @note An event registered with Pollable::EVEDGE stays enabled and this method only applies
+   * changes of its event flags, except with the select emulation which supports one-shot
+   * notification only.
    */
   bool undo(Pollable* event);
   /**
@@ -32,9 +32,34 @@ public:
   class Worker;
   class Session;
 private:
+  class Reactor;
   class TaskQueueImpl;
-  class SessionTask;
+  /**
+   * Task with a session.
+   */
+  class SessionTask {
+    friend class ThreadedServer;
+    friend class TaskQueueImpl;
+  public:
+    explicit SessionTask(Session* sess) : sess_(sess), thid_(0), aborted_(false) {}
+    uint32_t thread_id() {
+      return thid_;
+    }
+    bool aborted() {
+      return aborted_;
+    }
+  private:
+    Session* sess_;
+    uint32_t thid_;
+    bool aborted_;
+  };
 public:
+  /**
+   * Network options.
+   */
+  enum Option {
+    OEDGE = 1 << 0                       ///< edge-triggered notification
+  };
   /**
    * Interface to log internal information and errors.
    */
@@ -156,7 +181,9 @@ public:
     /**
      * Default Constructor.
      */
-    explicit Session(uint64_t id) : id_(id), thid_(0), data_(NULL) {
+    explicit Session(uint64_t id, Reactor* rct) :
+      id_(id), thid_(0), data_(NULL), rct_(rct), stat_(0), detached_(false), task_(this),
+      otime_(0), watched_(false), expired_(false) {
       _assert_(true);
     }
     /**
@@ -173,13 +200,29 @@ public:
     uint32_t thid_;
     /** The session local data. */
     Data* data_;
+    /** The reactor which owns the session. */
+    Reactor* rct_;
+    /** The dispatching status. */
+    kc::AtomicInt64 stat_;
+    /** The flag whether to be detached from the dispatcher. */
+    bool detached_;
+    /** The task to process the session. */
+    SessionTask task_;
+    /** The time when the pending output last made progress. */
+    double otime_;
+    /** The flag whether the pending output is watched by the reactor. */
+    bool watched_;
+    /** The flag whether the pending output timed out. */
+    bool expired_;
   };
   /**
    * Default constructor.
    */
   explicit ThreadedServer() :
-    run_(false), expr_(), timeout_(0), logger_(NULL), logkinds_(0), worker_(NULL), thnum_(0),
-    sock_(), poll_(), queue_(this), sesscnt_(0), idlesem_(0), timersem_(0) {
+    run_(false), expr_(), timeout_(0), opts_(0), logger_(NULL), logkinds_(0),
+    worker_(NULL), thnum_(0),
+    rcnum_(1), rcts_(NULL), queue_(this), sesscnt_(0), idlesem_(0), timersem_(0),
+    idletask_(SESSIDLE), timertask_(SESSTIMER) {
     _assert_(true);
   }
   /**
@@ -192,11 +235,16 @@ public:
    * Set the network configurations.
    * @param expr an expression of the address and the port of the server.
    * @param timeout the timeout of each network operation in seconds.  If it is not more than 0,
-   * no timeout is specified.
+   * no timeout is specified.  A session whose buffered output is not sent for this time is
+   * disconnected.
+   * @param opts the optional features by bitwise-or: ThreadedServer::OEDGE to keep each session
+   * registered in the poller with edge-triggered notification instead of re-enabling it after
+   * every request.
    */
-  void set_network(const std::string& expr, double timeout = -1) {
+  void set_network(const std::string& expr, double timeout = -1, uint32_t opts = 0) {
     expr_ = expr;
     timeout_ = timeout;
+    opts_ = opts;
   }
   /**
    * Set the logger to process each log message.
@@ -214,11 +262,15 @@ public:
    * Set the worker to process each request.
    * @param worker the worker object.
    * @param thnum the number of worker threads.
+   * @param rcnum the number of reactor threads.  If it is more than 1, each reactor owns a
+   * server socket bound with the SO_REUSEPORT option and an event poller of its own.
    */
-  void set_worker(Worker* worker, size_t thnum = 1) {
-    _assert_(worker && thnum > 0 && thnum < kc::MEMMAXSIZ);
+  void set_worker(Worker* worker, size_t thnum = 1, size_t rcnum = 1) {
+    _assert_(worker && thnum > 0 && thnum < kc::MEMMAXSIZ &&
+             rcnum > 0 && rcnum < kc::MEMMAXSIZ);
     worker_ = worker;
     thnum_ = thnum;
+    rcnum_ = rcnum;
   }
   /**
    * Start the service.
@@ -239,69 +291,46 @@ public:
       log(Logger::ERROR, "the worker is not set");
       return false;
     }
-    if (!sock_.open(expr_)) {
-      log(Logger::ERROR, "socket error: expr=%s msg=%s", expr_.c_str(), sock_.error());
-      return false;
-    }
-    log(Logger::SYSTEM, "server socket opened: expr=%s timeout=%.1f", expr_.c_str(), timeout_);
-    if (!poll_.open()) {
-      log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-      sock_.close();
-      return false;
+    rcts_ = new Reactor[rcnum_];
+    uint32_t sockopts = rcnum_ > 1 ? ServerSocket::OREUSEPORT : 0;
+    for (size_t i = 0; i < rcnum_; i++) {
+      Reactor* rct = rcts_ + i;
+      rct->serv_ = this;
+      rct->id_ = i;
+      if (!rct->sock_.open(expr_, sockopts)) {
+        log(Logger::ERROR, "socket error: expr=%s msg=%s", expr_.c_str(), rct->sock_.error());
+        release_reactors(i);
+        return false;
+      }
+      log(Logger::SYSTEM, "server socket opened: expr=%s timeout=%.1f",
+          expr_.c_str(), timeout_);
+      if (!rct->poll_.open()) {
+        log(Logger::ERROR, "poller error: msg=%s", rct->poll_.error());
+        rct->sock_.close();
+        release_reactors(i);
+        return false;
+      }
+      log(Logger::SYSTEM, "listening server socket started: fd=%d", rct->sock_.descriptor());
     }
-    log(Logger::SYSTEM, "listening server socket started: fd=%d", sock_.descriptor());
     bool err = false;
-    sock_.set_event_flags(Pollable::EVINPUT);
-    if (!poll_.deposit(&sock_)) {
-      log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-      err = true;
+    for (size_t i = 0; i < rcnum_; i++) {
+      Reactor* rct = rcts_ + i;
+      rct->sock_.set_event_flags(Pollable::EVINPUT);
+      if (!rct->poll_.deposit(&rct->sock_)) {
+        log(Logger::ERROR, "poller error: msg=%s", rct->poll_.error());
+        err = true;
+      }
     }
     queue_.set_worker(worker_);
     queue_.start(thnum_);
-    uint32_t timercnt = 0;
     run_ = true;
-    while (run_) {
-      if (poll_.wait(0.1)) {
-        Pollable* event;
-        while ((event = poll_.next()) != NULL) {
-          if (event == &sock_) {
-            Session* sess = new Session(++sesscnt_);
-            if (timeout_ > 0) sess->set_timeout(timeout_);
-            if (sock_.accept(sess)) {
-              log(Logger::INFO, "connected: expr=%s", sess->expression().c_str());
-              sess->set_event_flags(Pollable::EVINPUT);
-              if (!poll_.deposit(sess)) {
-                log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-                err = true;
-              }
-            } else {
-              log(Logger::ERROR, "socket error: msg=%s", sock_.error());
-              err = true;
-            }
-            sock_.set_event_flags(Pollable::EVINPUT);
-            if (!poll_.undo(&sock_)) {
-              log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-              err = true;
-            }
-          } else {
-            Session* sess = (Session*)event;
-            SessionTask* task = new SessionTask(sess);
-            queue_.add_task(task);
-          }
-        }
-        timercnt++;
-      } else {
-        if (queue_.count() < 1 && idlesem_.cas(0, 1)) {
-          SessionTask* task = new SessionTask(SESSIDLE);
-          queue_.add_task(task);
-        }
-        timercnt += kc::UINT8MAX / 4;
-      }
-      if (timercnt > kc::UINT8MAX && timersem_.cas(0, 1)) {
-        SessionTask* task = new SessionTask(SESSTIMER);
-        queue_.add_task(task);
-        timercnt = 0;
-      }
+    for (size_t i = 1; i < rcnum_; i++) {
+      rcts_[i].start();
+    }
+    if (!run_reactor(rcts_)) err = true;
+    for (size_t i = 1; i < rcnum_; i++) {
+      rcts_[i].join();
+      if (rcts_[i].err_) err = true;
     }
     log(Logger::SYSTEM, "server stopped");
     if (err) log(Logger::SYSTEM, "one or more errors were detected");
@@ -317,8 +346,10 @@ public:
       return false;
     }
     run_ = false;
-    sock_.abort();
-    poll_.abort();
+    for (size_t i = 0; i < rcnum_; i++) {
+      rcts_[i].sock_.abort();
+      rcts_[i].poll_.abort();
+    }
     return true;
   }
   /**
@@ -331,41 +362,20 @@ public:
       log(Logger::ERROR, "not stopped");
       return false;
     }
+    if (!rcts_) {
+      log(Logger::ERROR, "not started");
+      return false;
+    }
     bool err = false;
     queue_.finish();
     if (queue_.error()) {
       log(Logger::SYSTEM, "one or more errors were detected");
       err = true;
     }
-    if (poll_.flush()) {
-      Pollable* event;
-      while ((event = poll_.next()) != NULL) {
-        if (event == &sock_) continue;
-        Session* sess = (Session*)event;
-        log(Logger::INFO, "disconnecting: expr=%s", sess->expression().c_str());
-        if (!poll_.withdraw(sess)) {
-          log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-          err = true;
-        }
-        if (!sess->close()) {
-          log(Logger::ERROR, "socket error: fd=%d msg=%s", sess->descriptor(), sess->error());
-          err = true;
-        }
-        delete sess;
-      }
-    } else {
-      log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-      err = true;
-    }
-    if (!poll_.close()) {
-      log(Logger::ERROR, "poller error: msg=%s", poll_.error());
-      err = true;
-    }
-    log(Logger::SYSTEM, "closing the server socket");
-    if (!sock_.close()) {
-      log(Logger::ERROR, "socket error: fd=%d msg=%s", sock_.descriptor(), sock_.error());
-      err = true;
+    for (size_t i = 0; i < rcnum_; i++) {
+      if (!finish_reactor(rcts_ + i)) err = true;
     }
+    release_reactors(0);
     return !err;
   }
   /**
@@ -404,7 +414,12 @@ public:
    */
   int64_t connection_count() {
     _assert_(true);
-    return poll_.count() - 1;
+    if (!rcts_) return 0;
+    int64_t sum = 0;
+    for (size_t i = 0; i < rcnum_; i++) {
+      sum += rcts_[i].poll_.count() - 1;
+    }
+    return sum;
   }
   /**
    * Get the number of tasks in the queue.
@@ -422,19 +437,136 @@ public:
     _assert_(true);
     return !run_;
   }
+  /**
+   * Detach a session from the event dispatcher.
+   * @param sess the session object.
+   * @note This method should be called by the worker processing the session.  When the worker
+   * returns true, the session is withdrawn from the poller instead of waiting for the next
+   * request, and it must be closed later by the close_session method.
+   */
+  void detach_session(Session* sess) {
+    _assert_(sess);
+    sess->detached_ = true;
+  }
+  /**
+   * Check whether a session detached from the event dispatcher has been released.
+   * @param sess the session object.
+   * @return true if the worker thread has released the session, or false if not yet.
+   * @note A detached session should not be used by another thread until it is released.
+   */
+  bool session_detached(Session* sess) {
+    _assert_(sess);
+    return sess->stat_.get() == SSDETACHED;
+  }
+  /**
+   * Close a session detached from the event dispatcher.
+   * @param sess the session object.  It is destroyed implicitly afterwards.
+   * @return true on success, or false on failure.
+   */
+  bool close_session(Session* sess) {
+    _assert_(sess);
+    while (sess->stat_.get() != SSDETACHED) {
+      kc::Thread::yield();
+    }
+    bool err = false;
+    log(Logger::INFO, "disconnecting: expr=%s", sess->expression().c_str());
+    if (!sess->close()) {
+      log(Logger::ERROR, "socket error: msg=%s", sess->error());
+      err = true;
+    }
+    sess->stat_.set(SSCLOSED);
+    sess->rct_->discard(sess);
+    return !err;
+  }
 private:
   /** The magic pointer of an idle session. */
   static Session* const SESSIDLE;
   /** The magic pointer of a timer session. */
   static Session* const SESSTIMER;
+  /** The maximum size of the sending buffer of each session. */
+  static const int64_t SESSSENDMAX = 1 << 24;
+  /** The interval in seconds to check the pending output of sessions. */
+  static const double OUTCHECKFREQ = 1.0;
+  /**
+   * Dispatching status of a session.
+   */
+  enum SessionStatus {
+    SSIDLE,                              ///< waiting for events
+    SSBUSY,                              ///< processed by a worker
+    SSPENDING,                           ///< notified again while processed
+    SSDETACHED,                          ///< detached from the dispatcher
+    SSCLOSED                             ///< closed and to be destroyed
+  };
+  /**
+   * Reactor to accept connections and to dispatch events.
+   */
+  class Reactor : public kc::Thread {
+    friend class ThreadedServer;
+  public:
+    explicit Reactor() :
+      serv_(NULL), id_(0), sock_(), poll_(), trash_(), tlock_(), outs_(), olock_(),
+      err_(false) {
+      _assert_(true);
+    }
+    void watch(Session* sess, bool on) {
+      _assert_(sess);
+      if (on == sess->watched_) return;
+      olock_.lock();
+      if (on) {
+        outs_.insert(sess);
+      } else {
+        outs_.erase(sess);
+      }
+      olock_.unlock();
+      sess->watched_ = on;
+    }
+    void discard(Session* sess) {
+      _assert_(sess);
+      tlock_.lock();
+      trash_.push_back(sess);
+      tlock_.unlock();
+    }
+    void purge() {
+      _assert_(true);
+      tlock_.lock();
+      std::vector<Session*>::iterator it = trash_.begin();
+      std::vector<Session*>::iterator itend = trash_.end();
+      while (it != itend) {
+        delete *it;
+        ++it;
+      }
+      trash_.clear();
+      tlock_.unlock();
+    }
+  private:
+    void run() {
+      _assert_(true);
+      if (!serv_->run_reactor(this)) err_ = true;
+    }
+    ThreadedServer* serv_;
+    uint32_t id_;
+    ServerSocket sock_;
+    Poller poll_;
+    std::vector<Session*> trash_;
+    kc::SpinLock tlock_;
+    std::set<Session*> outs_;
+    kc::SpinLock olock_;
+    bool err_;
+  };
   /**
    * Task queue implementation.
    */
-  class TaskQueueImpl : public kc::TaskQueue {
+  class TaskQueueImpl {
   public:
-    explicit TaskQueueImpl(ThreadedServer* serv) : serv_(serv), worker_(NULL), err_(false) {
+    explicit TaskQueueImpl(ThreadedServer* serv) :
+      serv_(serv), worker_(NULL), err_(false), cells_(NULL), head_(0), tail_(0),
+      thary_(NULL), thnum_(0), mutex_(), cond_(), sleepers_(0), aborting_(0) {
       _assert_(true);
     }
+    ~TaskQueueImpl() {
+      _assert_(true);
+      delete[] cells_;
+    }
     void set_worker(Worker* worker) {
       _assert_(worker);
       worker_ = worker;
@@ -443,11 +575,161 @@ private:
       _assert_(true);
       return err_;
     }
+    void start(size_t thnum) {
+      _assert_(thnum > 0 && thnum <= kc::MEMMAXSIZ);
+      if (!cells_) cells_ = new Cell[QUEUECAP];
+      for (int64_t i = 0; i < QUEUECAP; i++) {
+        cells_[i].seq.set(i);
+        cells_[i].task = NULL;
+      }
+      head_.set(0);
+      tail_.set(0);
+      aborting_.set(0);
+      thary_ = new WorkerThread[thnum];
+      for (size_t i = 0; i < thnum; i++) {
+        thary_[i].id_ = i;
+        thary_[i].queue_ = this;
+        thary_[i].start();
+      }
+      thnum_ = thnum;
+    }
+    void finish() {
+      _assert_(true);
+      aborting_.set(1);
+      wake(true);
+      kc::Thread::yield();
+      for (double wsec = 0.001; count() > 0; wsec *= 2) {
+        if (wsec > 1.0) wsec = 1.0;
+        kc::Thread::sleep(wsec);
+      }
+      for (size_t i = 0; i < thnum_; i++) {
+        thary_[i].aborted_.set(1);
+      }
+      wake(true);
+      for (size_t i = 0; i < thnum_; i++) {
+        thary_[i].join();
+      }
+      delete[] thary_;
+      thary_ = NULL;
+      thnum_ = 0;
+    }
+    void add_task(SessionTask* task) {
+      _assert_(task);
+      while (!push(task)) {
+        kc::Thread::yield();
+      }
+      if (sleepers_.get() > 0) wake(false);
+    }
+    int64_t count() {
+      _assert_(true);
+      int64_t num = tail_.get() - head_.get();
+      return num > 0 ? num : 0;
+    }
   private:
-    void do_task(kc::TaskQueue::Task* task) {
+    /** The capacity of the ring buffer. */
+    static const int64_t QUEUECAP = 1 << 16;
+    /** The number of retries before a worker sleeps. */
+    static const int32_t SPINMAX = 64;
+    /**
+     * Cell of the ring buffer.
+     */
+    struct Cell {
+      kc::AtomicInt64 seq;                 ///< sequence number
+      SessionTask* task;                   ///< stored task
+    };
+    /**
+     * Worker thread.
+     */
+    class WorkerThread : public kc::Thread {
+      friend class TaskQueueImpl;
+    public:
+      explicit WorkerThread() : id_(0), queue_(NULL), aborted_(0) {}
+    private:
+      void run() {
+        _assert_(true);
+        queue_->work(this);
+      }
+      uint32_t id_;
+      TaskQueueImpl* queue_;
+      kc::AtomicInt64 aborted_;
+    };
+    bool push(SessionTask* task) {
+      _assert_(task);
+      int64_t pos = tail_.get();
+      Cell* cell;
+      while (true) {
+        cell = cells_ + (pos & (QUEUECAP - 1));
+        int64_t diff = cell->seq.get() - pos;
+        if (diff == 0) {
+          if (tail_.cas(pos, pos + 1)) break;
+          pos = tail_.get();
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = tail_.get();
+        }
+      }
+      cell->task = task;
+      cell->seq.set(pos + 1);
+      return true;
+    }
+    SessionTask* pop() {
+      _assert_(true);
+      int64_t pos = head_.get();
+      Cell* cell;
+      while (true) {
+        cell = cells_ + (pos & (QUEUECAP - 1));
+        int64_t diff = cell->seq.get() - (pos + 1);
+        if (diff == 0) {
+          if (head_.cas(pos, pos + 1)) break;
+          pos = head_.get();
+        } else if (diff < 0) {
+          return NULL;
+        } else {
+          pos = head_.get();
+        }
+      }
+      SessionTask* task = cell->task;
+      cell->seq.set(pos + QUEUECAP);
+      return task;
+    }
+    void wake(bool all) {
+      _assert_(true);
+      mutex_.lock();
+      if (all) {
+        cond_.broadcast();
+      } else {
+        cond_.signal();
+      }
+      mutex_.unlock();
+    }
+    void work(WorkerThread* thread) {
+      _assert_(thread);
+      int32_t miss = 0;
+      while (true) {
+        SessionTask* task = pop();
+        if (task) {
+          task->thid_ = thread->id_;
+          task->aborted_ = aborting_.get() > 0;
+          do_task(task);
+          miss = 0;
+          continue;
+        }
+        if (thread->aborted_.get() > 0) break;
+        if (++miss < SPINMAX) {
+          kc::Thread::yield();
+          continue;
+        }
+        mutex_.lock();
+        sleepers_.add(1);
+        if (count() < 1 && thread->aborted_.get() < 1) cond_.wait(&mutex_, 0.1);
+        sleepers_.add(-1);
+        mutex_.unlock();
+      }
+    }
+    void do_task(SessionTask* task) {
       _assert_(task);
-      SessionTask* mytask = (SessionTask*)task;
-      Session* sess = mytask->sess_;
+      Session* sess = task->sess_;
       if (sess == SESSIDLE) {
         worker_->process_idle(serv_);
         serv_->idlesem_.set(0);
@@ -455,50 +737,248 @@ private:
         worker_->process_timer(serv_);
         serv_->timersem_.set(0);
       } else {
+        Poller* poll = &sess->rct_->poll_;
+        bool edge = serv_->opts_ & OEDGE;
         bool keep = false;
-        if (mytask->aborted()) {
+        if (task->aborted()) {
           serv_->log(Logger::INFO, "aborted a request: expr=%s", sess->expression().c_str());
         } else {
-          sess->thid_ = mytask->thread_id();
-          do {
-            keep = worker_->process(serv_, sess);
-          } while (keep && sess->left_size() > 0);
+          sess->thid_ = task->thread_id();
+          keep = serve(sess);
         }
-        if (keep) {
-          sess->set_event_flags(Pollable::EVINPUT);
-          if (!serv_->poll_.undo(sess)) {
-            serv_->log(Logger::ERROR, "poller error: msg=%s", serv_->poll_.error());
+        while (keep && !sess->detached_) {
+          if (edge) {
+            uint32_t flags = Pollable::EVINPUT | Pollable::EVEDGE;
+            if (sess->pending_size() > 0) flags |= Pollable::EVOUTPUT;
+            sess->set_event_flags(flags);
+          } else if (sess->pending_size() > 0) {
+            sess->set_event_flags(Pollable::EVOUTPUT);
+          } else {
+            sess->set_event_flags(Pollable::EVINPUT);
+          }
+          sess->rct_->watch(sess, sess->pending_size() > 0);
+          if (!poll->undo(sess)) {
+            serv_->log(Logger::ERROR, "poller error: msg=%s", poll->error());
             err_ = true;
           }
-        } else {
+          if (sess->stat_.cas(SSBUSY, SSIDLE)) break;
+          sess->stat_.set(SSBUSY);
+          keep = serve(sess);
+        }
+        if (!keep) {
           serv_->log(Logger::INFO, "disconnecting: expr=%s", sess->expression().c_str());
-          if (!serv_->poll_.withdraw(sess)) {
-            serv_->log(Logger::ERROR, "poller error: msg=%s", serv_->poll_.error());
+          sess->rct_->watch(sess, false);
+          if (!poll->withdraw(sess)) {
+            serv_->log(Logger::ERROR, "poller error: msg=%s", poll->error());
             err_ = true;
           }
-          if (!sess->close()) {
+          if (!sess->close(!sess->expired_)) {
             serv_->log(Logger::ERROR, "socket error: msg=%s", sess->error());
             err_ = true;
           }
-          delete sess;
+          sess->stat_.set(SSCLOSED);
+          sess->rct_->discard(sess);
+        } else if (sess->detached_) {
+          sess->rct_->watch(sess, false);
+          if (!poll->withdraw(sess)) {
+            serv_->log(Logger::ERROR, "poller error: msg=%s", poll->error());
+            err_ = true;
+          }
+          sess->stat_.set(SSDETACHED);
         }
       }
-      delete mytask;
+    }
+    bool serve(Session* sess) {
+      _assert_(sess);
+      if (sess->expired_) {
+        serv_->log(Logger::INFO, "sending timed out: expr=%s", sess->expression().c_str());
+        return false;
+      }
+      size_t psiz = sess->pending_size();
+      if (psiz > 0) {
+        if (!sess->flush()) {
+          serv_->log(Logger::INFO, "socket error: expr=%s msg=%s",
+                     sess->expression().c_str(), sess->error());
+          return false;
+        }
+        if (sess->pending_size() < psiz) sess->otime_ = kc::time();
+        if (sess->pending_size() > 0) return true;
+      }
+      if (!sess->check_input()) return true;
+      bool edge = serv_->opts_ & OEDGE;
+      bool keep;
+      do {
+        keep = worker_->process(serv_, sess);
+      } while (keep && !sess->detached_ && sess->pending_size() < 1 &&
+               (edge ? sess->check_input() : sess->left_size() > 0));
+      if (psiz < 1 && sess->pending_size() > 0) sess->otime_ = kc::time();
+      return keep;
     }
     ThreadedServer* serv_;
     Worker* worker_;
     bool err_;
+    Cell* cells_;
+    kc::AtomicInt64 head_;
+    kc::AtomicInt64 tail_;
+    WorkerThread* thary_;
+    size_t thnum_;
+    kc::Mutex mutex_;
+    kc::CondVar cond_;
+    kc::AtomicInt64 sleepers_;
+    kc::AtomicInt64 aborting_;
   };
   /**
-   * Task with a session.
+   * Run the event loop of a reactor.
+   * @param rct the reactor.
+   * @return true on success, or false on failure.
    */
-  class SessionTask : public kc::TaskQueue::Task {
-    friend class ThreadedServer;
-  public:
-    explicit SessionTask(Session* sess) : sess_(sess) {}
-  private:
-    Session* sess_;
-  };
+  bool run_reactor(Reactor* rct) {
+    _assert_(rct);
+    ServerSocket* sock = &rct->sock_;
+    Poller* poll = &rct->poll_;
+    uint32_t sessflags = Pollable::EVINPUT;
+    if (opts_ & OEDGE) sessflags |= Pollable::EVEDGE;
+    bool err = false;
+    uint32_t timercnt = 0;
+    double otime = kc::time();
+    while (run_) {
+      rct->purge();
+      if (timeout_ > 0) {
+        double now = kc::time();
+        if (now > otime + OUTCHECKFREQ) {
+          expire_outputs(rct, now);
+          otime = now;
+        }
+      }
+      if (poll->wait(0.1)) {
+        Pollable* event;
+        while ((event = poll->next()) != NULL) {
+          if (event == sock) {
+            Session* sess = new Session(sesscnt_.add(1) + 1, rct);
+            if (timeout_ > 0) sess->set_timeout(timeout_);
+            sess->set_send_buffer(SESSSENDMAX);
+            if (sock->accept(sess)) {
+              log(Logger::INFO, "connected: expr=%s", sess->expression().c_str());
+              sess->set_event_flags(sessflags);
+              if (!poll->deposit(sess)) {
+                log(Logger::ERROR, "poller error: msg=%s", poll->error());
+                err = true;
+              }
+            } else {
+              log(Logger::ERROR, "socket error: msg=%s", sock->error());
+              err = true;
+            }
+            sock->set_event_flags(Pollable::EVINPUT);
+            if (!poll->undo(sock)) {
+              log(Logger::ERROR, "poller error: msg=%s", poll->error());
+              err = true;
+            }
+          } else {
+            Session* sess = (Session*)event;
+            if (sess->stat_.cas(SSIDLE, SSBUSY)) {
+              queue_.add_task(&sess->task_);
+            } else {
+              sess->stat_.cas(SSBUSY, SSPENDING);
+            }
+          }
+        }
+        timercnt++;
+      } else {
+        if (rct->id_ == 0 && queue_.count() < 1 && idlesem_.cas(0, 1))
+          queue_.add_task(&idletask_);
+        timercnt += kc::UINT8MAX / 4;
+      }
+      if (rct->id_ == 0 && timercnt > kc::UINT8MAX && timersem_.cas(0, 1)) {
+        queue_.add_task(&timertask_);
+        timercnt = 0;
+      }
+    }
+    return !err;
+  }
+  /**
+   * Dispatch the sessions of a reactor whose pending output made no progress within the timeout.
+   * @param rct the reactor.
+   * @param now the current time.
+   * @note The dispatched sessions are closed by the worker without flushing.
+   */
+  void expire_outputs(Reactor* rct, double now) {
+    _assert_(rct);
+    std::vector<Session*> sesss;
+    rct->olock_.lock();
+    std::set<Session*>::iterator it = rct->outs_.begin();
+    std::set<Session*>::iterator itend = rct->outs_.end();
+    while (it != itend) {
+      Session* sess = *it;
+      if (now > sess->otime_ + timeout_ && sess->stat_.cas(SSIDLE, SSBUSY)) {
+        sess->expired_ = true;
+        sesss.push_back(sess);
+      }
+      ++it;
+    }
+    rct->olock_.unlock();
+    std::vector<Session*>::iterator sit = sesss.begin();
+    std::vector<Session*>::iterator sitend = sesss.end();
+    while (sit != sitend) {
+      queue_.add_task(&(*sit)->task_);
+      ++sit;
+    }
+  }
+  /**
+   * Disconnect the sessions of a reactor and close its poller and its server socket.
+   * @param rct the reactor.
+   * @return true on success, or false on failure.
+   */
+  bool finish_reactor(Reactor* rct) {
+    _assert_(rct);
+    ServerSocket* sock = &rct->sock_;
+    Poller* poll = &rct->poll_;
+    bool err = false;
+    if (poll->flush()) {
+      Pollable* event;
+      while ((event = poll->next()) != NULL) {
+        if (event == sock) continue;
+        Session* sess = (Session*)event;
+        log(Logger::INFO, "disconnecting: expr=%s", sess->expression().c_str());
+        if (!poll->withdraw(sess)) {
+          log(Logger::ERROR, "poller error: msg=%s", poll->error());
+          err = true;
+        }
+        if (!sess->close()) {
+          log(Logger::ERROR, "socket error: fd=%d msg=%s", sess->descriptor(), sess->error());
+          err = true;
+        }
+        delete sess;
+      }
+    } else {
+      log(Logger::ERROR, "poller error: msg=%s", poll->error());
+      err = true;
+    }
+    if (!poll->close()) {
+      log(Logger::ERROR, "poller error: msg=%s", poll->error());
+      err = true;
+    }
+    rct->outs_.clear();
+    rct->purge();
+    log(Logger::SYSTEM, "closing the server socket");
+    if (!sock->close()) {
+      log(Logger::ERROR, "socket error: fd=%d msg=%s", sock->descriptor(), sock->error());
+      err = true;
+    }
+    return !err;
+  }
+  /**
+   * Release the reactors.
+   * @param onum the number of leading reactors whose poller and server socket are still open.
+   */
+  void release_reactors(size_t onum) {
+    _assert_(true);
+    for (size_t i = 0; i < onum; i++) {
+      rcts_[i].poll_.close();
+      rcts_[i].sock_.close();
+    }
+    delete[] rcts_;
+    rcts_ = NULL;
+  }
   /** Dummy constructor to forbid the use. */
   ThreadedServer(const ThreadedServer&);
   /** Dummy Operator to forbid the use. */
@@ -509,6 +989,8 @@ private:
   std::string expr_;
   /** The timeout of each network operation. */
   double timeout_;
+  /** The network options. */
+  uint32_t opts_;
   /** The internal logger. */
   Logger* logger_;
   /** The kinds of logged messages. */
@@ -517,18 +999,22 @@ private:
   Worker* worker_;
   /** The number of worker threads. */
   size_t thnum_;
-  /** The server socket. */
-  ServerSocket sock_;
-  /** The event poller. */
-  Poller poll_;
+  /** The number of reactor threads. */
+  size_t rcnum_;
+  /** The reactors. */
+  Reactor* rcts_;
   /** The task queue. */
   TaskQueueImpl queue_;
   /** The session count. */
-  uint64_t sesscnt_;
+  kc::AtomicInt64 sesscnt_;
   /** The idle event semaphore. */
   kc::AtomicInt64 idlesem_;
   /** The timer event semaphore. */
   kc::AtomicInt64 timersem_;
+  /** The task of idle events. */
+  SessionTask idletask_;
+  /** The task of timer events. */
+  SessionTask timertask_;
 };
 
 
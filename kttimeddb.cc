@@ -24,8 +24,11 @@ namespace kyototycoon {                  // common namespace
  */
 namespace {
 const char SSMAGICDATA[] = "KTSS\n";     ///< magic data of the snapshot file
+const char SSCHUNKMAGIC[] = "KTSC\n";    ///< magic data of the chunked snapshot file
 const uint8_t SSRECMAGIC = 0xcc;         ///< magic data for record in the snapshot
 const int32_t SSIOUNIT = 1 * (1<<20);    ///< unit size of the snapshot IO
+const int32_t SSIDXUNIT = 16;            ///< size of each entry of the chunk index
+const int32_t SSTAILSIZ = 16;            ///< size of the tail of the chunked snapshot
 }
 
 
@@ -79,11 +82,50 @@ static bool nice_impl(int32_t inc);
 static void exit_impl(int32_t status);
 
 
+/**
+ * Dump records into a file as chunks compressed by parallel workers.
+ * @param db the database object.
+ * @param file the file object.
+ * @param zcomp the data compressor object.  If it is NULL, no compression is performed.
+ * @param checker a progress checker object.  If it is NULL, no checking is performed.
+ * @param thnum the number of worker threads.
+ * @param emsgp the pointer to the variable into which the error message of file operations is
+ * assigned.
+ * @return true on success, or false on failure.
+ */
+static bool dump_snapshot_chunks(kc::BasicDB* db, kc::File* file, kc::Compressor* zcomp,
+                                 kc::BasicDB::ProgressChecker* checker, size_t thnum,
+                                 const char** emsgp);
+
+
+/**
+ * Load records from a file of chunks by parallel workers.
+ * @param db the database object.
+ * @param file the file object.
+ * @param off the offset of the first chunk.
+ * @param zcomp the data compressor object.  If it is NULL, no decompression is performed.
+ * @param thnum the number of worker threads.
+ * @return true on success, or false on failure.
+ */
+static bool load_snapshot_chunks(kc::BasicDB* db, kc::File* file, int64_t off,
+                                 kc::Compressor* zcomp, size_t thnum);
+
+
+/**
+ * Store records in a block of a snapshot file into a database.
+ * @param db the database object.
+ * @param rp the pointer to the block.
+ * @param rsiz the size of the block.
+ * @return true on success, or false on failure.
+ */
+static bool import_snapshot_block(kc::BasicDB* db, const char* rp, size_t rsiz);
+
+
 /**
  * Dump records atomically into a file.
  */
 bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcomp,
-                                   kc::BasicDB::ProgressChecker* checker) {
+                                   kc::BasicDB::ProgressChecker* checker, size_t thnum) {
   _assert_(true);
   bool forkable = false;
   kc::BasicDB* idb = db_.reveal_inner_db();
@@ -91,26 +133,49 @@ bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcom
     const std::type_info& info = typeid(*idb);
     if (info == typeid(kc::ProtoHashDB) || info == typeid(kc::ProtoTreeDB) ||
         info == typeid(kc::StashDB) || info == typeid(kc::CacheDB) ||
-        info == typeid(kc::GrassDB)) forkable = true;
+        info == typeid(kc::GrassDB)) {
+      forkable = true;
+    } else if (info == typeid(ShardDB)) {
+      ShardDB* sdb = (ShardDB*)idb;
+      forkable = true;
+      for (size_t i = 0; forkable && i < sdb->shard_num(); i++) {
+        kc::BasicDB* sidb = sdb->reveal_shard_db(i);
+        if (!sidb) {
+          forkable = false;
+          continue;
+        }
+        const std::type_info& sinfo = typeid(*sidb);
+        if (sinfo != typeid(kc::ProtoHashDB) && sinfo != typeid(kc::ProtoTreeDB) &&
+            sinfo != typeid(kc::StashDB) && sinfo != typeid(kc::CacheDB) &&
+            sinfo != typeid(kc::GrassDB)) forkable = false;
+      }
+    }
   }
   int64_t cpid = -1;
+  uint64_t ts = 0;
   if (forkable) {
     class Forker : public kc::BasicDB::FileProcessor {
     public:
-      explicit Forker() : cpid_(-1) {}
+      explicit Forker() : cpid_(-1), ts_(0) {}
       int64_t cpid() {
         return cpid_;
       }
+      uint64_t ts() {
+        return ts_;
+      }
     private:
       bool process(const std::string& path, int64_t count, int64_t size) {
+        ts_ = UpdateLogger::clock_pure();
         cpid_ = fork_impl();
         return true;
       }
       int64_t cpid_;
+      uint64_t ts_;
     };
     Forker forker;
     db_.occupy(true, &forker);
     cpid = forker.cpid();
+    ts = forker.ts();
   };
   if (cpid > 0) {
     int64_t osiz = 0;
@@ -157,7 +222,7 @@ bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcom
       delete[] zbuf;
     }
   }
-  uint64_t ts = UpdateLogger::clock_pure();
+  if (ts < 1) ts = UpdateLogger::clock_pure();
   uint64_t dbcount = db_.count();
   uint64_t dbsize = db_.size();
   char head[sizeof(chksum)+sizeof(ts)+sizeof(dbcount)+sizeof(dbsize)];
@@ -170,8 +235,10 @@ bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcom
   wp += sizeof(dbcount);
   kc::writefixnum(wp, dbsize, sizeof(dbsize));
   wp += sizeof(dbsize);
-  if (!file.append(SSMAGICDATA, sizeof(SSMAGICDATA)) ||
-      !file.append(head, sizeof(head))) {
+  char magic[sizeof(SSMAGICDATA)];
+  std::memcpy(magic, thnum > 1 ? SSCHUNKMAGIC : SSMAGICDATA, sizeof(magic));
+  magic[sizeof(magic)-1] = format_marker();
+  if (!file.append(magic, sizeof(magic)) || !file.append(head, sizeof(head))) {
     if (cpid != 0) db_.set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, file.error());
     return false;
   }
@@ -219,11 +286,16 @@ bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcom
     const char* emsg_;
     std::string buf_;
   };
-  Dumper dumper(&file, zcomp);
   bool err = false;
-  if (!db_.iterate(&dumper, false, checker)) err = true;
-  dumper.flush();
-  const char* emsg = dumper.emsg();
+  const char* emsg = NULL;
+  if (thnum > 1) {
+    if (!dump_snapshot_chunks(&db_, &file, zcomp, checker, thnum, &emsg)) err = true;
+  } else {
+    Dumper dumper(&file, zcomp);
+    if (!db_.iterate(&dumper, false, checker)) err = true;
+    dumper.flush();
+    emsg = dumper.emsg();
+  }
   if (emsg) {
     if (cpid != 0) db_.set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, emsg);
     err = true;
@@ -240,8 +312,8 @@ bool TimedDB::dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcom
 /**
  * Load records atomically from a file.
  */
-bool TimedDB::load_snapshot_atomic(const std::string& src, kc::Compressor* zcomp,
-                                   kc::BasicDB::ProgressChecker* checker) {
+bool TimedDB::load_snapshot_atomic_impl(const std::string& src, kc::Compressor* zcomp,
+                                        kc::BasicDB::ProgressChecker* checker, size_t thnum) {
   _assert_(true);
   kc::File file;
   if (!file.open(src, kc::File::OREADER)) {
@@ -263,16 +335,27 @@ bool TimedDB::load_snapshot_atomic(const std::string& src, kc::Compressor* zcomp
     return false;
   }
   const char* rp = head;
-  if (std::memcmp(rp, SSMAGICDATA, sizeof(SSMAGICDATA))) {
+  bool chunked = false;
+  if (!std::memcmp(rp, SSCHUNKMAGIC, sizeof(SSCHUNKMAGIC) - 1)) {
+    chunked = true;
+  } else if (std::memcmp(rp, SSMAGICDATA, sizeof(SSMAGICDATA) - 1)) {
     db_.set_error(_KCCODELINE_, kc::BasicDB::Error::BROKEN, "invalid magic data");
     return false;
   }
+  uint8_t fmt = rp[sizeof(SSMAGICDATA)-1];
+  if (fmt == 0 ? strict_format() : fmt != format_marker()) {
+    db_.set_error(_KCCODELINE_, kc::BasicDB::Error::INVALID, "mismatching record format");
+    return false;
+  }
   rp += sizeof(SSMAGICDATA);
   if (kc::readfixnum(rp, sizeof(chksum)) != chksum) {
     db_.set_error(_KCCODELINE_, kc::BasicDB::Error::BROKEN, "invalid check sum");
     return false;
   }
-  if (zcomp) {
+  if (chunked) {
+    if (!load_snapshot_chunks(&db_, &file, sizeof(head), zcomp, thnum > 0 ? thnum : 1))
+      return false;
+  } else if (zcomp) {
     int64_t off = sizeof(head);
     int64_t size = file.size() - off;
     while (size > (int64_t)sizeof(uint32_t)) {
@@ -304,29 +387,9 @@ bool TimedDB::load_snapshot_atomic(const std::string& src, kc::Compressor* zcomp
         return false;
       }
       delete[] zbuf;
-      const char* rp = rbuf;
-      while (rsiz >= 3) {
-        if (*(uint8_t*)rp != SSRECMAGIC) {
-          db_.set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, "invalid magic data");
-          delete[] rbuf;
-          return false;
-        }
-        rp++;
-        rsiz--;
-        uint64_t ksiz;
-        size_t step = kc::readvarnum(rp, rsiz, &ksiz);
-        rp += step;
-        rsiz -= step;
-        uint64_t vsiz;
-        step = kc::readvarnum(rp, rsiz, &vsiz);
-        rp += step;
-        rsiz -= step;
-        if (!db_.set(rp, ksiz, rp + ksiz, vsiz)) {
-          delete[] rbuf;
-          return false;
-        }
-        rp += ksiz + vsiz;
-        rsiz -= ksiz + vsiz;
+      if (!import_snapshot_block(&db_, rbuf, rsiz)) {
+        delete[] rbuf;
+        return false;
       }
       delete[] rbuf;
     }
@@ -401,7 +464,8 @@ bool TimedDB::status_snapshot_atomic(const std::string& src, uint64_t* tsp,
   char head[sizeof(SSMAGICDATA)+sizeof(uint32_t)+sizeof(uint64_t)*3];
   if (!file.read(0, head, sizeof(head))) return false;
   if (!file.close()) return false;
-  if (std::memcmp(head, SSMAGICDATA, sizeof(SSMAGICDATA))) return false;
+  if (std::memcmp(head, SSMAGICDATA, sizeof(SSMAGICDATA) - 1) &&
+      std::memcmp(head, SSCHUNKMAGIC, sizeof(SSCHUNKMAGIC) - 1)) return false;
   const char* rp = head + sizeof(SSMAGICDATA) + sizeof(uint32_t);
   uint64_t ts = kc::readfixnum(rp, sizeof(ts));
   rp += sizeof(ts);
@@ -416,6 +480,604 @@ bool TimedDB::status_snapshot_atomic(const std::string& src, uint64_t* tsp,
 }
 
 
+/**
+ * Dump records into a file as chunks compressed by parallel workers.
+ */
+static bool dump_snapshot_chunks(kc::BasicDB* db, kc::File* file, kc::Compressor* zcomp,
+                                 kc::BasicDB::ProgressChecker* checker, size_t thnum,
+                                 const char** emsgp) {
+  _assert_(db && file && thnum > 0 && emsgp);
+  class Writer {
+  public:
+    explicit Writer(kc::File* file, kc::Compressor* zcomp, int64_t off, size_t qmax) :
+      file_(file), zcomp_(zcomp), mutex_(), pcond_(), ccond_(), queue_(), qmax_(qmax),
+      done_(false), end_(off), index_(), emsg_(NULL) {}
+    ~Writer() {
+      std::deque<std::string*>::iterator it = queue_.begin();
+      std::deque<std::string*>::iterator itend = queue_.end();
+      while (it != itend) {
+        delete *it;
+        ++it;
+      }
+    }
+    void push(std::string* blk) {
+      kc::ScopedMutex lock(&mutex_);
+      while (queue_.size() >= qmax_) {
+        pcond_.wait(&mutex_);
+      }
+      queue_.push_back(blk);
+      ccond_.signal();
+    }
+    std::string* pop() {
+      kc::ScopedMutex lock(&mutex_);
+      while (queue_.empty() && !done_) {
+        ccond_.wait(&mutex_);
+      }
+      if (queue_.empty()) return NULL;
+      std::string* blk = queue_.front();
+      queue_.pop_front();
+      pcond_.signal();
+      return blk;
+    }
+    void finish() {
+      kc::ScopedMutex lock(&mutex_);
+      done_ = true;
+      ccond_.broadcast();
+    }
+    void write(const std::string& blk) {
+      const char* dbuf = blk.data();
+      size_t dsiz = blk.size();
+      char* zbuf = NULL;
+      if (zcomp_) {
+        zbuf = zcomp_->compress(dbuf, dsiz, &dsiz);
+        if (!zbuf) {
+          fail("compression failed");
+          return;
+        }
+        dbuf = zbuf;
+      }
+      mutex_.lock();
+      int64_t off = end_;
+      end_ += dsiz;
+      index_.push_back(std::make_pair(off, (int64_t)dsiz));
+      mutex_.unlock();
+      if (!file_->write(off, dbuf, dsiz)) fail(file_->error());
+      delete[] zbuf;
+    }
+    bool close() {
+      if (emsg_) return false;
+      size_t isiz = index_.size() * SSIDXUNIT + SSTAILSIZ;
+      char* ibuf = new char[isiz];
+      char* wp = ibuf;
+      std::vector<std::pair<int64_t, int64_t> >::iterator it = index_.begin();
+      std::vector<std::pair<int64_t, int64_t> >::iterator itend = index_.end();
+      while (it != itend) {
+        kc::writefixnum(wp, it->first, sizeof(uint64_t));
+        wp += sizeof(uint64_t);
+        kc::writefixnum(wp, it->second, sizeof(uint64_t));
+        wp += sizeof(uint64_t);
+        ++it;
+      }
+      kc::writefixnum(wp, end_, sizeof(uint64_t));
+      wp += sizeof(uint64_t);
+      kc::writefixnum(wp, index_.size(), sizeof(uint64_t));
+      if (!file_->write(end_, ibuf, isiz)) fail(file_->error());
+      delete[] ibuf;
+      return !emsg_;
+    }
+    const char* emsg() {
+      return emsg_;
+    }
+  private:
+    void fail(const char* emsg) {
+      kc::ScopedMutex lock(&mutex_);
+      if (!emsg_) emsg_ = emsg;
+    }
+    kc::File* file_;
+    kc::Compressor* zcomp_;
+    kc::Mutex mutex_;
+    kc::CondVar pcond_;
+    kc::CondVar ccond_;
+    std::deque<std::string*> queue_;
+    size_t qmax_;
+    bool done_;
+    int64_t end_;
+    std::vector<std::pair<int64_t, int64_t> > index_;
+    const char* emsg_;
+  };
+  class Worker : public kc::Thread {
+  public:
+    explicit Worker(Writer* writer) : writer_(writer) {}
+  private:
+    void run() {
+      std::string* blk;
+      while ((blk = writer_->pop()) != NULL) {
+        writer_->write(*blk);
+        delete blk;
+      }
+    }
+    Writer* writer_;
+  };
+  class Feeder : public kc::BasicDB::Visitor {
+  public:
+    explicit Feeder(Writer* writer) : writer_(writer), buf_(new std::string) {}
+    ~Feeder() {
+      delete buf_;
+    }
+    void flush() {
+      if (buf_->empty()) return;
+      writer_->push(buf_);
+      buf_ = new std::string;
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      char numbuf[kc::NUMBUFSIZ];
+      char* wp = numbuf;
+      *(wp++) = SSRECMAGIC;
+      wp += kc::writevarnum(wp, ksiz);
+      wp += kc::writevarnum(wp, vsiz);
+      buf_->append(numbuf, wp - numbuf);
+      buf_->append(kbuf, ksiz);
+      buf_->append(vbuf, vsiz);
+      if ((int32_t)buf_->size() >= SSIOUNIT) flush();
+      return NOP;
+    }
+    Writer* writer_;
+    std::string* buf_;
+  };
+  Writer writer(file, zcomp, file->size(), thnum * 2);
+  std::vector<Worker*> workers;
+  for (size_t i = 0; i < thnum; i++) {
+    Worker* worker = new Worker(&writer);
+    worker->start();
+    workers.push_back(worker);
+  }
+  bool err = false;
+  Feeder feeder(&writer);
+  if (!db->iterate(&feeder, false, checker)) err = true;
+  feeder.flush();
+  writer.finish();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i]->join();
+    delete workers[i];
+  }
+  if (!writer.close()) err = true;
+  *emsgp = writer.emsg();
+  return !err;
+}
+
+
+/**
+ * Load records from a file of chunks by parallel workers.
+ */
+static bool load_snapshot_chunks(kc::BasicDB* db, kc::File* file, int64_t off,
+                                 kc::Compressor* zcomp, size_t thnum) {
+  _assert_(db && file && off >= 0 && thnum > 0);
+  int64_t fsiz = file->size();
+  if (fsiz < off + SSTAILSIZ) {
+    db->set_error(_KCCODELINE_, kc::BasicDB::Error::BROKEN, "too short region");
+    return false;
+  }
+  char tail[SSTAILSIZ];
+  if (!file->read(fsiz - SSTAILSIZ, tail, sizeof(tail))) {
+    db->set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, file->error());
+    return false;
+  }
+  int64_t ioff = kc::readfixnum(tail, sizeof(uint64_t));
+  int64_t inum = kc::readfixnum(tail + sizeof(uint64_t), sizeof(uint64_t));
+  if (ioff < off || inum < 0 || inum > fsiz / SSIDXUNIT ||
+      ioff + inum * SSIDXUNIT + SSTAILSIZ != fsiz) {
+    db->set_error(_KCCODELINE_, kc::BasicDB::Error::BROKEN, "invalid chunk index");
+    return false;
+  }
+  char* ibuf = new char[inum*SSIDXUNIT+1];
+  if (!file->read(ioff, ibuf, inum * SSIDXUNIT)) {
+    db->set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, file->error());
+    delete[] ibuf;
+    return false;
+  }
+  class Loader {
+  public:
+    explicit Loader(kc::BasicDB* db, kc::File* file, kc::Compressor* zcomp,
+                    const char* ibuf, int64_t inum, int64_t ioff) :
+      db_(db), file_(file), zcomp_(zcomp), ibuf_(ibuf), inum_(inum), ioff_(ioff),
+      cur_(0), mutex_(), ecode_(kc::BasicDB::Error::SUCCESS), emsg_(NULL) {}
+    void load() {
+      while (true) {
+        int64_t idx = cur_.add(1);
+        if (idx >= inum_ || failed()) break;
+        const char* rp = ibuf_ + idx * SSIDXUNIT;
+        int64_t off = kc::readfixnum(rp, sizeof(uint64_t));
+        int64_t size = kc::readfixnum(rp + sizeof(uint64_t), sizeof(uint64_t));
+        if (off < 0 || size < 0 || size > ioff_ || off + size > ioff_) {
+          fail(kc::BasicDB::Error::BROKEN, "invalid chunk index");
+          break;
+        }
+        char* cbuf = new char[size+1];
+        if (!file_->read(off, cbuf, size)) {
+          fail(kc::BasicDB::Error::SYSTEM, file_->error());
+          delete[] cbuf;
+          break;
+        }
+        char* rbuf = cbuf;
+        size_t rsiz = size;
+        if (zcomp_) {
+          rbuf = zcomp_->decompress(cbuf, size, &rsiz);
+          delete[] cbuf;
+          if (!rbuf) {
+            fail(kc::BasicDB::Error::SYSTEM, "decompression failed");
+            break;
+          }
+        }
+        if (!import_snapshot_block(db_, rbuf, rsiz)) {
+          const kc::BasicDB::Error& e = db_->error();
+          fail(e.code(), e.message());
+          delete[] rbuf;
+          break;
+        }
+        delete[] rbuf;
+      }
+    }
+    bool failed() {
+      kc::ScopedMutex lock(&mutex_);
+      return emsg_ != NULL;
+    }
+    kc::BasicDB::Error::Code ecode() {
+      return ecode_;
+    }
+    const char* emsg() {
+      return emsg_;
+    }
+  private:
+    void fail(kc::BasicDB::Error::Code code, const char* message) {
+      kc::ScopedMutex lock(&mutex_);
+      if (emsg_) return;
+      ecode_ = code;
+      emsg_ = message;
+    }
+    kc::BasicDB* db_;
+    kc::File* file_;
+    kc::Compressor* zcomp_;
+    const char* ibuf_;
+    int64_t inum_;
+    int64_t ioff_;
+    kc::AtomicInt64 cur_;
+    kc::Mutex mutex_;
+    kc::BasicDB::Error::Code ecode_;
+    const char* emsg_;
+  };
+  class Worker : public kc::Thread {
+  public:
+    explicit Worker(Loader* loader) : loader_(loader) {}
+  private:
+    void run() {
+      loader_->load();
+    }
+    Loader* loader_;
+  };
+  Loader loader(db, file, zcomp, ibuf, inum, ioff);
+  if (thnum > (size_t)inum) thnum = inum;
+  std::vector<Worker*> workers;
+  for (size_t i = 1; i < thnum; i++) {
+    Worker* worker = new Worker(&loader);
+    worker->start();
+    workers.push_back(worker);
+  }
+  loader.load();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i]->join();
+    delete workers[i];
+  }
+  delete[] ibuf;
+  if (loader.failed()) {
+    db->set_error(_KCCODELINE_, loader.ecode(), loader.emsg());
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Store records in a block of a snapshot file into a database.
+ */
+static bool import_snapshot_block(kc::BasicDB* db, const char* rp, size_t rsiz) {
+  _assert_(db && rp);
+  while (rsiz >= 3) {
+    if (*(uint8_t*)rp != SSRECMAGIC) {
+      db->set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, "invalid magic data");
+      return false;
+    }
+    rp++;
+    rsiz--;
+    uint64_t ksiz;
+    size_t step = kc::readvarnum(rp, rsiz, &ksiz);
+    rp += step;
+    rsiz -= step;
+    uint64_t vsiz;
+    step = kc::readvarnum(rp, rsiz, &vsiz);
+    rp += step;
+    rsiz -= step;
+    if (ksiz > rsiz || vsiz > rsiz - ksiz) {
+      db->set_error(_KCCODELINE_, kc::BasicDB::Error::SYSTEM, "too short region");
+      return false;
+    }
+    if (!db->set(rp, ksiz, rp + ksiz, vsiz)) return false;
+    rp += ksiz + vsiz;
+    rsiz -= ksiz + vsiz;
+  }
+  return true;
+}
+
+
+/**
+ * Open a database file.
+ */
+bool SortedTableDB::open(const std::string& path, uint32_t mode) {
+  _assert_(true);
+  kc::ScopedSpinRWLock lock(&mlock_, true);
+  if (!path_.empty()) {
+    set_error(_KCCODELINE_, Error::INVALID, "already opened");
+    return false;
+  }
+  std::vector<std::string> elems;
+  kc::strsplit(path, '#', &elems);
+  std::string fpath = elems.empty() ? path : elems.front();
+  if (!map_file(fpath)) return false;
+  if (msiz_ < HEADSIZ || std::memcmp(map_, MAGICDATA, std::strlen(MAGICDATA))) {
+    set_error(_KCCODELINE_, Error::BROKEN, "invalid magic data");
+    unmap_file();
+    return false;
+  }
+  count_ = kc::readfixnum(map_ + 8, sizeof(int64_t));
+  dend_ = kc::readfixnum(map_ + 16, sizeof(int64_t));
+  inum_ = kc::readfixnum(map_ + 24, sizeof(int64_t));
+  int64_t bloff = kc::readfixnum(map_ + 32, sizeof(int64_t));
+  int64_t bbits = kc::readfixnum(map_ + 40, sizeof(int64_t));
+  if (count_ < 0 || dend_ < HEADSIZ || dend_ > msiz_ || inum_ < 0 ||
+      inum_ > (msiz_ - dend_) / INDEXUNIT || (count_ > 0) != (inum_ > 0) || bbits < 0 ||
+      (bbits & (bbits - 1)) != 0 ||
+      (bbits > 0 && (bloff < dend_ + inum_ * INDEXUNIT || bloff + bbits / 8 > msiz_))) {
+    set_error(_KCCODELINE_, Error::BROKEN, "invalid meta data");
+    unmap_file();
+    return false;
+  }
+  index_ = map_ + dend_;
+  bloom_ = bbits > 0 ? map_ + bloff : NULL;
+  bmask_ = bbits > 0 ? bbits - 1 : 0;
+  std::memcpy(opaque_, map_ + OPAQUEOFF, OPAQUESIZ);
+  path_ = fpath;
+  trigger_meta(MetaTrigger::OPEN, "open");
+  return true;
+}
+
+
+/**
+ * Close the database file.
+ */
+bool SortedTableDB::close() {
+  _assert_(true);
+  kc::ScopedSpinRWLock lock(&mlock_, true);
+  if (path_.empty()) {
+    set_error(_KCCODELINE_, Error::INVALID, "not opened");
+    return false;
+  }
+  bool err = false;
+  if (!unmap_file()) err = true;
+  count_ = 0;
+  dend_ = 0;
+  index_ = NULL;
+  inum_ = 0;
+  bloom_ = NULL;
+  bmask_ = 0;
+  path_.clear();
+  trigger_meta(MetaTrigger::CLOSE, "close");
+  return !err;
+}
+
+
+/**
+ * Map the database file on memory.
+ */
+bool SortedTableDB::map_file(const std::string& name) {
+  _assert_(true);
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  int64_t size;
+  char* buf = kc::File::read_file(name, &size);
+  if (!buf) {
+    set_error(_KCCODELINE_, Error::NOREPOS, "reading the file failed");
+    return false;
+  }
+  map_ = buf;
+  msiz_ = size;
+  return true;
+#else
+  int32_t fd = ::open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    set_error(_KCCODELINE_, errno == ENOENT ? Error::NOREPOS : Error::SYSTEM, "open failed");
+    return false;
+  }
+  struct stat sbuf;
+  if (::fstat(fd, &sbuf) != 0) {
+    set_error(_KCCODELINE_, Error::SYSTEM, "fstat failed");
+    ::close(fd);
+    return false;
+  }
+  if (sbuf.st_size < HEADSIZ) {
+    set_error(_KCCODELINE_, Error::BROKEN, "invalid file size");
+    ::close(fd);
+    return false;
+  }
+  void* map = ::mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    set_error(_KCCODELINE_, Error::SYSTEM, "mmap failed");
+    ::close(fd);
+    return false;
+  }
+  ::close(fd);
+  map_ = (char*)map;
+  msiz_ = sbuf.st_size;
+  return true;
+#endif
+}
+
+
+/**
+ * Unmap the database file.
+ */
+bool SortedTableDB::unmap_file() {
+  _assert_(true);
+  bool err = false;
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  delete[] map_;
+#else
+  if (::munmap(map_, msiz_) != 0) {
+    set_error(_KCCODELINE_, Error::SYSTEM, "munmap failed");
+    err = true;
+  }
+#endif
+  map_ = NULL;
+  msiz_ = 0;
+  return !err;
+}
+
+
+/**
+ * Write all live records into a sorted table file.
+ */
+bool TimedDB::export_sorted_table(const std::string& dest, int64_t bnum,
+                                  kc::BasicDB::ProgressChecker* checker) {
+  _assert_(true);
+  if (omode_ == 0) {
+    set_error(kc::BasicDB::Error::INVALID, "not opened");
+    return false;
+  }
+  kc::Comparator* rcomp = NULL;
+  kc::BasicDB* idb = db_.reveal_inner_db();
+  if (idb) {
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::GrassDB)) {
+      rcomp = ((kc::GrassDB*)idb)->rcomp();
+    } else if (info == typeid(kc::TreeDB)) {
+      rcomp = ((kc::TreeDB*)idb)->rcomp();
+    } else if (info == typeid(kc::ForestDB)) {
+      rcomp = ((kc::ForestDB*)idb)->rcomp();
+    }
+  }
+  bool ordered = rcomp == kc::LEXICALCOMP;
+  int64_t ct = std::time(NULL);
+  int64_t allcnt = db_.count();
+  if (checker && !checker->check("export_sorted_table", "beginning", 0, allcnt)) {
+    set_error(kc::BasicDB::Error::LOGIC, "checker failed");
+    return false;
+  }
+  bool err = false;
+  kc::BasicDB* sdb = &db_;
+  kc::TreeDB* tmpdb = NULL;
+  std::string tmppath = dest + ".tmp.kct";
+  if (!ordered) {
+    tmpdb = new kc::TreeDB;
+    if (!tmpdb->open(tmppath, kc::BasicDB::OWRITER | kc::BasicDB::OCREATE |
+                     kc::BasicDB::OTRUNCATE)) {
+      kc::BasicDB::Error e = tmpdb->error();
+      set_error(e.code(), e.message());
+      delete tmpdb;
+      return false;
+    }
+    kc::BasicDB::Cursor* cur = db_.cursor();
+    int64_t curcnt = 0;
+    if (cur->jump()) {
+      char* kbuf;
+      size_t ksiz, vsiz;
+      const char* vbuf;
+      while ((kbuf = cur->get(&ksiz, &vbuf, &vsiz, true)) != NULL) {
+        int64_t xt;
+        if (((opts_ & TPERSIST) || (read_record_header(opts_, vbuf, vsiz, &xt) > 0 &&
+                                    ct <= xt)) && !tmpdb->set(kbuf, ksiz, vbuf, vsiz)) {
+          kc::BasicDB::Error e = tmpdb->error();
+          set_error(e.code(), e.message());
+          err = true;
+        }
+        delete[] kbuf;
+        if (err) break;
+        curcnt++;
+        if (checker && !checker->check("export_sorted_table", "sorting", curcnt, allcnt)) {
+          set_error(kc::BasicDB::Error::LOGIC, "checker failed");
+          err = true;
+          break;
+        }
+      }
+      if (!err && db_.error() != kc::BasicDB::Error::NOREC) err = true;
+    }
+    delete cur;
+    sdb = tmpdb;
+  }
+  std::string buildpath = dest + ".tmp";
+  SortedTableDB::Builder builder(bnum);
+  if (!err && !builder.open(buildpath)) {
+    set_error(kc::BasicDB::Error::SYSTEM, builder.error());
+    err = true;
+  }
+  if (!err) {
+    kc::BasicDB::Cursor* cur = sdb->cursor();
+    if (cur->jump()) {
+      char* kbuf;
+      size_t ksiz, vsiz;
+      const char* vbuf;
+      while ((kbuf = cur->get(&ksiz, &vbuf, &vsiz, true)) != NULL) {
+        int64_t xt;
+        if ((tmpdb || (opts_ & TPERSIST) || (read_record_header(opts_, vbuf, vsiz, &xt) > 0 &&
+                                             ct <= xt)) &&
+            !builder.append(kbuf, ksiz, vbuf, vsiz)) {
+          set_error(kc::BasicDB::Error::LOGIC, builder.error());
+          err = true;
+        }
+        delete[] kbuf;
+        if (err) break;
+        if (checker && !checker->check("export_sorted_table", "processing",
+                                       builder.count(), allcnt)) {
+          set_error(kc::BasicDB::Error::LOGIC, "checker failed");
+          err = true;
+          break;
+        }
+      }
+    }
+    if (!err && sdb->error() != kc::BasicDB::Error::NOREC) {
+      kc::BasicDB::Error e = sdb->error();
+      set_error(e.code(), e.message());
+      err = true;
+    }
+    delete cur;
+    char opaque[SortedTableDB::OPAQUESIZ];
+    std::memset(opaque, 0, sizeof(opaque));
+    write_opaque(opaque, 0, zcode_);
+    if (!builder.close(opaque) && !err) {
+      set_error(kc::BasicDB::Error::SYSTEM, builder.error());
+      err = true;
+    }
+  }
+  if (tmpdb) {
+    if (!tmpdb->close() && !err) {
+      kc::BasicDB::Error e = tmpdb->error();
+      set_error(e.code(), e.message());
+      err = true;
+    }
+    delete tmpdb;
+    kc::File::remove(tmppath);
+  }
+  if (!err && checker && !checker->check("export_sorted_table", "ending", -1, -1)) {
+    set_error(kc::BasicDB::Error::LOGIC, "checker failed");
+    err = true;
+  }
+  if (!err && !kc::File::rename(buildpath, dest)) {
+    set_error(kc::BasicDB::Error::SYSTEM, "renaming the file failed");
+    err = true;
+  }
+  if (err) kc::File::remove(buildpath);
+  return !err;
+}
+
+
 /**
  * Create a child process.
  */
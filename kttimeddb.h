@@ -24,6 +24,3678 @@
 namespace kyototycoon {                  // common namespace
 
 
+/**
+ * Get the access tick of the current time.
+ * @return the lower 32 bits of the current time in milliseconds.  It is never 0, which marks a
+ * slot of an access time table which has not been touched.
+ */
+inline uint32_t access_tick() {
+  _assert_(true);
+  uint32_t tick = (uint32_t)((int64_t)(kc::time() * 1000) & 0xffffffff);
+  return tick > 0 ? tick : 1;
+}
+
+
+/**
+ * Get the age of an access tick.
+ * @param tick the access tick recorded in an access time table.
+ * @param now the access tick of the current time.
+ * @return the age in milliseconds, which is the maximum if the slot has not been touched.
+ */
+inline uint32_t access_age(uint32_t tick, uint32_t now) {
+  _assert_(true);
+  return tick > 0 ? now - tick : kc::UINT32MAX;
+}
+
+
+/**
+ * Sharded database.
+ * @note This class is a concrete class of the basic database to distribute records into
+ * several polymorphic databases by the hash value of the key.  It is used as the internal
+ * database of the timed database specified by the "ktshards" tuning parameter.  Whole
+ * database operations are performed on every shard in order.  Cursors merge records of all
+ * shards in the order of the comparator of the shards, which is the lexical order unless the
+ * shards are tree databases with another comparator.
+ */
+class ShardDB : public kc::BasicDB {
+public:
+  class Cursor;
+protected:
+  class ShardVisitor;
+private:
+  class Occupier;
+public:
+  /**
+   * Cursor to indicate a record.
+   */
+  class Cursor : public kc::BasicDB::Cursor {
+    friend class ShardDB;
+  public:
+    /**
+     * Constructor.
+     * @param db the container database object.
+     */
+    explicit Cursor(ShardDB* db) : db_(db), curs_(), keys_(), lives_(), cur_(-1), back_(false) {
+      _assert_(db);
+      size_t num = db_->dbs_.size();
+      for (size_t i = 0; i < num; i++) {
+        curs_.push_back(db_->dbs_[i]->cursor());
+      }
+      keys_.resize(num);
+      lives_.resize(num, false);
+    }
+    /**
+     * Destructor.
+     */
+    virtual ~Cursor() {
+      _assert_(true);
+      std::vector<kc::PolyDB::Cursor*>::iterator it = curs_.begin();
+      std::vector<kc::PolyDB::Cursor*>::iterator itend = curs_.end();
+      while (it != itend) {
+        delete *it;
+        ++it;
+      }
+    }
+    /**
+     * Accept a visitor to the current record.
+     * @param visitor a visitor object.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @param step true to move the cursor to the next record, or false for no move.
+     * @return true on success, or false on failure.
+     */
+    bool accept(Visitor* visitor, bool writable = true, bool step = false) {
+      _assert_(visitor);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      if (cur_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      int32_t idx = cur_;
+      std::string okey = keys_[idx];
+      if (!curs_[idx]->accept(visitor, writable, false)) {
+        check_end(idx);
+        select();
+        return false;
+      }
+      load_key(idx);
+      if (lives_[idx] && keys_[idx] == okey) {
+        if (step) return step_impl();
+      } else if (back_) {
+        if (curs_[idx]->jump_back(okey.data(), okey.size())) {
+          load_key(idx);
+        } else if (!check_end(idx)) {
+          select();
+          return false;
+        }
+      }
+      select();
+      return true;
+    }
+    /**
+     * Jump the cursor to the first record for forward scan.
+     * @return true on success, or false on failure.
+     */
+    bool jump() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      back_ = false;
+      bool err = false;
+      for (size_t i = 0; i < curs_.size(); i++) {
+        if (curs_[i]->jump()) {
+          load_key(i);
+        } else if (!check_end(i)) {
+          err = true;
+        }
+      }
+      return settle(err);
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     */
+    bool jump(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      back_ = false;
+      bool err = false;
+      for (size_t i = 0; i < curs_.size(); i++) {
+        if (curs_[i]->jump(kbuf, ksiz)) {
+          load_key(i);
+        } else if (!check_end(i)) {
+          err = true;
+        }
+      }
+      return settle(err);
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @note Equal to the original Cursor::jump method except that the parameter is std::string.
+     */
+    bool jump(const std::string& key) {
+      _assert_(true);
+      return jump(key.c_str(), key.size());
+    }
+    /**
+     * Jump the cursor to the last record for backward scan.
+     * @return true on success, or false on failure.
+     */
+    bool jump_back() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      back_ = true;
+      bool err = false;
+      for (size_t i = 0; i < curs_.size(); i++) {
+        if (curs_[i]->jump_back()) {
+          load_key(i);
+        } else if (!check_end(i)) {
+          err = true;
+        }
+      }
+      return settle(err);
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     */
+    bool jump_back(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      back_ = true;
+      bool err = false;
+      for (size_t i = 0; i < curs_.size(); i++) {
+        if (curs_[i]->jump_back(kbuf, ksiz)) {
+          load_key(i);
+        } else if (!check_end(i)) {
+          err = true;
+        }
+      }
+      return settle(err);
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @note Equal to the original Cursor::jump_back method except that the parameter is
+     * std::string.
+     */
+    bool jump_back(const std::string& key) {
+      _assert_(true);
+      return jump_back(key.c_str(), key.size());
+    }
+    /**
+     * Step the cursor to the next record.
+     * @return true on success, or false on failure.
+     */
+    bool step() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      return step_impl();
+    }
+    /**
+     * Step the cursor to the previous record.
+     * @return true on success, or false on failure.
+     */
+    bool step_back() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      return step_back_impl();
+    }
+    /**
+     * Get the database object.
+     * @return the database object.
+     */
+    ShardDB* db() {
+      _assert_(true);
+      return db_;
+    }
+  private:
+    /**
+     * Step the cursor to the next record.
+     * @return true on success, or false on failure.
+     */
+    bool step_impl() {
+      _assert_(true);
+      if (cur_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      bool err = false;
+      int32_t idx = cur_;
+      if (back_) {
+        const std::string& key = keys_[idx];
+        for (size_t i = 0; i < curs_.size(); i++) {
+          if ((int32_t)i == idx) continue;
+          if (curs_[i]->jump(key.data(), key.size())) {
+            load_key(i);
+          } else if (!check_end(i)) {
+            err = true;
+          }
+        }
+        back_ = false;
+      }
+      if (curs_[idx]->step()) {
+        load_key(idx);
+      } else if (!check_end(idx)) {
+        err = true;
+      }
+      return settle(err);
+    }
+    /**
+     * Step the cursor to the previous record.
+     * @return true on success, or false on failure.
+     */
+    bool step_back_impl() {
+      _assert_(true);
+      if (cur_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      bool err = false;
+      int32_t idx = cur_;
+      if (!back_) {
+        const std::string& key = keys_[idx];
+        for (size_t i = 0; i < curs_.size(); i++) {
+          if ((int32_t)i == idx) continue;
+          if (curs_[i]->jump_back(key.data(), key.size())) {
+            load_key(i);
+          } else if (!check_end(i)) {
+            err = true;
+          }
+        }
+        back_ = true;
+      }
+      if (curs_[idx]->step_back()) {
+        load_key(idx);
+      } else if (!check_end(idx)) {
+        err = true;
+      }
+      return settle(err);
+    }
+    /**
+     * Load the key of the record at a shard cursor.
+     * @param idx the index of the shard.
+     */
+    void load_key(size_t idx) {
+      _assert_(true);
+      size_t ksiz;
+      char* kbuf = curs_[idx]->get_key(&ksiz, false);
+      if (kbuf) {
+        keys_[idx].assign(kbuf, ksiz);
+        lives_[idx] = true;
+        delete[] kbuf;
+      } else {
+        lives_[idx] = false;
+      }
+    }
+    /**
+     * Check whether a failed shard cursor has reached the end.
+     * @param idx the index of the shard.
+     * @return true if the cursor has reached the end, or false on the other failure.
+     */
+    bool check_end(size_t idx) {
+      _assert_(true);
+      lives_[idx] = false;
+      kc::BasicDB::Error e = db_->dbs_[idx]->error();
+      if (e == Error::NOREC) return true;
+      db_->set_error(_KCCODELINE_, e.code(), e.message());
+      return false;
+    }
+    /**
+     * Select the shard cursor of the current record.
+     */
+    void select() {
+      _assert_(true);
+      cur_ = -1;
+      for (size_t i = 0; i < curs_.size(); i++) {
+        if (!lives_[i]) continue;
+        if (cur_ < 0) {
+          cur_ = i;
+          continue;
+        }
+        const std::string& key = keys_[i];
+        const std::string& ckey = keys_[cur_];
+        int32_t rv = db_->comp_->compare(key.data(), key.size(), ckey.data(), ckey.size());
+        if (back_ ? rv > 0 : rv < 0) cur_ = i;
+      }
+    }
+    /**
+     * Select the current record and set the error if no record remains.
+     * @param err true if an error has happened.
+     * @return true on success, or false on failure.
+     */
+    bool settle(bool err) {
+      _assert_(true);
+      select();
+      if (err) return false;
+      if (cur_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      return true;
+    }
+    /** Dummy constructor to forbid the use. */
+    Cursor(const Cursor&);
+    /** Dummy Operator to forbid the use. */
+    Cursor& operator =(const Cursor&);
+    /** The inner database. */
+    ShardDB* db_;
+    /** The cursors of the shards. */
+    std::vector<kc::PolyDB::Cursor*> curs_;
+    /** The keys of the current records of the shards. */
+    std::vector<std::string> keys_;
+    /** The flags whether each shard cursor indicates a record. */
+    std::vector<bool> lives_;
+    /** The index of the shard of the current record. */
+    int32_t cur_;
+    /** The backward flag. */
+    bool back_;
+  };
+  /**
+   * Constructor.
+   * @param num the number of shards.
+   */
+  explicit ShardDB(size_t num) :
+    mlock_(), error_(), logger_(NULL), logkinds_(0), mtrigger_(NULL), path_(""), dbs_(),
+    comp_(kc::LEXICALCOMP) {
+    _assert_(num > 0);
+    for (size_t i = 0; i < num; i++) {
+      dbs_.push_back(new kc::PolyDB);
+    }
+  }
+  /**
+   * Destructor.
+   */
+  virtual ~ShardDB() {
+    _assert_(true);
+    if (!path_.empty()) close();
+    std::vector<kc::PolyDB*>::iterator it = dbs_.begin();
+    std::vector<kc::PolyDB*>::iterator itend = dbs_.end();
+    while (it != itend) {
+      delete *it;
+      ++it;
+    }
+  }
+  /**
+   * Get the last happened error.
+   * @return the last happened error.
+   */
+  Error error() const {
+    _assert_(true);
+    return error_;
+  }
+  /**
+   * Set the error information.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param code an error code.
+   * @param message a supplement message.
+   */
+  void set_error(const char* file, int32_t line, const char* func,
+                 Error::Code code, const char* message) {
+    _assert_(file && line > 0 && func && message);
+    error_->set(code, message);
+    if (logger_) {
+      Logger::Kind kind = code == Error::BROKEN || code == Error::SYSTEM ?
+        Logger::ERROR : Logger::INFO;
+      if (kind & logkinds_)
+        report(file, line, func, kind, "%d: %s: %s", code, Error::codename(code), message);
+    }
+  }
+  /**
+   * Open the database files of all shards.
+   * @param path the path of the database.  The file name is suffixed with the index number of
+   * each shard and the tuning parameters are applied to every shard.
+   * @param mode the connection mode.  The same as with kc::PolyDB.
+   * @return true on success, or false on failure.
+   */
+  bool open(const std::string& path, uint32_t mode = OWRITER | OCREATE) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    if (!path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "already opened");
+      return false;
+    }
+    std::string name = path;
+    std::string params;
+    size_t pv = name.find('#');
+    if (pv != std::string::npos) {
+      params = name.substr(pv);
+      name.erase(pv);
+    }
+    std::string ext;
+    if (name.size() > 1) {
+      size_t ev = name.rfind(kc::File::EXTCHR);
+      size_t dv = name.rfind(kc::File::PATHCHR);
+      if (ev != std::string::npos && ev > 0 && (dv == std::string::npos || ev > dv + 1)) {
+        ext = name.substr(ev);
+        name.erase(ev);
+      }
+    }
+    bool err = false;
+    size_t onum = 0;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      std::string spath;
+      if (name.size() > 1) {
+        kc::strprintf(&spath, "%s-%03d%s%s",
+                      name.c_str(), (int)i, ext.c_str(), params.c_str());
+      } else {
+        spath = name + params;
+      }
+      if (logger_) dbs_[i]->tune_logger(logger_, logkinds_);
+      if (!dbs_[i]->open(spath, mode)) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+        break;
+      }
+      onum++;
+    }
+    if (err) {
+      for (size_t i = 0; i < onum; i++) {
+        dbs_[i]->close();
+      }
+      return false;
+    }
+    comp_ = shard_comparator();
+    path_ = path;
+    trigger_meta(MetaTrigger::OPEN, "open");
+    return true;
+  }
+  /**
+   * Close the database files of all shards.
+   * @return true on success, or false on failure.
+   */
+  bool close() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    bool err = false;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->close()) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+      }
+    }
+    path_.clear();
+    trigger_meta(MetaTrigger::CLOSE, "close");
+    return !err;
+  }
+  /**
+   * Accept a visitor to a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   */
+  bool accept(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable = true) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    size_t idx = shard_index(kbuf, ksiz);
+    if (!dbs_[idx]->accept(kbuf, ksiz, visitor, writable)) {
+      set_shard_error(_KCCODELINE_, idx);
+      return false;
+    }
+    return true;
+  }
+  /**
+   * Accept a visitor to multiple records at once.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note The operations are performed atomically in each shard but not across shards.
+   */
+  bool accept_bulk(const std::vector<std::string>& keys, Visitor* visitor,
+                   bool writable = true) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    std::vector<std::vector<std::string> > groups(dbs_.size());
+    std::vector<std::string>::const_iterator it = keys.begin();
+    std::vector<std::string>::const_iterator itend = keys.end();
+    while (it != itend) {
+      groups[shard_index(it->data(), it->size())].push_back(*it);
+      ++it;
+    }
+    bool err = false;
+    ShardVisitor svis(visitor);
+    visitor->visit_before();
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (groups[i].empty()) continue;
+      if (!dbs_[i]->accept_bulk(groups[i], &svis, writable)) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+        break;
+      }
+    }
+    visitor->visit_after();
+    return !err;
+  }
+  /**
+   * Iterate to accept a visitor for each record.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   * @note The shards are iterated one after another.
+   */
+  bool iterate(Visitor *visitor, bool writable = true, ProgressChecker* checker = NULL) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    bool err = false;
+    ShardVisitor svis(visitor);
+    visitor->visit_before();
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->iterate(&svis, writable, checker)) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+        break;
+      }
+    }
+    visitor->visit_after();
+    trigger_meta(MetaTrigger::ITERATE, "iterate");
+    return !err;
+  }
+  /**
+   * Synchronize updated contents with the file and the device.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @param proc a postprocessor object.  If it is NULL, no postprocessing is performed.  It is
+   * called for each shard with the path of the shard.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   */
+  bool synchronize(bool hard = false, FileProcessor* proc = NULL,
+                   ProgressChecker* checker = NULL) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    bool err = false;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->synchronize(hard, proc, checker)) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+      }
+    }
+    trigger_meta(MetaTrigger::SYNCHRONIZE, "synchronize");
+    return !err;
+  }
+  /**
+   * Occupy database by locking and do something meanwhile.
+   * @param writable true to use writer lock, or false to use reader lock.
+   * @param proc a processor object.  If it is NULL, no processing is performed.  It is called
+   * once while all shards are locked, with the total number of records and the total size.
+   * @return true on success, or false on failure.
+   */
+  bool occupy(bool writable = true, FileProcessor* proc = NULL) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    Occupier occupier(this, 0, writable, proc);
+    bool err = false;
+    if (!dbs_[0]->occupy(writable, &occupier)) {
+      set_shard_error(_KCCODELINE_, 0);
+      err = true;
+    }
+    trigger_meta(MetaTrigger::OCCUPY, "occupy");
+    return !err;
+  }
+  /**
+   * Begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   */
+  bool begin_transaction(bool hard = false) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->begin_transaction(hard)) {
+        set_shard_error(_KCCODELINE_, i);
+        while (i > 0) {
+          dbs_[--i]->end_transaction(false);
+        }
+        return false;
+      }
+    }
+    trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction");
+    return true;
+  }
+  /**
+   * Try to begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   */
+  bool begin_transaction_try(bool hard = false) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->begin_transaction_try(hard)) {
+        set_shard_error(_KCCODELINE_, i);
+        while (i > 0) {
+          dbs_[--i]->end_transaction(false);
+        }
+        return false;
+      }
+    }
+    trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction_try");
+    return true;
+  }
+  /**
+   * End transaction.
+   * @param commit true to commit the transaction, or false to abort the transaction.
+   * @return true on success, or false on failure.
+   */
+  bool end_transaction(bool commit = true) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    bool err = false;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->end_transaction(commit)) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+      }
+    }
+    trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
+    return !err;
+  }
+  /**
+   * Remove all records.
+   * @return true on success, or false on failure.
+   */
+  bool clear() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    bool err = false;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      if (!dbs_[i]->clear()) {
+        set_shard_error(_KCCODELINE_, i);
+        err = true;
+      }
+    }
+    trigger_meta(MetaTrigger::CLEAR, "clear");
+    return !err;
+  }
+  /**
+   * Get the number of records.
+   * @return the number of records, or -1 on failure.
+   */
+  int64_t count() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    int64_t sum = 0;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      int64_t num = dbs_[i]->count();
+      if (num < 0) {
+        set_shard_error(_KCCODELINE_, i);
+        return -1;
+      }
+      sum += num;
+    }
+    return sum;
+  }
+  /**
+   * Get the size of the database files.
+   * @return the total size of the database files in bytes, or -1 on failure.
+   */
+  int64_t size() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    int64_t sum = 0;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      int64_t num = dbs_[i]->size();
+      if (num < 0) {
+        set_shard_error(_KCCODELINE_, i);
+        return -1;
+      }
+      sum += num;
+    }
+    return sum;
+  }
+  /**
+   * Get the path of the database.
+   * @return the path of the database, or an empty string on failure.
+   */
+  std::string path() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    return path_;
+  }
+  /**
+   * Get the miscellaneous status information.
+   * @param strmap a string map to contain the result.
+   * @return true on success, or false on failure.
+   */
+  bool status(std::map<std::string, std::string>* strmap) {
+    _assert_(strmap);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    std::map<std::string, std::string> smap;
+    if (!dbs_[0]->status(&smap)) {
+      set_shard_error(_KCCODELINE_, 0);
+      return false;
+    }
+    int64_t count = 0;
+    int64_t size = 0;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      count += dbs_[i]->count();
+      size += dbs_[i]->size();
+    }
+    (*strmap)["type"] = kc::strprintf("%u", (unsigned)TYPEMISC);
+    (*strmap)["realtype"] = smap["realtype"];
+    (*strmap)["path"] = path_;
+    (*strmap)["count"] = kc::strprintf("%lld", (long long)count);
+    (*strmap)["size"] = kc::strprintf("%lld", (long long)size);
+    (*strmap)["shards"] = kc::strprintf("%lld", (long long)dbs_.size());
+    return true;
+  }
+  /**
+   * Create a cursor object.
+   * @return the return value is the created cursor object.
+   */
+  Cursor* cursor() {
+    _assert_(true);
+    return new Cursor(this);
+  }
+  /**
+   * Set the internal logger.
+   * @param logger the logger object.
+   * @param kinds kinds of logged messages by bitwise-or.
+   * @return true on success, or false on failure.
+   */
+  bool tune_logger(Logger* logger, uint32_t kinds = Logger::WARN | Logger::ERROR) {
+    _assert_(logger);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    logger_ = logger;
+    logkinds_ = kinds;
+    return true;
+  }
+  /**
+   * Set the internal meta operation trigger.
+   * @param trigger the trigger object.
+   * @return true on success, or false on failure.
+   */
+  bool tune_meta_trigger(MetaTrigger* trigger) {
+    _assert_(trigger);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    mtrigger_ = trigger;
+    return true;
+  }
+  /**
+   * Get the number of shards.
+   * @return the number of shards.
+   */
+  size_t shard_num() {
+    _assert_(true);
+    return dbs_.size();
+  }
+  /**
+   * Reveal the inner database of a shard.
+   * @param idx the index of the shard.
+   * @return the inner database object, or NULL on failure.
+   */
+  kc::BasicDB* reveal_shard_db(size_t idx) {
+    _assert_(true);
+    if (idx >= dbs_.size()) return NULL;
+    return dbs_[idx]->reveal_inner_db();
+  }
+  /**
+   * Get the opaque data of the first shard.
+   * @return the pointer to the opaque data region, or NULL if the type of the first shard does
+   * not support it.
+   */
+  char* opaque() {
+    _assert_(true);
+    kc::BasicDB* idb = dbs_[0]->reveal_inner_db();
+    if (!idb) return NULL;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::HashDB)) return ((kc::HashDB*)idb)->opaque();
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->opaque();
+    if (info == typeid(kc::DirDB)) return ((kc::DirDB*)idb)->opaque();
+    if (info == typeid(kc::ForestDB)) return ((kc::ForestDB*)idb)->opaque();
+    return NULL;
+  }
+  /**
+   * Synchronize the opaque data of the first shard.
+   * @return true on success, or false on failure.
+   */
+  bool synchronize_opaque() {
+    _assert_(true);
+    kc::BasicDB* idb = dbs_[0]->reveal_inner_db();
+    if (!idb) return false;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::HashDB)) return ((kc::HashDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::DirDB)) return ((kc::DirDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::ForestDB)) return ((kc::ForestDB*)idb)->synchronize_opaque();
+    return false;
+  }
+  /**
+   * Perform defragmentation of the database files of all shards.
+   * @param step the number of steps.  If it is not more than 0, the whole region is defraged.
+   * @return true on success, or false on failure.
+   */
+  bool defrag(int64_t step = 0) {
+    _assert_(true);
+    bool err = false;
+    for (size_t i = 0; i < dbs_.size(); i++) {
+      kc::BasicDB* idb = dbs_[i]->reveal_inner_db();
+      if (!idb) continue;
+      const std::type_info& info = typeid(*idb);
+      if (info == typeid(kc::HashDB)) {
+        if (!((kc::HashDB*)idb)->defrag(step)) err = true;
+      } else if (info == typeid(kc::TreeDB)) {
+        if (!((kc::TreeDB*)idb)->defrag(step)) err = true;
+      }
+    }
+    return !err;
+  }
+protected:
+  /**
+   * Report a message for debugging.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param kind the kind of the event.
+   * @param format the printf-like format string.
+   * @param ... used according to the format string.
+   */
+  void report(const char* file, int32_t line, const char* func, Logger::Kind kind,
+              const char* format, ...) {
+    _assert_(file && line > 0 && func && format);
+    if (!logger_ || !(kind & logkinds_)) return;
+    std::string message;
+    kc::strprintf(&message, "%s: ", path_.empty() ? "-" : path_.c_str());
+    va_list ap;
+    va_start(ap, format);
+    kc::vstrprintf(&message, format, ap);
+    va_end(ap);
+    logger_->log(file, line, func, kind, message.c_str());
+  }
+  /**
+   * Trigger a meta database operation.
+   * @param kind the kind of the event.
+   * @param message the supplement message.
+   */
+  void trigger_meta(MetaTrigger::Kind kind, const char* message) {
+    _assert_(message);
+    if (mtrigger_) mtrigger_->trigger(kind, message);
+  }
+  /**
+   * Visitor to forward records of a shard without the bracketing events.
+   */
+  class ShardVisitor : public Visitor {
+  public:
+    explicit ShardVisitor(Visitor* visitor) : visitor_(visitor) {
+      _assert_(visitor);
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      return visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp);
+    }
+    const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+      _assert_(kbuf && sp);
+      return visitor_->visit_empty(kbuf, ksiz, sp);
+    }
+    Visitor* visitor_;
+  };
+private:
+  /**
+   * Processor to occupy the rest shards in order.
+   */
+  class Occupier : public FileProcessor {
+  public:
+    Occupier(ShardDB* db, size_t idx, bool writable, FileProcessor* proc) :
+      db_(db), idx_(idx), writable_(writable), proc_(proc), count_(0), size_(0) {
+      _assert_(db);
+    }
+  private:
+    bool process(const std::string& path, int64_t count, int64_t size) {
+      _assert_(true);
+      count_ += count;
+      size_ += size;
+      size_t next = idx_ + 1;
+      if (next < db_->dbs_.size()) {
+        Occupier occupier(db_, next, writable_, proc_);
+        occupier.count_ = count_;
+        occupier.size_ = size_;
+        return db_->dbs_[next]->occupy(writable_, &occupier);
+      }
+      if (proc_ && !proc_->process(db_->path_, count_, size_)) {
+        db_->set_error(_KCCODELINE_, Error::LOGIC, "processing failed");
+        return false;
+      }
+      return true;
+    }
+    ShardDB* db_;
+    size_t idx_;
+    bool writable_;
+    FileProcessor* proc_;
+    int64_t count_;
+    int64_t size_;
+  };
+  /**
+   * Get the index of the shard of a key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return the index of the shard.
+   * @note The FNV hash is used so as not to correlate with the murmur hash of the bucket array
+   * of each shard.
+   */
+  size_t shard_index(const char* kbuf, size_t ksiz) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+    return kc::hashfnv(kbuf, ksiz) % dbs_.size();
+  }
+protected:
+  /**
+   * Get the comparator of the keys of the shards.
+   * @return the record comparator of the first shard if it is a tree database, or the lexical
+   * comparator if not.
+   */
+  kc::Comparator* shard_comparator() {
+    _assert_(true);
+    kc::BasicDB* idb = dbs_[0]->reveal_inner_db();
+    if (!idb) return kc::LEXICALCOMP;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::GrassDB)) return ((kc::GrassDB*)idb)->rcomp();
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->rcomp();
+    if (info == typeid(kc::ForestDB)) return ((kc::ForestDB*)idb)->rcomp();
+    return kc::LEXICALCOMP;
+  }
+  /**
+   * Copy the last error of a shard.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param idx the index of the shard.
+   */
+  void set_shard_error(const char* file, int32_t line, const char* func, size_t idx) {
+    _assert_(file && line > 0 && func);
+    Error e = dbs_[idx]->error();
+    set_error(file, line, func, e.code(), e.message());
+  }
+private:
+  /** Dummy constructor to forbid the use. */
+  ShardDB(const ShardDB&);
+  /** Dummy Operator to forbid the use. */
+  ShardDB& operator =(const ShardDB&);
+protected:
+  /** The method lock. */
+  kc::SpinRWLock mlock_;
+  /** The last happened error. */
+  kc::TSD<Error> error_;
+  /** The internal logger. */
+  Logger* logger_;
+  /** The kinds of logged messages. */
+  uint32_t logkinds_;
+  /** The internal meta operation trigger. */
+  MetaTrigger* mtrigger_;
+  /** The path of the database. */
+  std::string path_;
+  /** The shard databases. */
+  std::vector<kc::PolyDB*> dbs_;
+  /** The comparator of the keys of the shards. */
+  kc::Comparator* comp_;
+};
+
+
+/**
+ * Tiered database.
+ * @note This class is a concrete class of the basic database to combine an on-memory tier with
+ * a disk tier.  It is used as the internal database of the timed database specified by the
+ * "kttier" tuning parameter.  The disk tier holds every record and the memory tier holds copies
+ * of recently used records as a cache.  Retrievals consult the memory tier first and copy the
+ * records found in the disk tier into the memory tier.  Updates are written through to the disk
+ * tier and to the copy in the memory tier.  The background demoter thread drops the least
+ * recently used copies while the memory tier exceeds the capacity.  Whole database operations
+ * and cursors are inherited from the sharded database whose only shard is the disk tier.  No
+ * copy is made or dropped while the database is iterated or occupied.
+ */
+class TieredDB : public ShardDB {
+public:
+  class Cursor;
+private:
+  class TierVisitor;
+  class CacheVisitor;
+  class Demoter;
+  /* The index of the disk tier. */
+  static const size_t COLDIDX = 0;
+  /* The number of lock slots of records. */
+  static const size_t RLOCKNUM = 1024;
+  /* The number of slots of the access time table. */
+  static const size_t TICKSLOTS = 1 << 18;
+  /* The number of sampled records for demotion. */
+  static const int32_t DEMOTESAMPLE = 8;
+  /* The maximum number of records demoted in a round. */
+  static const int64_t DEMOTEUNIT = 1024;
+  /* The waiting seconds of the background demoter. */
+  static const double DEMOTEWAIT = 0.1;
+public:
+  /**
+   * Cursor to indicate a record.
+   * @note Records are visited in the disk tier and updates through the cursor drop the copies
+   * in the memory tier.
+   */
+  class Cursor : public ShardDB::Cursor {
+  public:
+    /**
+     * Constructor.
+     * @param db the container database object.
+     */
+    explicit Cursor(TieredDB* db) : ShardDB::Cursor(db), tdb_(db) {
+      _assert_(db);
+    }
+    /**
+     * Accept a visitor to the current record.
+     * @param visitor a visitor object.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @param step true to move the cursor to the next record, or false for no move.
+     * @return true on success, or false on failure.
+     */
+    bool accept(Visitor* visitor, bool writable = true, bool step = false) {
+      _assert_(visitor);
+      if (!writable) return ShardDB::Cursor::accept(visitor, false, step);
+      CacheVisitor cvis(visitor, &tdb_->hdb_, false);
+      return ShardDB::Cursor::accept(&cvis, true, step);
+    }
+  private:
+    /** Dummy constructor to forbid the use. */
+    Cursor(const Cursor&);
+    /** Dummy Operator to forbid the use. */
+    Cursor& operator =(const Cursor&);
+    /** The container database. */
+    TieredDB* tdb_;
+  };
+  /**
+   * Constructor.
+   * @param capsiz the capacity size of the memory tier.
+   */
+  explicit TieredDB(int64_t capsiz) :
+    ShardDB(1), hdb_(), capsiz_(capsiz), rlocks_(RLOCKNUM), ticks_(NULL), dcur_(NULL),
+    dthr_(NULL), writer_(false), frozen_(0), promoted_(0), demoted_(0) {
+    _assert_(capsiz > 0);
+    ticks_ = new uint32_t[TICKSLOTS];
+    std::memset(ticks_, 0, sizeof(*ticks_) * TICKSLOTS);
+  }
+  /**
+   * Destructor.
+   */
+  virtual ~TieredDB() {
+    _assert_(true);
+    if (!path_.empty()) close();
+    delete[] ticks_;
+  }
+  /**
+   * Open the database file of the disk tier and the memory tier.
+   * @param path the path of the database file of the disk tier.  The same as with kc::PolyDB.
+   * The memory tier is a cache tree database.
+   * @param mode the connection mode.  The same as with kc::PolyDB.  Records are copied into the
+   * memory tier only if it contains the writer option.
+   * @return true on success, or false on failure.
+   */
+  bool open(const std::string& path, uint32_t mode = OWRITER | OCREATE) {
+    _assert_(true);
+    {
+      kc::ScopedSpinRWLock lock(&mlock_, true);
+      if (!path_.empty()) {
+        set_error(_KCCODELINE_, Error::INVALID, "already opened");
+        return false;
+      }
+      if (logger_) {
+        dbs_[COLDIDX]->tune_logger(logger_, logkinds_);
+        hdb_.tune_logger(logger_, logkinds_);
+      }
+      if (!dbs_[COLDIDX]->open(path, mode)) {
+        set_shard_error(_KCCODELINE_, COLDIDX);
+        return false;
+      }
+      if (!hdb_.open("%", OWRITER | OCREATE)) {
+        set_hot_error(_KCCODELINE_);
+        dbs_[COLDIDX]->close();
+        return false;
+      }
+      writer_ = (mode & OWRITER) != 0;
+      comp_ = shard_comparator();
+      path_ = path;
+      trigger_meta(MetaTrigger::OPEN, "open");
+    }
+    if (writer_) {
+      dcur_ = hdb_.cursor();
+      dthr_ = new Demoter(this);
+      dthr_->start();
+    }
+    return true;
+  }
+  /**
+   * Close the database files and discard the memory tier.
+   * @return true on success, or false on failure.
+   */
+  bool close() {
+    _assert_(true);
+    bool err = false;
+    if (dthr_) {
+      dthr_->stop();
+      dthr_->join();
+      delete dthr_;
+      dthr_ = NULL;
+    }
+    if (dcur_) {
+      delete dcur_;
+      dcur_ = NULL;
+    }
+    if (!hdb_.close()) {
+      set_hot_error(_KCCODELINE_);
+      err = true;
+    }
+    if (!ShardDB::close()) err = true;
+    writer_ = false;
+    return !err;
+  }
+  /**
+   * Accept a visitor to a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note A record found in the disk tier is copied into the memory tier even by read-only
+   * operations, and so are new records.
+   */
+  bool accept(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable = true) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    visitor->visit_before();
+    bool err = false;
+    if (!accept_impl(kbuf, ksiz, visitor, writable)) err = true;
+    visitor->visit_after();
+    return !err;
+  }
+  /**
+   * Accept a visitor to multiple records at once.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note The operation for each record is performed atomically but not across records.
+   */
+  bool accept_bulk(const std::vector<std::string>& keys, Visitor* visitor,
+                   bool writable = true) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    visitor->visit_before();
+    bool err = false;
+    std::vector<std::string>::const_iterator it = keys.begin();
+    std::vector<std::string>::const_iterator itend = keys.end();
+    while (it != itend) {
+      if (!accept_impl(it->data(), it->size(), visitor, writable)) {
+        err = true;
+        break;
+      }
+      ++it;
+    }
+    visitor->visit_after();
+    return !err;
+  }
+  /**
+   * Iterate to accept a visitor for each record.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   * @note Records are visited in the disk tier and updates drop the copies in the memory tier.
+   */
+  bool iterate(Visitor *visitor, bool writable = true, ProgressChecker* checker = NULL) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    frozen_.add(1);
+    bool err = false;
+    ShardVisitor svis(visitor);
+    CacheVisitor cvis(visitor, &hdb_, false);
+    Visitor* ivis = &svis;
+    if (writable) ivis = &cvis;
+    visitor->visit_before();
+    if (!dbs_[COLDIDX]->iterate(ivis, writable, checker)) {
+      set_shard_error(_KCCODELINE_, COLDIDX);
+      err = true;
+    }
+    visitor->visit_after();
+    frozen_.add(-1);
+    trigger_meta(MetaTrigger::ITERATE, "iterate");
+    return !err;
+  }
+  /**
+   * Occupy database by locking and do something meanwhile.
+   * @param writable true to use writer lock, or false to use reader lock.
+   * @param proc a processor object.  If it is NULL, no processing is performed.
+   * @return true on success, or false on failure.
+   */
+  bool occupy(bool writable = true, FileProcessor* proc = NULL) {
+    _assert_(true);
+    frozen_.add(1);
+    bool err = false;
+    if (!ShardDB::occupy(writable, proc)) err = true;
+    frozen_.add(-1);
+    return !err;
+  }
+  /**
+   * End transaction.
+   * @param commit true to commit the transaction, or false to abort the transaction.
+   * @return true on success, or false on failure.
+   * @note The memory tier is cleared when the transaction is aborted.
+   */
+  bool end_transaction(bool commit = true) {
+    _assert_(true);
+    bool err = false;
+    if (!ShardDB::end_transaction(commit)) err = true;
+    if (!commit && !hdb_.clear()) {
+      set_hot_error(_KCCODELINE_);
+      err = true;
+    }
+    return !err;
+  }
+  /**
+   * Remove all records.
+   * @return true on success, or false on failure.
+   */
+  bool clear() {
+    _assert_(true);
+    bool err = false;
+    if (!ShardDB::clear()) err = true;
+    if (!hdb_.clear()) {
+      set_hot_error(_KCCODELINE_);
+      err = true;
+    }
+    return !err;
+  }
+  /**
+   * Get the miscellaneous status information.
+   * @param strmap a string map to contain the result.
+   * @return true on success, or false on failure.
+   */
+  bool status(std::map<std::string, std::string>* strmap) {
+    _assert_(strmap);
+    if (!ShardDB::status(strmap)) return false;
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    strmap->erase("shards");
+    (*strmap)["tier_capacity"] = kc::strprintf("%lld", (long long)capsiz_);
+    (*strmap)["tier_hot_count"] = kc::strprintf("%lld", (long long)hdb_.count());
+    (*strmap)["tier_hot_size"] = kc::strprintf("%lld", (long long)hdb_.size());
+    (*strmap)["tier_promoted"] = kc::strprintf("%lld", (long long)promoted_.get());
+    (*strmap)["tier_demoted"] = kc::strprintf("%lld", (long long)demoted_.get());
+    return true;
+  }
+  /**
+   * Create a cursor object.
+   * @return the return value is the created cursor object.
+   */
+  Cursor* cursor() {
+    _assert_(true);
+    return new Cursor(this);
+  }
+private:
+  /**
+   * Visitor to forward records of the memory tier and to detect missing records.
+   */
+  class TierVisitor : public Visitor {
+  public:
+    explicit TierVisitor(Visitor* visitor) : visitor_(visitor), hit_(false) {
+      _assert_(visitor);
+    }
+    bool hit() {
+      _assert_(true);
+      return hit_;
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      hit_ = true;
+      return visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp);
+    }
+    Visitor* visitor_;
+    bool hit_;
+  };
+  /**
+   * Visitor to forward records of the disk tier and to keep the memory tier consistent.
+   * @note With the filling flag, visited records are copied into the memory tier.  Without it,
+   * the copies of updated records are dropped.
+   */
+  class CacheVisitor : public Visitor {
+  public:
+    explicit CacheVisitor(Visitor* visitor, kc::PolyDB* hdb, bool fill) :
+      visitor_(visitor), hdb_(hdb), fill_(fill), filled_(false) {
+      _assert_(visitor && hdb);
+    }
+    bool filled() {
+      _assert_(true);
+      return filled_;
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      const char* rbuf = visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp);
+      if (rbuf == NOP) {
+        if (fill_ && hdb_->set(kbuf, ksiz, vbuf, vsiz)) filled_ = true;
+      } else if (rbuf == REMOVE || !fill_ || !hdb_->set(kbuf, ksiz, rbuf, *sp)) {
+        hdb_->remove(kbuf, ksiz);
+      } else {
+        filled_ = true;
+      }
+      return rbuf;
+    }
+    const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+      _assert_(kbuf && sp);
+      const char* rbuf = visitor_->visit_empty(kbuf, ksiz, sp);
+      if (rbuf != NOP && rbuf != REMOVE && fill_ && hdb_->set(kbuf, ksiz, rbuf, *sp))
+        filled_ = true;
+      return rbuf;
+    }
+    Visitor* visitor_;
+    kc::PolyDB* hdb_;
+    bool fill_;
+    bool filled_;
+  };
+  /**
+   * Background demoter.
+   */
+  class Demoter : public kc::Thread {
+  public:
+    explicit Demoter(TieredDB* db) : db_(db), mutex_(), cond_(), alive_(true) {
+      _assert_(db);
+    }
+    void run() {
+      _assert_(true);
+      while (true) {
+        mutex_.lock();
+        if (alive_) cond_.wait(&mutex_, DEMOTEWAIT);
+        bool alive = alive_;
+        mutex_.unlock();
+        if (!alive) break;
+        db_->demote_records(DEMOTEUNIT);
+      }
+    }
+    void stop() {
+      _assert_(true);
+      mutex_.lock();
+      alive_ = false;
+      cond_.signal();
+      mutex_.unlock();
+    }
+  private:
+    TieredDB* db_;
+    kc::Mutex mutex_;
+    kc::CondVar cond_;
+    bool alive_;
+  };
+  /**
+   * Accept a visitor to a record without the bracketing events.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note Read-only operations are answered by the memory tier if possible.  The others are
+   * performed on the disk tier, which updates the memory tier while the record is locked.
+   */
+  bool accept_impl(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    size_t lidx = kc::hashfnv(kbuf, ksiz) % RLOCKNUM;
+    rlocks_.lock(lidx);
+    bool err = false;
+    bool hit = false;
+    if (!writable) {
+      TierVisitor hvis(visitor);
+      if (hdb_.accept(kbuf, ksiz, &hvis, false)) {
+        hit = hvis.hit();
+      } else {
+        set_hot_error(_KCCODELINE_);
+        err = true;
+      }
+    }
+    if (hit) {
+      touch_record(kbuf, ksiz);
+    } else if (!err) {
+      CacheVisitor cvis(visitor, &hdb_, writer_ && frozen_.get() < 1);
+      if (dbs_[COLDIDX]->accept(kbuf, ksiz, &cvis, writable)) {
+        if (cvis.filled()) {
+          touch_record(kbuf, ksiz);
+          if (!writable) promoted_.add(1);
+        }
+      } else {
+        set_shard_error(_KCCODELINE_, COLDIDX);
+        hdb_.remove(kbuf, ksiz);
+        err = true;
+      }
+    }
+    rlocks_.unlock(lidx);
+    return !err;
+  }
+  /**
+   * Record the access time of a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   */
+  void touch_record(const char* kbuf, size_t ksiz) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+    ticks_[kc::hashmurmur(kbuf, ksiz) % TICKSLOTS] = access_tick();
+  }
+  /**
+   * Drop the least recently used records of the memory tier while the memory tier exceeds the
+   * capacity.
+   * @param max the maximum number of dropped records.
+   * @return true on success, or false on failure.
+   */
+  bool demote_records(int64_t max) {
+    _assert_(max >= 0);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    for (int64_t i = 0; i < max && frozen_.get() < 1 && hdb_.size() > capsiz_; i++) {
+      uint32_t now = access_tick();
+      std::string key;
+      uint32_t mage = 0;
+      bool jumped = false;
+      int32_t num = 0;
+      while (num < DEMOTESAMPLE) {
+        size_t ksiz;
+        char* kbuf = dcur_->get_key(&ksiz, true);
+        if (!kbuf) {
+          if (jumped) break;
+          dcur_->jump();
+          jumped = true;
+          continue;
+        }
+        uint32_t age = access_age(ticks_[kc::hashmurmur(kbuf, ksiz) % TICKSLOTS], now);
+        if (num < 1 || age > mage) {
+          key.assign(kbuf, ksiz);
+          mage = age;
+        }
+        delete[] kbuf;
+        num++;
+      }
+      if (num < 1) break;
+      if (!demote_record(key.data(), key.size())) return false;
+    }
+    return true;
+  }
+  /**
+   * Drop a record of the memory tier.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return true on success, or false on failure.
+   * @note The record is kept in the disk tier because every update is written through.
+   */
+  bool demote_record(const char* kbuf, size_t ksiz) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+    size_t lidx = kc::hashfnv(kbuf, ksiz) % RLOCKNUM;
+    rlocks_.lock(lidx);
+    bool err = false;
+    if (hdb_.remove(kbuf, ksiz)) {
+      demoted_.add(1);
+    } else if (hdb_.error() != Error::NOREC) {
+      set_hot_error(_KCCODELINE_);
+      err = true;
+    }
+    rlocks_.unlock(lidx);
+    return !err;
+  }
+  /**
+   * Copy the last error of the memory tier.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   */
+  void set_hot_error(const char* file, int32_t line, const char* func) {
+    _assert_(file && line > 0 && func);
+    Error e = hdb_.error();
+    set_error(file, line, func, e.code(), e.message());
+  }
+  /** Dummy constructor to forbid the use. */
+  TieredDB(const TieredDB&);
+  /** Dummy Operator to forbid the use. */
+  TieredDB& operator =(const TieredDB&);
+  /** The memory tier. */
+  kc::PolyDB hdb_;
+  /** The capacity size of the memory tier. */
+  int64_t capsiz_;
+  /** The locks of records. */
+  kc::SlottedSpinLock rlocks_;
+  /** The access time table. */
+  uint32_t* ticks_;
+  /** The cursor of the memory tier for demotion. */
+  kc::PolyDB::Cursor* dcur_;
+  /** The background demoter. */
+  Demoter* dthr_;
+  /** The flag whether records are copied into the memory tier. */
+  bool writer_;
+  /** The number of running iterations and occupations which suspend copying. */
+  kc::AtomicInt64 frozen_;
+  /** The number of records copied into the memory tier. */
+  kc::AtomicInt64 promoted_;
+  /** The number of records dropped from the memory tier. */
+  kc::AtomicInt64 demoted_;
+};
+
+
+/**
+ * Write-behind buffered database.
+ * @note This class is a concrete class of the basic database to buffer updates of a polymorphic
+ * database on memory.  It is used as the internal database of the timed database specified by
+ * the "ktwbuf" tuning parameter.  Updated records are kept in an ordered map which retrievals
+ * consult first, and the background flusher thread writes them into the inner database in
+ * sorted order in a transaction.  If the buffer exceeds the capacity, the updating thread
+ * flushes it by itself.  The number of records and the size count in the differences made by
+ * the buffer.  Whole database operations and cursor jumps flush the buffer before they are
+ * performed, and cursors visit records through the buffer.  During a transaction, updates
+ * bypass the buffer.  Buffered updates are lost on a crash.
+ */
+class BufferedDB : public kc::BasicDB {
+public:
+  class Cursor;
+private:
+  struct PendingRecord;
+  class CaptureVisitor;
+  class ForwardVisitor;
+  class CursorVisitor;
+  class Flusher;
+  /** The type of the buffer of pending records. */
+  typedef std::map<std::string, PendingRecord> PendingMap;
+  /* The number of lock slots of records. */
+  static const size_t RLOCKNUM = 1024;
+  /* The size of the management data of each pending record. */
+  static const int64_t PENDOVERHEAD = 64;
+  /* The waiting seconds of the background flusher. */
+  static const double FLUSHWAIT = 1.0;
+  /* The waiting seconds to retry beginning a transaction. */
+  static const double TRANWAIT = 0.01;
+public:
+  /**
+   * Cursor to indicate a record.
+   */
+  class Cursor : public kc::BasicDB::Cursor {
+    friend class BufferedDB;
+  public:
+    /**
+     * Constructor.
+     * @param db the container database object.
+     */
+    explicit Cursor(BufferedDB* db) : db_(db), cur_(NULL), back_(false) {
+      _assert_(db);
+      cur_ = db_->db_.cursor();
+    }
+    /**
+     * Destructor.
+     */
+    virtual ~Cursor() {
+      _assert_(true);
+      delete cur_;
+    }
+    /**
+     * Accept a visitor to the current record.
+     * @param visitor a visitor object.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @param step true to move the cursor to the next record, or false for no move.
+     * @return true on success, or false on failure.
+     * @note The record is visited through the buffer in the same way as the accept method of
+     * the database.  If the record is removed in the buffer, the cursor moves to the next record
+     * in the direction of the scan.
+     */
+    bool accept(Visitor* visitor, bool writable = true, bool step = false) {
+      _assert_(visitor);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      if (db_->tran_ || !db_->writer_) {
+        size_t ksiz;
+        char* kbuf = cur_->get_key(&ksiz, false);
+        if (!kbuf) {
+          db_->set_inner_error(_KCCODELINE_);
+          return false;
+        }
+        size_t lidx = kc::hashfnv(kbuf, ksiz) % RLOCKNUM;
+        delete[] kbuf;
+        db_->rlocks_.lock(lidx);
+        bool err = false;
+        if (!cur_->accept(visitor, writable, step)) {
+          db_->set_inner_error(_KCCODELINE_);
+          err = true;
+        }
+        db_->rlocks_.unlock(lidx);
+        return !err;
+      }
+      while (true) {
+        size_t ksiz;
+        char* kbuf = cur_->get_key(&ksiz, false);
+        if (!kbuf) {
+          db_->set_inner_error(_KCCODELINE_);
+          return false;
+        }
+        bool err = false;
+        bool full = false;
+        CursorVisitor cvis(visitor);
+        if (!db_->accept_impl(kbuf, ksiz, &cvis, writable, &full)) err = true;
+        delete[] kbuf;
+        if (full && !db_->flush_buffer()) err = true;
+        if (err) return false;
+        if (cvis.hit()) {
+          if (step && !cur_->step() && db_->db_.error() != Error::NOREC) {
+            db_->set_inner_error(_KCCODELINE_);
+            return false;
+          }
+          break;
+        }
+        if (!(back_ ? cur_->step_back() : cur_->step())) {
+          db_->set_inner_error(_KCCODELINE_);
+          return false;
+        }
+      }
+      return true;
+    }
+    /**
+     * Jump the cursor to the first record for forward scan.
+     * @return true on success, or false on failure.
+     * @note The buffer is flushed beforehand.
+     */
+    bool jump() {
+      _assert_(true);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = false;
+      if (!db_->flush_buffer()) return false;
+      if (!cur_->jump()) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     * @note The buffer is flushed beforehand.
+     */
+    bool jump(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = false;
+      if (!db_->flush_buffer()) return false;
+      if (!cur_->jump(kbuf, ksiz)) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @note Equal to the original Cursor::jump method except that the parameter is std::string.
+     */
+    bool jump(const std::string& key) {
+      _assert_(true);
+      return jump(key.c_str(), key.size());
+    }
+    /**
+     * Jump the cursor to the last record for backward scan.
+     * @return true on success, or false on failure.
+     * @note The buffer is flushed beforehand.
+     */
+    bool jump_back() {
+      _assert_(true);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = true;
+      if (!db_->flush_buffer()) return false;
+      if (!cur_->jump_back()) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     * @note The buffer is flushed beforehand.
+     */
+    bool jump_back(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = true;
+      if (!db_->flush_buffer()) return false;
+      if (!cur_->jump_back(kbuf, ksiz)) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @note Equal to the original Cursor::jump_back method except that the parameter is
+     * std::string.
+     */
+    bool jump_back(const std::string& key) {
+      _assert_(true);
+      return jump_back(key.c_str(), key.size());
+    }
+    /**
+     * Step the cursor to the next record.
+     * @return true on success, or false on failure.
+     */
+    bool step() {
+      _assert_(true);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = false;
+      if (!cur_->step()) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Step the cursor to the previous record.
+     * @return true on success, or false on failure.
+     */
+    bool step_back() {
+      _assert_(true);
+      kc::ScopedRWLock lock(&db_->mlock_, false);
+      back_ = true;
+      if (!cur_->step_back()) {
+        db_->set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      return true;
+    }
+    /**
+     * Get the database object.
+     * @return the database object.
+     */
+    BufferedDB* db() {
+      _assert_(true);
+      return db_;
+    }
+  private:
+    /** Dummy constructor to forbid the use. */
+    Cursor(const Cursor&);
+    /** Dummy Operator to forbid the use. */
+    Cursor& operator =(const Cursor&);
+    /** The inner database. */
+    BufferedDB* db_;
+    /** The cursor of the inner database. */
+    kc::PolyDB::Cursor* cur_;
+    /** The backward flag. */
+    bool back_;
+  };
+  /**
+   * Constructor.
+   * @param capsiz the capacity size of the buffer.
+   */
+  explicit BufferedDB(int64_t capsiz) :
+    mlock_(), error_(), logger_(NULL), logkinds_(0), mtrigger_(NULL), path_(""), db_(),
+    capsiz_(capsiz), rlocks_(RLOCKNUM), block_(), flock_(), abuf_(), fbuf_(), asiz_(0),
+    fsiz_(0), cdelta_(0), sdelta_(0), fthr_(NULL), writer_(false), tran_(false), flushed_(0) {
+    _assert_(capsiz > 0);
+  }
+  /**
+   * Destructor.
+   */
+  virtual ~BufferedDB() {
+    _assert_(true);
+    if (!path_.empty()) close();
+  }
+  /**
+   * Get the last happened error.
+   * @return the last happened error.
+   */
+  Error error() const {
+    _assert_(true);
+    return error_;
+  }
+  /**
+   * Set the error information.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param code an error code.
+   * @param message a supplement message.
+   */
+  void set_error(const char* file, int32_t line, const char* func,
+                 Error::Code code, const char* message) {
+    _assert_(file && line > 0 && func && message);
+    error_->set(code, message);
+    if (logger_) {
+      Logger::Kind kind = code == Error::BROKEN || code == Error::SYSTEM ?
+        Logger::ERROR : Logger::INFO;
+      if (kind & logkinds_)
+        report(file, line, func, kind, "%d: %s: %s", code, Error::codename(code), message);
+    }
+  }
+  /**
+   * Open the database file.
+   * @param path the path of the database file.  The same as with kc::PolyDB.
+   * @param mode the connection mode.  The same as with kc::PolyDB.  Updates are buffered only
+   * if it contains the writer option.
+   * @return true on success, or false on failure.
+   */
+  bool open(const std::string& path, uint32_t mode = OWRITER | OCREATE) {
+    _assert_(true);
+    {
+      kc::ScopedRWLock lock(&mlock_, true);
+      if (!path_.empty()) {
+        set_error(_KCCODELINE_, Error::INVALID, "already opened");
+        return false;
+      }
+      if (logger_) db_.tune_logger(logger_, logkinds_);
+      if (!db_.open(path, mode)) {
+        set_inner_error(_KCCODELINE_);
+        return false;
+      }
+      writer_ = (mode & OWRITER) != 0;
+      tran_ = false;
+      path_ = path;
+      trigger_meta(MetaTrigger::OPEN, "open");
+    }
+    if (writer_) {
+      fthr_ = new Flusher(this);
+      fthr_->start();
+    }
+    return true;
+  }
+  /**
+   * Close the database file after flushing the buffer.
+   * @return true on success, or false on failure.
+   */
+  bool close() {
+    _assert_(true);
+    if (fthr_) {
+      fthr_->stop();
+      fthr_->join();
+      delete fthr_;
+      fthr_ = NULL;
+    }
+    kc::ScopedRWLock lock(&mlock_, true);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    bool err = false;
+    if (!flush_buffer()) err = true;
+    if (!db_.close()) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    writer_ = false;
+    path_.clear();
+    trigger_meta(MetaTrigger::CLOSE, "close");
+    return !err;
+  }
+  /**
+   * Accept a visitor to a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   */
+  bool accept(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable = true) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    bool err = false;
+    bool full = false;
+    {
+      kc::ScopedRWLock lock(&mlock_, false);
+      visitor->visit_before();
+      if (!accept_impl(kbuf, ksiz, visitor, writable, &full)) err = true;
+      visitor->visit_after();
+    }
+    if (full && !flush_full()) err = true;
+    return !err;
+  }
+  /**
+   * Accept a visitor to multiple records at once.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note The operation for each record is performed atomically but not across records.
+   */
+  bool accept_bulk(const std::vector<std::string>& keys, Visitor* visitor,
+                   bool writable = true) {
+    _assert_(visitor);
+    bool err = false;
+    bool full = false;
+    {
+      kc::ScopedRWLock lock(&mlock_, false);
+      visitor->visit_before();
+      std::vector<std::string>::const_iterator it = keys.begin();
+      std::vector<std::string>::const_iterator itend = keys.end();
+      while (it != itend) {
+        if (!accept_impl(it->data(), it->size(), visitor, writable, &full)) {
+          err = true;
+          break;
+        }
+        ++it;
+      }
+      visitor->visit_after();
+    }
+    if (full && !flush_full()) err = true;
+    return !err;
+  }
+  /**
+   * Iterate to accept a visitor for each record.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   * @note The buffer is flushed beforehand and updates are blocked during the iteration.
+   */
+  bool iterate(Visitor *visitor, bool writable = true, ProgressChecker* checker = NULL) {
+    _assert_(visitor);
+    kc::ScopedRWLock lock(&mlock_, true);
+    if (!flush_buffer()) return false;
+    bool err = false;
+    if (!db_.iterate(visitor, writable, checker)) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    trigger_meta(MetaTrigger::ITERATE, "iterate");
+    return !err;
+  }
+  /**
+   * Synchronize updated contents with the file and the device.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @param proc a postprocessor object.  If it is NULL, no postprocessing is performed.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   * @note The buffer is flushed beforehand.
+   */
+  bool synchronize(bool hard = false, FileProcessor* proc = NULL,
+                   ProgressChecker* checker = NULL) {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, false);
+    if (!flush_buffer()) return false;
+    bool err = false;
+    if (!db_.synchronize(hard, proc, checker)) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    trigger_meta(MetaTrigger::SYNCHRONIZE, "synchronize");
+    return !err;
+  }
+  /**
+   * Occupy database by locking and do something meanwhile.
+   * @param writable true to use writer lock, or false to use reader lock.
+   * @param proc a processor object.  If it is NULL, no processing is performed.
+   * @return true on success, or false on failure.
+   * @note The buffer is flushed beforehand and updates are blocked during the processing.
+   */
+  bool occupy(bool writable = true, FileProcessor* proc = NULL) {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, true);
+    if (!flush_buffer()) return false;
+    bool err = false;
+    if (!db_.occupy(writable, proc)) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    trigger_meta(MetaTrigger::OCCUPY, "occupy");
+    return !err;
+  }
+  /**
+   * Begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   * @note The buffer is flushed beforehand and updates bypass the buffer until the transaction
+   * ends.
+   */
+  bool begin_transaction(bool hard = false) {
+    _assert_(true);
+    while (true) {
+      {
+        kc::ScopedRWLock lock(&mlock_, true);
+        if (!flush_buffer()) return false;
+        if (db_.begin_transaction_try(hard)) {
+          tran_ = true;
+          break;
+        }
+        if (db_.error() != Error::LOGIC) {
+          set_inner_error(_KCCODELINE_);
+          return false;
+        }
+      }
+      kc::Thread::sleep(TRANWAIT);
+    }
+    trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction");
+    return true;
+  }
+  /**
+   * Try to begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   */
+  bool begin_transaction_try(bool hard = false) {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, true);
+    if (!flush_buffer()) return false;
+    if (!db_.begin_transaction_try(hard)) {
+      set_inner_error(_KCCODELINE_);
+      return false;
+    }
+    tran_ = true;
+    trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction_try");
+    return true;
+  }
+  /**
+   * End transaction.
+   * @param commit true to commit the transaction, or false to abort the transaction.
+   * @return true on success, or false on failure.
+   */
+  bool end_transaction(bool commit = true) {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, true);
+    bool err = false;
+    if (!db_.end_transaction(commit)) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    tran_ = false;
+    trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
+    return !err;
+  }
+  /**
+   * Remove all records.
+   * @return true on success, or false on failure.
+   */
+  bool clear() {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, true);
+    flock_.lock();
+    block_.lock();
+    abuf_.clear();
+    asiz_ = 0;
+    cdelta_ = 0;
+    sdelta_ = 0;
+    block_.unlock();
+    flock_.unlock();
+    bool err = false;
+    if (!db_.clear()) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    trigger_meta(MetaTrigger::CLEAR, "clear");
+    return !err;
+  }
+  /**
+   * Get the number of records.
+   * @return the number of records, or -1 on failure.
+   * @note Pending updates are counted in without flushing the buffer.
+   */
+  int64_t count() {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, false);
+    int64_t count = db_.count();
+    if (count < 0) {
+      set_inner_error(_KCCODELINE_);
+      return -1;
+    }
+    kc::ScopedSpinLock block(&block_);
+    return std::max(count + cdelta_, (int64_t)0);
+  }
+  /**
+   * Get the size of the database file.
+   * @return the size of the database file in bytes, or -1 on failure.
+   * @note The sizes of the keys and the values of pending updates are counted in without
+   * flushing the buffer.
+   */
+  int64_t size() {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, false);
+    int64_t size = db_.size();
+    if (size < 0) {
+      set_inner_error(_KCCODELINE_);
+      return -1;
+    }
+    kc::ScopedSpinLock block(&block_);
+    return std::max(size + sdelta_, (int64_t)0);
+  }
+  /**
+   * Get the path of the database file.
+   * @return the path of the database file, or an empty string on failure.
+   */
+  std::string path() {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, false);
+    return path_;
+  }
+  /**
+   * Get the miscellaneous status information.
+   * @param strmap a string map to contain the result.
+   * @return true on success, or false on failure.
+   */
+  bool status(std::map<std::string, std::string>* strmap) {
+    _assert_(strmap);
+    kc::ScopedRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (!db_.status(strmap)) {
+      set_inner_error(_KCCODELINE_);
+      return false;
+    }
+    block_.lock();
+    int64_t pcnt = abuf_.size() + fbuf_.size();
+    int64_t psiz = asiz_ + fsiz_;
+    int64_t cdelta = cdelta_;
+    int64_t sdelta = sdelta_;
+    block_.unlock();
+    int64_t count = std::max(kc::atoi((*strmap)["count"].c_str()) + cdelta, (int64_t)0);
+    int64_t size = std::max(kc::atoi((*strmap)["size"].c_str()) + sdelta, (int64_t)0);
+    (*strmap)["type"] = kc::strprintf("%u", (unsigned)TYPEMISC);
+    (*strmap)["path"] = path_;
+    (*strmap)["count"] = kc::strprintf("%lld", (long long)count);
+    (*strmap)["size"] = kc::strprintf("%lld", (long long)size);
+    (*strmap)["wbuf_capacity"] = kc::strprintf("%lld", (long long)capsiz_);
+    (*strmap)["wbuf_count"] = kc::strprintf("%lld", (long long)pcnt);
+    (*strmap)["wbuf_size"] = kc::strprintf("%lld", (long long)psiz);
+    (*strmap)["wbuf_flushed"] = kc::strprintf("%lld", (long long)flushed_.get());
+    return true;
+  }
+  /**
+   * Create a cursor object.
+   * @return the return value is the created cursor object.
+   */
+  Cursor* cursor() {
+    _assert_(true);
+    return new Cursor(this);
+  }
+  /**
+   * Set the internal logger.
+   * @param logger the logger object.
+   * @param kinds kinds of logged messages by bitwise-or.
+   * @return true on success, or false on failure.
+   */
+  bool tune_logger(Logger* logger, uint32_t kinds = Logger::WARN | Logger::ERROR) {
+    _assert_(logger);
+    kc::ScopedRWLock lock(&mlock_, true);
+    logger_ = logger;
+    logkinds_ = kinds;
+    return true;
+  }
+  /**
+   * Set the internal meta operation trigger.
+   * @param trigger the trigger object.
+   * @return true on success, or false on failure.
+   */
+  bool tune_meta_trigger(MetaTrigger* trigger) {
+    _assert_(trigger);
+    kc::ScopedRWLock lock(&mlock_, true);
+    mtrigger_ = trigger;
+    return true;
+  }
+  /**
+   * Get the opaque data of the inner database.
+   * @return the pointer to the opaque data region, or NULL if the type of the inner database
+   * does not support it.
+   */
+  char* opaque() {
+    _assert_(true);
+    kc::BasicDB* idb = db_.reveal_inner_db();
+    if (!idb) return NULL;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::HashDB)) return ((kc::HashDB*)idb)->opaque();
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->opaque();
+    if (info == typeid(kc::DirDB)) return ((kc::DirDB*)idb)->opaque();
+    if (info == typeid(kc::ForestDB)) return ((kc::ForestDB*)idb)->opaque();
+    return NULL;
+  }
+  /**
+   * Synchronize the opaque data of the inner database.
+   * @return true on success, or false on failure.
+   */
+  bool synchronize_opaque() {
+    _assert_(true);
+    kc::BasicDB* idb = db_.reveal_inner_db();
+    if (!idb) return false;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::HashDB)) return ((kc::HashDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::DirDB)) return ((kc::DirDB*)idb)->synchronize_opaque();
+    if (info == typeid(kc::ForestDB)) return ((kc::ForestDB*)idb)->synchronize_opaque();
+    return false;
+  }
+  /**
+   * Perform defragmentation of the database file.
+   * @param step the number of steps.  If it is not more than 0, the whole region is defraged.
+   * @return true on success, or false on failure.
+   */
+  bool defrag(int64_t step = 0) {
+    _assert_(true);
+    kc::BasicDB* idb = db_.reveal_inner_db();
+    if (!idb) return true;
+    const std::type_info& info = typeid(*idb);
+    if (info == typeid(kc::HashDB)) return ((kc::HashDB*)idb)->defrag(step);
+    if (info == typeid(kc::TreeDB)) return ((kc::TreeDB*)idb)->defrag(step);
+    return true;
+  }
+protected:
+  /**
+   * Report a message for debugging.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param kind the kind of the event.
+   * @param format the printf-like format string.
+   * @param ... used according to the format string.
+   */
+  void report(const char* file, int32_t line, const char* func, Logger::Kind kind,
+              const char* format, ...) {
+    _assert_(file && line > 0 && func && format);
+    if (!logger_ || !(kind & logkinds_)) return;
+    std::string message;
+    kc::strprintf(&message, "%s: ", path_.empty() ? "-" : path_.c_str());
+    va_list ap;
+    va_start(ap, format);
+    kc::vstrprintf(&message, format, ap);
+    va_end(ap);
+    logger_->log(file, line, func, kind, message.c_str());
+  }
+  /**
+   * Trigger a meta database operation.
+   * @param kind the kind of the event.
+   * @param message the supplement message.
+   */
+  void trigger_meta(MetaTrigger::Kind kind, const char* message) {
+    _assert_(message);
+    if (mtrigger_) mtrigger_->trigger(kind, message);
+  }
+private:
+  /**
+   * Pending update of a record.
+   */
+  struct PendingRecord {
+    std::string value;                   ///< new value
+    bool live;                           ///< whether the record exists
+    bool olive;                          ///< whether the record existed before the update
+    size_t osiz;                         ///< size of the value before the update
+  };
+  /**
+   * Visitor to forward a record of the inner database and to capture the result.
+   */
+  class CaptureVisitor : public Visitor {
+  public:
+    explicit CaptureVisitor(Visitor* visitor) :
+      visitor_(visitor), value_(), changed_(false), live_(false), olive_(false), osiz_(0) {
+      _assert_(visitor);
+    }
+    bool changed() {
+      _assert_(true);
+      return changed_;
+    }
+    bool live() {
+      _assert_(true);
+      return live_;
+    }
+    const std::string& value() {
+      _assert_(true);
+      return value_;
+    }
+    bool olive() {
+      _assert_(true);
+      return olive_;
+    }
+    size_t osiz() {
+      _assert_(true);
+      return osiz_;
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      olive_ = true;
+      osiz_ = vsiz;
+      capture(visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp), *sp);
+      return NOP;
+    }
+    const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+      _assert_(kbuf && sp);
+      capture(visitor_->visit_empty(kbuf, ksiz, sp), *sp);
+      return NOP;
+    }
+    void capture(const char* rbuf, size_t rsiz) {
+      _assert_(true);
+      if (rbuf == NOP) return;
+      changed_ = true;
+      if (rbuf == REMOVE) return;
+      value_.assign(rbuf, rsiz);
+      live_ = true;
+    }
+    Visitor* visitor_;
+    std::string value_;
+    bool changed_;
+    bool live_;
+    bool olive_;
+    size_t osiz_;
+  };
+  /**
+   * Visitor to forward a record of the inner database without the bracketing events.
+   */
+  class ForwardVisitor : public Visitor {
+  public:
+    explicit ForwardVisitor(Visitor* visitor) : visitor_(visitor) {
+      _assert_(visitor);
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      return visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp);
+    }
+    const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+      _assert_(kbuf && sp);
+      return visitor_->visit_empty(kbuf, ksiz, sp);
+    }
+    Visitor* visitor_;
+  };
+  /**
+   * Visitor to forward a record at a cursor and to skip missing records.
+   */
+  class CursorVisitor : public Visitor {
+  public:
+    explicit CursorVisitor(Visitor* visitor) : visitor_(visitor), hit_(false) {
+      _assert_(visitor);
+    }
+    bool hit() {
+      _assert_(true);
+      return hit_;
+    }
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+                           const char* vbuf, size_t vsiz, size_t* sp) {
+      _assert_(kbuf && vbuf && sp);
+      hit_ = true;
+      return visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, sp);
+    }
+    Visitor* visitor_;
+    bool hit_;
+  };
+  /**
+   * Background flusher.
+   */
+  class Flusher : public kc::Thread {
+  public:
+    explicit Flusher(BufferedDB* db) : db_(db), mutex_(), cond_(), alive_(true) {
+      _assert_(db);
+    }
+    void run() {
+      _assert_(true);
+      while (true) {
+        mutex_.lock();
+        if (alive_) cond_.wait(&mutex_, FLUSHWAIT);
+        bool alive = alive_;
+        mutex_.unlock();
+        if (!alive) break;
+        kc::ScopedRWLock lock(&db_->mlock_, false);
+        db_->flush_buffer();
+      }
+    }
+    void wake() {
+      _assert_(true);
+      mutex_.lock();
+      cond_.signal();
+      mutex_.unlock();
+    }
+    void stop() {
+      _assert_(true);
+      mutex_.lock();
+      alive_ = false;
+      cond_.signal();
+      mutex_.unlock();
+    }
+  private:
+    BufferedDB* db_;
+    kc::Mutex mutex_;
+    kc::CondVar cond_;
+    bool alive_;
+  };
+  /**
+   * Accept a visitor to a record without the bracketing events.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param fullp the pointer to the variable which is set true if the buffer exceeds the
+   * capacity.
+   * @return true on success, or false on failure.
+   */
+  bool accept_impl(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable,
+                   bool* fullp) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor && fullp);
+    size_t lidx = kc::hashfnv(kbuf, ksiz) % RLOCKNUM;
+    rlocks_.lock(lidx);
+    bool err = false;
+    std::string key(kbuf, ksiz);
+    PendingRecord rec;
+    bool hit = false;
+    if (!tran_) {
+      block_.lock();
+      PendingMap::iterator it = abuf_.find(key);
+      if (it != abuf_.end()) {
+        rec = it->second;
+        hit = true;
+      } else {
+        it = fbuf_.find(key);
+        if (it != fbuf_.end()) {
+          rec = it->second;
+          hit = true;
+        }
+      }
+      block_.unlock();
+    }
+    if (hit) {
+      size_t rsiz;
+      const char* rbuf = rec.live ?
+        visitor->visit_full(kbuf, ksiz, rec.value.data(), rec.value.size(), &rsiz) :
+        visitor->visit_empty(kbuf, ksiz, &rsiz);
+      if (writable && rbuf != Visitor::NOP) {
+        rec.olive = rec.live;
+        rec.osiz = rec.value.size();
+        if (rbuf == Visitor::REMOVE) {
+          rec.value.clear();
+          rec.live = false;
+        } else {
+          rec.value.assign(rbuf, rsiz);
+          rec.live = true;
+        }
+        if (put_pending(key, rec)) *fullp = true;
+      }
+    } else if (tran_ || !writer_ || !writable) {
+      ForwardVisitor fvis(visitor);
+      if (!db_.accept(kbuf, ksiz, &fvis, writable)) {
+        set_inner_error(_KCCODELINE_);
+        err = true;
+      }
+    } else {
+      CaptureVisitor cvis(visitor);
+      if (db_.accept(kbuf, ksiz, &cvis, false)) {
+        if (cvis.changed()) {
+          rec.value = cvis.value();
+          rec.live = cvis.live();
+          rec.olive = cvis.olive();
+          rec.osiz = cvis.osiz();
+          if (put_pending(key, rec)) *fullp = true;
+        }
+      } else {
+        set_inner_error(_KCCODELINE_);
+        err = true;
+      }
+    }
+    rlocks_.unlock(lidx);
+    return !err;
+  }
+  /**
+   * Store a pending update into the buffer.
+   * @param key the key of the record.
+   * @param rec the pending update.
+   * @return true if the buffer exceeds the capacity, or false if not.
+   * @note If the record already has a pending update, its state before the update is kept.
+   */
+  bool put_pending(const std::string& key, const PendingRecord& rec) {
+    _assert_(true);
+    block_.lock();
+    PendingMap::iterator it = abuf_.find(key);
+    if (it != abuf_.end()) {
+      apply_delta(key, it->second, -1);
+      asiz_ += (int64_t)rec.value.size() - (int64_t)it->second.value.size();
+      it->second.value = rec.value;
+      it->second.live = rec.live;
+      apply_delta(key, it->second, 1);
+    } else {
+      asiz_ += key.size() + rec.value.size() + PENDOVERHEAD;
+      abuf_[key] = rec;
+      apply_delta(key, rec, 1);
+    }
+    int64_t asiz = asiz_;
+    block_.unlock();
+    if (asiz > capsiz_) return true;
+    if (asiz > capsiz_ / 2 && fthr_) fthr_->wake();
+    return false;
+  }
+  /**
+   * Apply the differences of the number of records and the size made by a pending update.
+   * @param key the key of the record.
+   * @param rec the pending update.
+   * @param sign 1 to add the differences, or -1 to cancel them.
+   * @note The lock of the buffers must be held by the caller.
+   */
+  void apply_delta(const std::string& key, const PendingRecord& rec, int64_t sign) {
+    _assert_(true);
+    if (rec.live) {
+      cdelta_ += sign;
+      sdelta_ += sign * (int64_t)(key.size() + rec.value.size());
+    }
+    if (rec.olive) {
+      cdelta_ -= sign;
+      sdelta_ -= sign * (int64_t)(key.size() + rec.osiz);
+    }
+  }
+  /**
+   * Flush the buffer after an update exceeds the capacity.
+   * @return true on success, or false on failure.
+   */
+  bool flush_full() {
+    _assert_(true);
+    kc::ScopedRWLock lock(&mlock_, false);
+    return flush_buffer();
+  }
+  /**
+   * Write all pending updates into the inner database.
+   * @return true on success, or false on failure.
+   * @note The method lock must be held by the caller.  Pending updates are moved to the
+   * flushing buffer, which retrievals keep consulting until they are written.  The differences
+   * made by each update are cancelled when it is written and restored if the transaction fails.
+   */
+  bool flush_buffer() {
+    _assert_(true);
+    kc::ScopedMutex lock(&flock_);
+    block_.lock();
+    fbuf_.swap(abuf_);
+    fsiz_ = asiz_;
+    asiz_ = 0;
+    block_.unlock();
+    if (fbuf_.empty()) return true;
+    bool err = false;
+    bool tran = db_.begin_transaction(false);
+    if (!tran) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    PendingMap::iterator it = fbuf_.begin();
+    PendingMap::iterator itend = fbuf_.end();
+    PendingMap::iterator wend = it;
+    while (!err && it != itend) {
+      const std::string& key = it->first;
+      const PendingRecord& rec = it->second;
+      if (rec.live) {
+        if (!db_.set(key.data(), key.size(), rec.value.data(), rec.value.size())) {
+          set_inner_error(_KCCODELINE_);
+          err = true;
+        }
+      } else if (!db_.remove(key.data(), key.size()) && db_.error() != Error::NOREC) {
+        set_inner_error(_KCCODELINE_);
+        err = true;
+      }
+      if (!err) {
+        block_.lock();
+        apply_delta(key, rec, -1);
+        block_.unlock();
+        wend = ++it;
+      }
+    }
+    if (tran && !db_.end_transaction(!err)) {
+      set_inner_error(_KCCODELINE_);
+      err = true;
+    }
+    block_.lock();
+    if (err) {
+      for (it = fbuf_.begin(); it != wend; ++it) {
+        apply_delta(it->first, it->second, 1);
+      }
+      for (it = fbuf_.begin(); it != itend; ++it) {
+        PendingMap::iterator ait = abuf_.find(it->first);
+        if (ait == abuf_.end()) {
+          asiz_ += it->first.size() + it->second.value.size() + PENDOVERHEAD;
+          abuf_[it->first] = it->second;
+        } else {
+          ait->second.olive = it->second.olive;
+          ait->second.osiz = it->second.osiz;
+        }
+      }
+    } else {
+      flushed_.add(fbuf_.size());
+    }
+    fbuf_.clear();
+    fsiz_ = 0;
+    block_.unlock();
+    return !err;
+  }
+  /**
+   * Copy the last error of the inner database.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   */
+  void set_inner_error(const char* file, int32_t line, const char* func) {
+    _assert_(file && line > 0 && func);
+    Error e = db_.error();
+    set_error(file, line, func, e.code(), e.message());
+  }
+  /** Dummy constructor to forbid the use. */
+  BufferedDB(const BufferedDB&);
+  /** Dummy Operator to forbid the use. */
+  BufferedDB& operator =(const BufferedDB&);
+  /** The method lock. */
+  kc::RWLock mlock_;
+  /** The last happened error. */
+  kc::TSD<Error> error_;
+  /** The internal logger. */
+  Logger* logger_;
+  /** The kinds of logged messages. */
+  uint32_t logkinds_;
+  /** The internal meta operation trigger. */
+  MetaTrigger* mtrigger_;
+  /** The path of the database file. */
+  std::string path_;
+  /** The inner database. */
+  kc::PolyDB db_;
+  /** The capacity size of the buffer. */
+  int64_t capsiz_;
+  /** The locks of records. */
+  kc::SlottedSpinLock rlocks_;
+  /** The lock of the buffers. */
+  kc::SpinLock block_;
+  /** The lock of flushing. */
+  kc::Mutex flock_;
+  /** The buffer of pending updates. */
+  PendingMap abuf_;
+  /** The buffer of updates being flushed. */
+  PendingMap fbuf_;
+  /** The size of the buffer of pending updates. */
+  int64_t asiz_;
+  /** The size of the buffer of updates being flushed. */
+  int64_t fsiz_;
+  /** The difference of the number of records made by the buffers. */
+  int64_t cdelta_;
+  /** The difference of the size made by the buffers. */
+  int64_t sdelta_;
+  /** The background flusher. */
+  Flusher* fthr_;
+  /** The flag whether updates are buffered. */
+  bool writer_;
+  /** The flag whether a transaction is in progress. */
+  bool tran_;
+  /** The number of flushed records. */
+  kc::AtomicInt64 flushed_;
+};
+
+
+/**
+ * Sorted table database.
+ * @note This class is a concrete class of the basic database to serve records of an immutable
+ * file in which records are sorted in the lexical order of keys.  The file is mapped on memory
+ * and is searched by the index of blocks and the optional Bloom filter, so that opening it does
+ * not load any record.  It is used as the internal database of the timed database whose path
+ * has the extension "ktst".  The file is made by the SortedTableDB::Builder class.  Every
+ * updating operation fails.
+ */
+class SortedTableDB : public kc::BasicDB {
+public:
+  class Cursor;
+  class Builder;
+private:
+  struct RecordRef;
+public:
+  /** The extension of the database file. */
+  static const char* const EXTNAME;
+  /** The size of the opaque region. */
+  static const size_t OPAQUESIZ = 16;
+private:
+  /* The magic data of the file. */
+  static const char* const MAGICDATA;
+  /* The size of the header. */
+  static const int64_t HEADSIZ = 64;
+  /* The offset of the opaque region. */
+  static const int64_t OPAQUEOFF = 48;
+  /* The size of each entry of the block index. */
+  static const int64_t INDEXUNIT = 8;
+  /* The minimum size of each block. */
+  static const int64_t BLOCKSIZ = 4096;
+  /* The number of hash functions of the Bloom filter. */
+  static const int32_t BLOOMHASHNUM = 5;
+public:
+  /**
+   * Cursor to indicate a record.
+   */
+  class Cursor : public kc::BasicDB::Cursor {
+    friend class SortedTableDB;
+  public:
+    /**
+     * Constructor.
+     * @param db the container database object.
+     */
+    explicit Cursor(SortedTableDB* db) : db_(db), off_(-1) {
+      _assert_(db);
+    }
+    /**
+     * Destructor.
+     */
+    virtual ~Cursor() {
+      _assert_(true);
+    }
+    /**
+     * Accept a visitor to the current record.
+     * @param visitor a visitor object.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @param step true to move the cursor to the next record, or false for no move.
+     * @return true on success, or false on failure.
+     */
+    bool accept(Visitor* visitor, bool writable = true, bool step = false) {
+      _assert_(visitor);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      if (writable) {
+        db_->set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+        return false;
+      }
+      if (off_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      RecordRef rec;
+      if (!db_->read_record(off_, &rec)) return false;
+      size_t rsiz;
+      visitor->visit_full(rec.kbuf, rec.ksiz, rec.vbuf, rec.vsiz, &rsiz);
+      if (step) off_ = rec.next < db_->dend_ ? rec.next : -1;
+      return true;
+    }
+    /**
+     * Jump the cursor to the first record for forward scan.
+     * @return true on success, or false on failure.
+     */
+    bool jump() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      off_ = db_->count_ > 0 ? HEADSIZ : -1;
+      return settle();
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     */
+    bool jump(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      off_ = db_->lower_bound(kbuf, ksiz);
+      if (off_ >= db_->dend_) off_ = -1;
+      return settle();
+    }
+    /**
+     * Jump the cursor to a record for forward scan.
+     * @note Equal to the original Cursor::jump method except that the parameter is std::string.
+     */
+    bool jump(const std::string& key) {
+      _assert_(true);
+      return jump(key.c_str(), key.size());
+    }
+    /**
+     * Jump the cursor to the last record for backward scan.
+     * @return true on success, or false on failure.
+     */
+    bool jump_back() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      off_ = db_->count_ > 0 ? db_->prev_offset(db_->dend_) : -1;
+      return settle();
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @return true on success, or false on failure.
+     */
+    bool jump_back(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      off_ = db_->lower_bound(kbuf, ksiz);
+      if (off_ < 0) return false;
+      RecordRef rec;
+      if (off_ < db_->dend_ && db_->read_record(off_, &rec) &&
+          db_->compare_keys(rec.kbuf, rec.ksiz, kbuf, ksiz) == 0) return true;
+      off_ = off_ > HEADSIZ ? db_->prev_offset(off_) : -1;
+      return settle();
+    }
+    /**
+     * Jump the cursor to a record for backward scan.
+     * @note Equal to the original Cursor::jump_back method except that the parameter is
+     * std::string.
+     */
+    bool jump_back(const std::string& key) {
+      _assert_(true);
+      return jump_back(key.c_str(), key.size());
+    }
+    /**
+     * Step the cursor to the next record.
+     * @return true on success, or false on failure.
+     */
+    bool step() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      if (off_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      RecordRef rec;
+      if (!db_->read_record(off_, &rec)) return false;
+      off_ = rec.next < db_->dend_ ? rec.next : -1;
+      return settle();
+    }
+    /**
+     * Step the cursor to the previous record.
+     * @return true on success, or false on failure.
+     */
+    bool step_back() {
+      _assert_(true);
+      kc::ScopedSpinRWLock lock(&db_->mlock_, false);
+      if (off_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      off_ = off_ > HEADSIZ ? db_->prev_offset(off_) : -1;
+      return settle();
+    }
+    /**
+     * Get the database object.
+     * @return the database object.
+     */
+    SortedTableDB* db() {
+      _assert_(true);
+      return db_;
+    }
+  private:
+    /**
+     * Set the error if the cursor indicates no record.
+     * @return true if the cursor indicates a record, or false if not.
+     */
+    bool settle() {
+      _assert_(true);
+      if (off_ < 0) {
+        db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+        return false;
+      }
+      return true;
+    }
+    /** Dummy constructor to forbid the use. */
+    Cursor(const Cursor&);
+    /** Dummy Operator to forbid the use. */
+    Cursor& operator =(const Cursor&);
+    /** The inner database. */
+    SortedTableDB* db_;
+    /** The offset of the current record. */
+    int64_t off_;
+  };
+  /**
+   * Builder of a database file from records in ascending order of keys.
+   */
+  class Builder {
+  public:
+    /**
+     * Constructor.
+     * @param bnum the number of bits of the Bloom filter.  If it is not more than 0, the filter
+     * is not made.
+     */
+    explicit Builder(int64_t bnum = 0) :
+      file_(), emsg_(NULL), buf_(), off_(0), boff_(0), count_(0), lkey_(),
+      index_(), bloom_(NULL), bmask_(0) {
+      _assert_(true);
+      if (bnum > 0) {
+        uint64_t num = 64;
+        while (num < (uint64_t)bnum && num < (1ULL << 40)) {
+          num <<= 1;
+        }
+        bmask_ = num - 1;
+        bloom_ = new uint8_t[num/8];
+        std::memset(bloom_, 0, num / 8);
+      }
+    }
+    /**
+     * Destructor.
+     */
+    ~Builder() {
+      _assert_(true);
+      delete[] bloom_;
+    }
+    /**
+     * Open the file to be built.
+     * @param path the path of the file.
+     * @return true on success, or false on failure.
+     */
+    bool open(const std::string& path) {
+      _assert_(true);
+      if (!file_.open(path, kc::File::OWRITER | kc::File::OCREATE | kc::File::OTRUNCATE)) {
+        emsg_ = file_.error();
+        return false;
+      }
+      buf_.append(HEADSIZ, '\0');
+      off_ = HEADSIZ;
+      boff_ = -BLOCKSIZ;
+      return true;
+    }
+    /**
+     * Append a record.
+     * @param kbuf the pointer to the key region.
+     * @param ksiz the size of the key region.
+     * @param vbuf the pointer to the value region.
+     * @param vsiz the size of the value region.
+     * @return true on success, or false on failure.
+     * @note The key must be greater than the key of the previous record.
+     */
+    bool append(const char* kbuf, size_t ksiz, const char* vbuf, size_t vsiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && vbuf && vsiz <= kc::MEMMAXSIZ);
+      if (count_ > 0 && compare_keys(kbuf, ksiz, lkey_.data(), lkey_.size()) <= 0) {
+        emsg_ = "keys out of order";
+        return false;
+      }
+      if (off_ - boff_ >= BLOCKSIZ) {
+        boff_ = off_;
+        index_.push_back(off_);
+      }
+      char numbuf[kc::NUMBUFSIZ*2];
+      char* wp = numbuf;
+      wp += kc::writevarnum(wp, ksiz);
+      wp += kc::writevarnum(wp, vsiz);
+      buf_.append(numbuf, wp - numbuf);
+      buf_.append(kbuf, ksiz);
+      buf_.append(vbuf, vsiz);
+      off_ += (wp - numbuf) + ksiz + vsiz;
+      lkey_.assign(kbuf, ksiz);
+      count_++;
+      if (bloom_) {
+        uint64_t hash = kc::hashmurmur(kbuf, ksiz);
+        uint64_t step = kc::hashfnv(kbuf, ksiz) | 1;
+        for (int32_t i = 0; i < BLOOMHASHNUM; i++) {
+          uint64_t bidx = (hash + step * i) & bmask_;
+          bloom_[bidx>>3] |= 1 << (bidx & 7);
+        }
+      }
+      if ((int64_t)buf_.size() >= BLOCKSIZ * 256) return flush();
+      return true;
+    }
+    /**
+     * Close the file after writing the index, the Bloom filter, and the header.
+     * @param opaque the data of the opaque region, whose size is OPAQUESIZ.  If it is NULL, the
+     * region is filled with zero.
+     * @return true on success, or false on failure.
+     */
+    bool close(const char* opaque = NULL) {
+      _assert_(true);
+      bool err = false;
+      int64_t dend = off_;
+      for (size_t i = 0; i < index_.size(); i++) {
+        char numbuf[INDEXUNIT];
+        kc::writefixnum(numbuf, index_[i], INDEXUNIT);
+        buf_.append(numbuf, INDEXUNIT);
+      }
+      int64_t bloff = dend + index_.size() * INDEXUNIT;
+      if (bloom_) buf_.append((char*)bloom_, (bmask_ + 1) / 8);
+      if (!flush()) err = true;
+      char head[HEADSIZ];
+      std::memset(head, 0, sizeof(head));
+      std::memcpy(head, MAGICDATA, std::strlen(MAGICDATA));
+      kc::writefixnum(head + 8, count_, sizeof(int64_t));
+      kc::writefixnum(head + 16, dend, sizeof(int64_t));
+      kc::writefixnum(head + 24, index_.size(), sizeof(int64_t));
+      kc::writefixnum(head + 32, bloom_ ? bloff : 0, sizeof(int64_t));
+      kc::writefixnum(head + 40, bloom_ ? bmask_ + 1 : 0, sizeof(int64_t));
+      if (opaque) std::memcpy(head + OPAQUEOFF, opaque, OPAQUESIZ);
+      if (!err && !file_.write(0, head, sizeof(head))) {
+        emsg_ = file_.error();
+        err = true;
+      }
+      if (!file_.close()) {
+        if (!emsg_) emsg_ = file_.error();
+        err = true;
+      }
+      return !err;
+    }
+    /**
+     * Get the number of appended records.
+     * @return the number of appended records.
+     */
+    int64_t count() {
+      _assert_(true);
+      return count_;
+    }
+    /**
+     * Get the message of the last happened error.
+     * @return the message of the last happened error, or NULL if no error has happened.
+     */
+    const char* error() {
+      _assert_(true);
+      return emsg_;
+    }
+  private:
+    /**
+     * Write the buffered data into the file.
+     * @return true on success, or false on failure.
+     */
+    bool flush() {
+      _assert_(true);
+      if (!file_.append(buf_.data(), buf_.size())) {
+        emsg_ = file_.error();
+        return false;
+      }
+      buf_.clear();
+      return true;
+    }
+    /** Dummy constructor to forbid the use. */
+    Builder(const Builder&);
+    /** Dummy Operator to forbid the use. */
+    Builder& operator =(const Builder&);
+    /** The file object. */
+    kc::File file_;
+    /** The message of the last happened error. */
+    const char* emsg_;
+    /** The buffer of data to be written. */
+    std::string buf_;
+    /** The end offset of records. */
+    int64_t off_;
+    /** The offset of the current block. */
+    int64_t boff_;
+    /** The number of records. */
+    int64_t count_;
+    /** The key of the last record. */
+    std::string lkey_;
+    /** The offsets of the blocks. */
+    std::vector<int64_t> index_;
+    /** The bit array of the Bloom filter. */
+    uint8_t* bloom_;
+    /** The mask of bit indices of the Bloom filter. */
+    uint64_t bmask_;
+  };
+  /**
+   * Default constructor.
+   */
+  explicit SortedTableDB() :
+    mlock_(), error_(), logger_(NULL), logkinds_(0), mtrigger_(NULL), path_(""),
+    map_(NULL), msiz_(0), count_(0), dend_(0), index_(NULL), inum_(0),
+    bloom_(NULL), bmask_(0) {
+    _assert_(true);
+    std::memset(opaque_, 0, sizeof(opaque_));
+  }
+  /**
+   * Destructor.
+   */
+  virtual ~SortedTableDB() {
+    _assert_(true);
+    if (!path_.empty()) close();
+  }
+  /**
+   * Get the last happened error.
+   * @return the last happened error.
+   */
+  Error error() const {
+    _assert_(true);
+    return error_;
+  }
+  /**
+   * Set the error information.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param code an error code.
+   * @param message a supplement message.
+   */
+  void set_error(const char* file, int32_t line, const char* func,
+                 Error::Code code, const char* message) {
+    _assert_(file && line > 0 && func && message);
+    error_->set(code, message);
+    if (logger_) {
+      Logger::Kind kind = code == Error::BROKEN || code == Error::SYSTEM ?
+        Logger::ERROR : Logger::INFO;
+      if (kind & logkinds_)
+        report(file, line, func, kind, "%d: %s: %s", code, Error::codename(code), message);
+    }
+  }
+  /**
+   * Open a database file.
+   * @param path the path of a database file.  Tuning parameters following "#" are ignored.
+   * @param mode the connection mode.  The database is always opened as a reader.
+   * @return true on success, or false on failure.
+   */
+  bool open(const std::string& path, uint32_t mode = OREADER);
+  /**
+   * Close the database file.
+   * @return true on success, or false on failure.
+   */
+  bool close();
+  /**
+   * Accept a visitor to a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   */
+  bool accept(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable = true) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (writable) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      return false;
+    }
+    visitor->visit_before();
+    bool err = false;
+    if (!accept_impl(kbuf, ksiz, visitor)) err = true;
+    visitor->visit_after();
+    return !err;
+  }
+  /**
+   * Accept a visitor to multiple records at once.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   */
+  bool accept_bulk(const std::vector<std::string>& keys, Visitor* visitor,
+                   bool writable = true) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (writable) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      return false;
+    }
+    visitor->visit_before();
+    bool err = false;
+    std::vector<std::string>::const_iterator it = keys.begin();
+    std::vector<std::string>::const_iterator itend = keys.end();
+    while (it != itend) {
+      if (!accept_impl(it->data(), it->size(), visitor)) {
+        err = true;
+        break;
+      }
+      ++it;
+    }
+    visitor->visit_after();
+    return !err;
+  }
+  /**
+   * Iterate to accept a visitor for each record.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   */
+  bool iterate(Visitor *visitor, bool writable = true, ProgressChecker* checker = NULL) {
+    _assert_(visitor);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (writable) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      return false;
+    }
+    if (checker && !checker->check("iterate", "beginning", 0, count_)) {
+      set_error(_KCCODELINE_, Error::LOGIC, "checker failed");
+      return false;
+    }
+    visitor->visit_before();
+    bool err = false;
+    int64_t off = HEADSIZ;
+    int64_t curcnt = 0;
+    while (off < dend_) {
+      RecordRef rec;
+      if (!read_record(off, &rec)) {
+        err = true;
+        break;
+      }
+      size_t rsiz;
+      visitor->visit_full(rec.kbuf, rec.ksiz, rec.vbuf, rec.vsiz, &rsiz);
+      off = rec.next;
+      curcnt++;
+      if (checker && !checker->check("iterate", "processing", curcnt, count_)) {
+        set_error(_KCCODELINE_, Error::LOGIC, "checker failed");
+        err = true;
+        break;
+      }
+    }
+    visitor->visit_after();
+    if (!err && checker && !checker->check("iterate", "ending", -1, -1)) {
+      set_error(_KCCODELINE_, Error::LOGIC, "checker failed");
+      err = true;
+    }
+    trigger_meta(MetaTrigger::ITERATE, "iterate");
+    return !err;
+  }
+  /**
+   * Synchronize updated contents with the file and the device.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @param proc a postprocessor object.  If it is NULL, no postprocessing is performed.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @return true on success, or false on failure.
+   */
+  bool synchronize(bool hard = false, FileProcessor* proc = NULL,
+                   ProgressChecker* checker = NULL) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (proc && !proc->process(path_, count_, msiz_)) {
+      set_error(_KCCODELINE_, Error::LOGIC, "postprocessing failed");
+      return false;
+    }
+    trigger_meta(MetaTrigger::SYNCHRONIZE, "synchronize");
+    return true;
+  }
+  /**
+   * Occupy database by locking and do something meanwhile.
+   * @param writable true to use writer lock, or false to use reader lock.
+   * @param proc a processor object.  If it is NULL, no processing is performed.
+   * @return true on success, or false on failure.
+   */
+  bool occupy(bool writable = true, FileProcessor* proc = NULL) {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, writable);
+    bool err = false;
+    if (proc && !proc->process(path_, count_, msiz_)) {
+      set_error(_KCCODELINE_, Error::LOGIC, "processing failed");
+      err = true;
+    }
+    trigger_meta(MetaTrigger::OCCUPY, "occupy");
+    return !err;
+  }
+  /**
+   * Begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   */
+  bool begin_transaction(bool hard = false) {
+    _assert_(true);
+    set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+    return false;
+  }
+  /**
+   * Try to begin transaction.
+   * @param hard true for physical synchronization with the device, or false for logical
+   * synchronization with the file system.
+   * @return true on success, or false on failure.
+   */
+  bool begin_transaction_try(bool hard = false) {
+    _assert_(true);
+    set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+    return false;
+  }
+  /**
+   * End transaction.
+   * @param commit true to commit the transaction, or false to abort the transaction.
+   * @return true on success, or false on failure.
+   */
+  bool end_transaction(bool commit = true) {
+    _assert_(true);
+    set_error(_KCCODELINE_, Error::INVALID, "not in transaction");
+    return false;
+  }
+  /**
+   * Remove all records.
+   * @return true on success, or false on failure.
+   */
+  bool clear() {
+    _assert_(true);
+    set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+    return false;
+  }
+  /**
+   * Get the number of records.
+   * @return the number of records, or -1 on failure.
+   */
+  int64_t count() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return -1;
+    }
+    return count_;
+  }
+  /**
+   * Get the size of the database file.
+   * @return the size of the database file in bytes, or -1 on failure.
+   */
+  int64_t size() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return -1;
+    }
+    return msiz_;
+  }
+  /**
+   * Get the path of the database file.
+   * @return the path of the database file, or an empty string on failure.
+   */
+  std::string path() {
+    _assert_(true);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    return path_;
+  }
+  /**
+   * Get the miscellaneous status information.
+   * @param strmap a string map to contain the result.
+   * @return true on success, or false on failure.
+   */
+  bool status(std::map<std::string, std::string>* strmap) {
+    _assert_(strmap);
+    kc::ScopedSpinRWLock lock(&mlock_, false);
+    if (path_.empty()) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    (*strmap)["type"] = kc::strprintf("%u", (unsigned)TYPEMISC);
+    (*strmap)["realtype"] = kc::strprintf("%u", (unsigned)TYPEMISC);
+    (*strmap)["path"] = path_;
+    (*strmap)["count"] = kc::strprintf("%lld", (long long)count_);
+    (*strmap)["size"] = kc::strprintf("%lld", (long long)msiz_);
+    (*strmap)["blocks"] = kc::strprintf("%lld", (long long)inum_);
+    (*strmap)["bloombits"] = kc::strprintf("%lld", (long long)(bloom_ ? bmask_ + 1 : 0));
+    return true;
+  }
+  /**
+   * Create a cursor object.
+   * @return the return value is the created cursor object.
+   */
+  Cursor* cursor() {
+    _assert_(true);
+    return new Cursor(this);
+  }
+  /**
+   * Set the internal logger.
+   * @param logger the logger object.
+   * @param kinds kinds of logged messages by bitwise-or.
+   * @return true on success, or false on failure.
+   */
+  bool tune_logger(Logger* logger, uint32_t kinds = Logger::WARN | Logger::ERROR) {
+    _assert_(logger);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    logger_ = logger;
+    logkinds_ = kinds;
+    return true;
+  }
+  /**
+   * Set the internal meta operation trigger.
+   * @param trigger the trigger object.
+   * @return true on success, or false on failure.
+   */
+  bool tune_meta_trigger(MetaTrigger* trigger) {
+    _assert_(trigger);
+    kc::ScopedSpinRWLock lock(&mlock_, true);
+    mtrigger_ = trigger;
+    return true;
+  }
+  /**
+   * Get the opaque data.
+   * @return the pointer to the opaque data region, whose size is OPAQUESIZ.
+   * @note The region is a copy of the file and modifying it has no effect on the file.
+   */
+  char* opaque() {
+    _assert_(true);
+    return opaque_;
+  }
+  /**
+   * Compare two keys in the lexical order.
+   * @param abuf the pointer to the region of one key.
+   * @param asiz the size of the region of one key.
+   * @param bbuf the pointer to the region of the other key.
+   * @param bsiz the size of the region of the other key.
+   * @return positive if the former is bigger, negative if the latter is bigger, 0 if both are
+   * equivalent.
+   */
+  static int32_t compare_keys(const char* abuf, size_t asiz, const char* bbuf, size_t bsiz) {
+    _assert_(abuf && bbuf);
+    size_t msiz = asiz < bsiz ? asiz : bsiz;
+    int32_t rv = msiz > 0 ? std::memcmp(abuf, bbuf, msiz) : 0;
+    if (rv != 0) return rv;
+    return asiz < bsiz ? -1 : asiz > bsiz ? 1 : 0;
+  }
+protected:
+  /**
+   * Report a message for debugging.
+   * @param file the file name of the program source code.
+   * @param line the line number of the program source code.
+   * @param func the function name of the program source code.
+   * @param kind the kind of the event.
+   * @param format the printf-like format string.
+   * @param ... used according to the format string.
+   */
+  void report(const char* file, int32_t line, const char* func, Logger::Kind kind,
+              const char* format, ...) {
+    _assert_(file && line > 0 && func && format);
+    if (!logger_ || !(kind & logkinds_)) return;
+    std::string message;
+    kc::strprintf(&message, "%s: ", path_.empty() ? "-" : path_.c_str());
+    va_list ap;
+    va_start(ap, format);
+    kc::vstrprintf(&message, format, ap);
+    va_end(ap);
+    logger_->log(file, line, func, kind, message.c_str());
+  }
+  /**
+   * Trigger a meta database operation.
+   * @param kind the kind of the event.
+   * @param message the supplement message.
+   */
+  void trigger_meta(MetaTrigger::Kind kind, const char* message) {
+    _assert_(message);
+    if (mtrigger_) mtrigger_->trigger(kind, message);
+  }
+private:
+  /**
+   * Reference to a record in the mapped region.
+   */
+  struct RecordRef {
+    const char* kbuf;                    ///< pointer to the key
+    size_t ksiz;                         ///< size of the key
+    const char* vbuf;                    ///< pointer to the value
+    size_t vsiz;                         ///< size of the value
+    int64_t next;                        ///< offset of the next record
+  };
+  /**
+   * Accept a visitor to a record without the bracketing events.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @return true on success, or false on failure.
+   */
+  bool accept_impl(const char* kbuf, size_t ksiz, Visitor* visitor) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+    size_t rsiz;
+    if (bloom_) {
+      uint64_t hash = kc::hashmurmur(kbuf, ksiz);
+      uint64_t step = kc::hashfnv(kbuf, ksiz) | 1;
+      for (int32_t i = 0; i < BLOOMHASHNUM; i++) {
+        uint64_t bidx = (hash + step * i) & bmask_;
+        if (!(((const uint8_t*)bloom_)[bidx>>3] & (1 << (bidx & 7)))) {
+          visitor->visit_empty(kbuf, ksiz, &rsiz);
+          return true;
+        }
+      }
+    }
+    int64_t off = lower_bound(kbuf, ksiz);
+    if (off < 0) return false;
+    RecordRef rec;
+    if (off < dend_) {
+      if (!read_record(off, &rec)) return false;
+      if (compare_keys(rec.kbuf, rec.ksiz, kbuf, ksiz) == 0) {
+        visitor->visit_full(rec.kbuf, rec.ksiz, rec.vbuf, rec.vsiz, &rsiz);
+        return true;
+      }
+    }
+    visitor->visit_empty(kbuf, ksiz, &rsiz);
+    return true;
+  }
+  /**
+   * Read a record in the mapped region.
+   * @param off the offset of the record.
+   * @param rec the reference into which the record is assigned.
+   * @return true on success, or false on failure.
+   */
+  bool read_record(int64_t off, RecordRef* rec) {
+    _assert_(off >= 0 && rec);
+    if (off < HEADSIZ || off >= dend_) {
+      set_error(_KCCODELINE_, Error::BROKEN, "invalid record offset");
+      return false;
+    }
+    const char* rp = map_ + off;
+    size_t rsiz = dend_ - off;
+    uint64_t ksiz;
+    size_t step = kc::readvarnum(rp, rsiz, &ksiz);
+    if (step < 1) {
+      set_error(_KCCODELINE_, Error::BROKEN, "invalid record header");
+      return false;
+    }
+    rp += step;
+    rsiz -= step;
+    uint64_t vsiz;
+    step = kc::readvarnum(rp, rsiz, &vsiz);
+    if (step < 1 || ksiz > rsiz - step || vsiz > rsiz - step - ksiz) {
+      set_error(_KCCODELINE_, Error::BROKEN, "invalid record header");
+      return false;
+    }
+    rp += step;
+    rec->kbuf = rp;
+    rec->ksiz = ksiz;
+    rec->vbuf = rp + ksiz;
+    rec->vsiz = vsiz;
+    rec->next = rp + ksiz + vsiz - map_;
+    return true;
+  }
+  /**
+   * Get the offset of a block.
+   * @param idx the index of the block.
+   * @return the offset of the first record of the block.
+   */
+  int64_t block_offset(int64_t idx) {
+    _assert_(idx >= 0 && idx < inum_);
+    return kc::readfixnum(index_ + idx * INDEXUNIT, INDEXUNIT);
+  }
+  /**
+   * Get the offset of the first record whose key is not less than a key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return the offset of the record, or the end offset of records if no such record exists,
+   * or -1 on failure.
+   */
+  int64_t lower_bound(const char* kbuf, size_t ksiz) {
+    _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+    int64_t lo = 0;
+    int64_t hi = inum_;
+    while (lo < hi) {
+      int64_t mid = (lo + hi) / 2;
+      RecordRef rec;
+      if (!read_record(block_offset(mid), &rec)) return -1;
+      if (compare_keys(rec.kbuf, rec.ksiz, kbuf, ksiz) <= 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < 1) return inum_ > 0 ? block_offset(0) : dend_;
+    int64_t off = block_offset(lo - 1);
+    int64_t end = lo < inum_ ? block_offset(lo) : dend_;
+    while (off < end) {
+      RecordRef rec;
+      if (!read_record(off, &rec)) return -1;
+      if (compare_keys(rec.kbuf, rec.ksiz, kbuf, ksiz) >= 0) break;
+      off = rec.next;
+    }
+    return off;
+  }
+  /**
+   * Get the offset of the previous record.
+   * @param off the offset of a record or the end offset of records.
+   * @return the offset of the previous record, or -1 if no such record exists.
+   */
+  int64_t prev_offset(int64_t off) {
+    _assert_(off >= 0);
+    int64_t lo = 0;
+    int64_t hi = inum_;
+    while (lo < hi) {
+      int64_t mid = (lo + hi) / 2;
+      if (block_offset(mid) < off) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < 1) return -1;
+    int64_t cur = block_offset(lo - 1);
+    int64_t prev = -1;
+    while (cur < off) {
+      RecordRef rec;
+      if (!read_record(cur, &rec)) return -1;
+      prev = cur;
+      cur = rec.next;
+    }
+    return prev;
+  }
+  /**
+   * Map the database file on memory.
+   * @param name the path of the database file.
+   * @return true on success, or false on failure.
+   */
+  bool map_file(const std::string& name);
+  /**
+   * Unmap the database file.
+   * @return true on success, or false on failure.
+   */
+  bool unmap_file();
+  /** Dummy constructor to forbid the use. */
+  SortedTableDB(const SortedTableDB&);
+  /** Dummy Operator to forbid the use. */
+  SortedTableDB& operator =(const SortedTableDB&);
+  /** The method lock. */
+  kc::SpinRWLock mlock_;
+  /** The last happened error. */
+  kc::TSD<Error> error_;
+  /** The internal logger. */
+  Logger* logger_;
+  /** The kinds of logged messages. */
+  uint32_t logkinds_;
+  /** The internal meta operation trigger. */
+  MetaTrigger* mtrigger_;
+  /** The path of the database file. */
+  std::string path_;
+  /** The mapped region of the file. */
+  char* map_;
+  /** The size of the file. */
+  int64_t msiz_;
+  /** The number of records. */
+  int64_t count_;
+  /** The end offset of records. */
+  int64_t dend_;
+  /** The region of the block index. */
+  const char* index_;
+  /** The number of blocks. */
+  int64_t inum_;
+  /** The region of the Bloom filter. */
+  const char* bloom_;
+  /** The mask of bit indices of the Bloom filter. */
+  uint64_t bmask_;
+  /** The copy of the opaque region. */
+  char opaque_[OPAQUESIZ];
+};
+
+
 /**
  * Timed database.
  * @note This class is a concrete class of a wrapper for the polymorphic database to add
@@ -47,8 +3719,18 @@ private:
   class TimedVisitor;
   class TimedMetaTrigger;
   struct MergeLine;
+  class ExpirationIndex;
+  class Expirer;
+  class BloomFilter;
+  class RecordCache;
   /* The magic data of the database type. */
   static const uint8_t MAGICDATA = 0xbb;
+  /* The offset of the number of shards in the opaque region. */
+  static const size_t SHARDNUMOFF = 2;
+  /* The offset of the compression algorithm in the opaque region. */
+  static const size_t ZCOMPOFF = 6;
+  /* The bit set in the marker of the format of record values. */
+  static const uint8_t FMTMARK = 0x80;
   /* The score unit of expiratoin. */
   static const int64_t XTSCUNIT = 256;
   /* The inverse frequency of reading expiration. */
@@ -57,8 +3739,38 @@ private:
   static const int64_t XTITERFREQ = 4;
   /* The unit step number of expiration. */
   static const int64_t XTUNIT = 8;
+  /* The waiting seconds of the background expirer. */
+  static const double XTBGWAIT = 0.1;
+  /* The minimum number of slots of the access time table. */
+  static const size_t XTLRUMINSLOTS = 1 << 16;
+  /* The maximum number of slots of the access time table. */
+  static const size_t XTLRUMAXSLOTS = 1 << 26;
+  /* The number of sampled records for eviction. */
+  static const int32_t XTLRUSAMPLE = 8;
+  /* The number of slots of the expiration index. */
+  static const size_t XTIDXSLOTNUM = 16;
   /* The size of the logging buffer. */
   static const size_t LOGBUFSIZ = 1024;
+  /* The size of the value buffer on the stack. */
+  static const size_t VALBUFSIZ = 1024;
+  /* The leading byte of the compact header of records which never expire. */
+  static const uint8_t XTNONE = 0xff;
+  /* The number of hash functions of the Bloom filter. */
+  static const int32_t BLOOMHASHNUM = 5;
+  /* The number of lock slots of the Bloom filter. */
+  static const size_t BLOOMLOCKNUM = 64;
+  /* The minimum number of additions to rebuild the Bloom filter. */
+  static const int64_t BLOOMREBMIN = 65536;
+  /* The number of slots of the record cache. */
+  static const size_t CACHESLOTNUM = 16;
+  /* The size of the management data of each record in the record cache. */
+  static const int64_t CACHEOVERHEAD = 96;
+  /* The default minimum size of record values to be compressed. */
+  static const int64_t ZMINSIZ = 256;
+  /* The flag byte of record values stored as they are. */
+  static const uint8_t ZPLAIN = 0x00;
+  /* The flag byte of compressed record values. */
+  static const uint8_t ZDEFLATED = 0x01;
 public:
   /**
    * Cursor to indicate a record.
@@ -196,7 +3908,7 @@ public:
         }
         break;
       }
-      if (db_->xcur_) {
+      if (db_->xcur_ && db_->xrate_ < 1) {
         int64_t xtsc = writable ? XTSCUNIT : XTSCUNIT / XTREADFREQ;
         if (!db_->expire_records(xtsc)) err = true;
       }
@@ -636,7 +4348,9 @@ public:
    */
   explicit TimedDB() :
     xlock_(), db_(), mtrigger_(this), utrigger_(NULL), omode_(0),
-    opts_(0), capcnt_(0), capsiz_(0), xcur_(NULL), xsc_(0) {
+    opts_(0), capcnt_(0), capsiz_(0), xcur_(NULL), xidx_(NULL), xrate_(0), xthr_(NULL),
+    xticks_(NULL), xtslots_(0), bloom_(NULL), bmutex_(), cache_(NULL), zcomp_(NULL), zcode_(0),
+    zmin_(0), xsc_(0) {
     _assert_(true);
     db_.tune_meta_trigger(&mtrigger_);
   }
@@ -682,9 +4396,27 @@ public:
   /**
    * Open a database file.
    * @param path the path of a database file.  The same as with kc::PolyDB.  In addition, the
-   * following tuning parameters are supported.  "ktopts" sets options and the value can contain
-   * "p" for the persistent option.  "ktcapcnt" sets the capacity by record number.  "ktcapsiz"
-   * sets the capacity by database size.
+   * following tuning parameters are supported.  "ktopts" sets options and the value can contain "p"
+   * for the persistent option, "c" for the compact header option, "x" for the expiration index
+   * option, "l" for the LRU eviction option, and "z" for the compression option, which cannot be
+   * combined with "p".  "ktzcomp" sets the compression algorithm and the value can be "zlib",
+   * "lzo", or "lzma".  The algorithm is recorded in the database file and opening it with another
+   * one fails.  "ktzmin" sets the minimum size of record values to be compressed.  "ktcapcnt" sets
+   * the capacity by record number.  "ktcapsiz" sets the capacity by database size.  "ktxrate" sets
+   * the number of records checked per second by the background expirer thread.  If it is specified,
+   * database operations do not perform expiration by themselves.  "ktshards" sets the number of
+   * shards.  If it is more than 1, records are distributed by ShardDB into database files whose
+   * names are suffixed with the index of each shard.  The number is recorded in the first shard and
+   * opening it with a different number fails.  "kttier" sets the capacity size of the memory
+   * tier.  If it is specified, copies of recently used records are kept by TieredDB in an on-memory
+   * tier over the database file as the disk tier.  "ktwbuf" sets the capacity size of the
+   * write-behind buffer.  If it is specified, updates are kept by BufferedDB on memory and are
+   * written into the database file in the background.  "ktbloom" sets the number of bits of the
+   * Bloom filter on memory to answer retrievals of missing records without accessing the database.
+   * "ktcache" sets the capacity size of the cache of record values on memory.  If the path has the
+   * extension "ktst", the file is opened as a read-only SortedTableDB made by the
+   * export_sorted_table method.  "ktshards", "kttier", "ktwbuf", and sorted tables cannot be
+   * combined.
    * @param mode the connection mode.  The same as with kc::PolyDB.
    * @return true on success, or false on failure.
    */
@@ -700,7 +4432,17 @@ public:
     kc::strsplit(path, '#', &elems);
     capcnt_ = -1;
     capsiz_ = -1;
+    xrate_ = 0;
     opts_ = 0;
+    bool xidx = false;
+    bool xlru = false;
+    int64_t shards = 0;
+    int64_t tsiz = 0;
+    int64_t wsiz = 0;
+    int64_t bbits = 0;
+    int64_t csiz = 0;
+    std::string zcname;
+    zmin_ = ZMINSIZ;
     std::vector<std::string>::iterator it = elems.begin();
     std::vector<std::string>::iterator itend = elems.end();
     if (it != itend) ++it;
@@ -715,13 +4457,78 @@ public:
         } else if (!std::strcmp(key, "ktcapsiz") || !std::strcmp(key, "ktcapsize") ||
                    !std::strcmp(key, "ktcap_size")) {
           capsiz_ = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktxrate") || !std::strcmp(key, "ktexprate") ||
+                   !std::strcmp(key, "ktexp_rate")) {
+          xrate_ = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktshards") || !std::strcmp(key, "ktshardnum") ||
+                   !std::strcmp(key, "ktshard_num")) {
+          shards = kc::atoix(value);
+        } else if (!std::strcmp(key, "kttier") || !std::strcmp(key, "kttiersiz") ||
+                   !std::strcmp(key, "kttier_size")) {
+          tsiz = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktwbuf") || !std::strcmp(key, "ktwbufsiz") ||
+                   !std::strcmp(key, "ktwbuf_size")) {
+          wsiz = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktbloom") || !std::strcmp(key, "ktbloombits") ||
+                   !std::strcmp(key, "ktbloom_bits")) {
+          bbits = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktcache") || !std::strcmp(key, "ktcachesiz") ||
+                   !std::strcmp(key, "ktcache_size")) {
+          csiz = kc::atoix(value);
+        } else if (!std::strcmp(key, "ktzcomp") || !std::strcmp(key, "ktcompressor") ||
+                   !std::strcmp(key, "ktcomp")) {
+          zcname = value;
+        } else if (!std::strcmp(key, "ktzmin") || !std::strcmp(key, "ktzminsiz") ||
+                   !std::strcmp(key, "ktzmin_size")) {
+          zmin_ = kc::atoix(value);
         } else if (!std::strcmp(key, "ktopts") || !std::strcmp(key, "ktoptions")) {
           if (std::strchr(value, 'p')) opts_ |= TPERSIST;
+          if (std::strchr(value, 'c')) opts_ |= TCOMPACT;
+          if (std::strchr(value, 'x')) xidx = true;
+          if (std::strchr(value, 'l')) xlru = true;
+          if (std::strchr(value, 'z')) opts_ |= TCOMPRESS;
         }
       }
       ++it;
     }
+    if ((opts_ & TPERSIST) && (opts_ & TCOMPRESS)) {
+      set_error(kc::BasicDB::Error::INVALID,
+                "the persistent option and the compression option are exclusive");
+      return false;
+    }
+    uint8_t zcode = ZCDEFAULT;
+    if (!zcname.empty()) {
+      if (!kc::stricmp(zcname.c_str(), "lzo") || !kc::stricmp(zcname.c_str(), "oz")) {
+        zcode = ZCLZO;
+      } else if (!kc::stricmp(zcname.c_str(), "lzma") || !kc::stricmp(zcname.c_str(), "xz")) {
+        zcode = ZCLZMA;
+      } else {
+        zcode = ZCZLIB;
+      }
+    }
+    bool sorted = !elems.empty() && kc::strbwm(elems.front().c_str(), SortedTableDB::EXTNAME);
+    if ((shards > 1) + (tsiz > 0) + (wsiz > 0) + sorted > 1) {
+      set_error(kc::BasicDB::Error::INVALID,
+                "ktshards, kttier, ktwbuf, and sorted tables are exclusive");
+      return false;
+    }
+    if (shards > 1) {
+      ShardDB* sdb = new ShardDB(shards);
+      if (!db_.set_internal_db(sdb)) delete sdb;
+    } else if (tsiz > 0) {
+      TieredDB* tdb = new TieredDB(tsiz);
+      if (!db_.set_internal_db(tdb)) delete tdb;
+    } else if (wsiz > 0) {
+      BufferedDB* bdb = new BufferedDB(wsiz);
+      if (!db_.set_internal_db(bdb)) delete bdb;
+    } else if (sorted) {
+      SortedTableDB* tdb = new SortedTableDB;
+      if (!db_.set_internal_db(tdb)) delete tdb;
+      mode = kc::BasicDB::OREADER;
+    }
     if (!db_.open(path, mode)) return false;
+    bool writable = (mode & kc::BasicDB::OWRITER) != 0;
+    bool err = false;
     kc::BasicDB* idb = db_.reveal_inner_db();
     if (idb) {
       const std::type_info& info = typeid(*idb);
@@ -730,10 +4537,9 @@ public:
         char* opq = hdb->opaque();
         if (opq) {
           if (*(uint8_t*)opq == MAGICDATA) {
-            opts_ = *(uint8_t*)(opq + 1);
-          } else if ((mode & kc::BasicDB::OWRITER) && hdb->count() < 1) {
-            *(uint8_t*)opq = MAGICDATA;
-            *(uint8_t*)(opq + 1) = opts_;
+            if (!read_opaque(opq, 0, &zcode)) err = true;
+          } else if (writable && hdb->count() < 1) {
+            write_opaque(opq, 0, zcode);
             hdb->synchronize_opaque();
           }
         }
@@ -742,10 +4548,9 @@ public:
         char* opq = tdb->opaque();
         if (opq) {
           if (*(uint8_t*)opq == MAGICDATA) {
-            opts_ = *(uint8_t*)(opq + 1);
-          } else if ((mode & kc::BasicDB::OWRITER) && tdb->count() < 1) {
-            *(uint8_t*)opq = MAGICDATA;
-            *(uint8_t*)(opq + 1) = opts_;
+            if (!read_opaque(opq, 0, &zcode)) err = true;
+          } else if (writable && tdb->count() < 1) {
+            write_opaque(opq, 0, zcode);
             tdb->synchronize_opaque();
           }
         }
@@ -754,10 +4559,9 @@ public:
         char* opq = ddb->opaque();
         if (opq) {
           if (*(uint8_t*)opq == MAGICDATA) {
-            opts_ = *(uint8_t*)(opq + 1);
-          } else if ((mode & kc::BasicDB::OWRITER) && ddb->count() < 1) {
-            *(uint8_t*)opq = MAGICDATA;
-            *(uint8_t*)(opq + 1) = opts_;
+            if (!read_opaque(opq, 0, &zcode)) err = true;
+          } else if (writable && ddb->count() < 1) {
+            write_opaque(opq, 0, zcode);
             ddb->synchronize_opaque();
           }
         }
@@ -766,19 +4570,101 @@ public:
         char* opq = fdb->opaque();
         if (opq) {
           if (*(uint8_t*)opq == MAGICDATA) {
-            opts_ = *(uint8_t*)(opq + 1);
-          } else if ((mode & kc::BasicDB::OWRITER) && fdb->count() < 1) {
-            *(uint8_t*)opq = MAGICDATA;
-            *(uint8_t*)(opq + 1) = opts_;
+            if (!read_opaque(opq, 0, &zcode)) err = true;
+          } else if (writable && fdb->count() < 1) {
+            write_opaque(opq, 0, zcode);
             fdb->synchronize_opaque();
           }
         }
+      } else if (info == typeid(ShardDB) || info == typeid(TieredDB)) {
+        ShardDB* sdb = (ShardDB*)idb;
+        char* opq = sdb->opaque();
+        if (opq) {
+          uint32_t snum = info == typeid(ShardDB) ? sdb->shard_num() : 0;
+          if (*(uint8_t*)opq == MAGICDATA) {
+            if (!read_opaque(opq, snum, &zcode)) err = true;
+          } else if (writable && sdb->count() < 1) {
+            write_opaque(opq, snum, zcode);
+            sdb->synchronize_opaque();
+          }
+        }
+      } else if (info == typeid(BufferedDB)) {
+        BufferedDB* bdb = (BufferedDB*)idb;
+        char* opq = bdb->opaque();
+        if (opq) {
+          if (*(uint8_t*)opq == MAGICDATA) {
+            if (!read_opaque(opq, 0, &zcode)) err = true;
+          } else if (writable && bdb->count() < 1) {
+            write_opaque(opq, 0, zcode);
+            bdb->synchronize_opaque();
+          }
+        }
+      } else if (info == typeid(SortedTableDB)) {
+        char* opq = ((SortedTableDB*)idb)->opaque();
+        if (*(uint8_t*)opq == MAGICDATA && !read_opaque(opq, 0, &zcode)) err = true;
       }
     }
+    if (err) {
+      db_.close();
+      return false;
+    }
     omode_ = mode;
+    zcode_ = zcode;
+    if (opts_ & TCOMPRESS) {
+      switch (zcode) {
+        case ZCLZO: {
+          zcomp_ = new kc::LZOCompressor<kc::LZO::RAW>;
+          break;
+        }
+        case ZCLZMA: {
+          zcomp_ = new kc::LZMACompressor<kc::LZMA::RAW>;
+          break;
+        }
+        default: {
+          zcomp_ = new kc::ZLIBCompressor<kc::ZLIB::RAW>;
+          break;
+        }
+      }
+    }
+    if (csiz > 0) cache_ = new RecordCache(csiz);
+    if (bbits > 0) {
+      bloom_ = new BloomFilter(bbits);
+      if (!build_bloom_filter()) {
+        delete bloom_;
+        bloom_ = NULL;
+        delete cache_;
+        cache_ = NULL;
+        delete zcomp_;
+        zcomp_ = NULL;
+        db_.close();
+        omode_ = 0;
+        return false;
+      }
+    }
     if ((omode_ & kc::BasicDB::OWRITER) && !(opts_ & TPERSIST)) {
       xcur_ = db_.cursor();
       if (db_.count() > 0) xcur_->jump();
+      if (xidx) {
+        xidx_ = new ExpirationIndex;
+        if (!build_expiration_index()) {
+          delete xidx_;
+          xidx_ = NULL;
+          delete xcur_;
+          xcur_ = NULL;
+          db_.close();
+          omode_ = 0;
+          return false;
+        }
+      }
+      if (xlru) {
+        xtslots_ = calc_lru_slots();
+        xticks_ = new uint32_t[xtslots_];
+        std::memset(xticks_, 0, sizeof(*xticks_) * xtslots_);
+      }
+    }
+    if ((omode_ & kc::BasicDB::OWRITER) && (xrate_ > 0 || xidx_ || bloom_)) {
+      xthr_ = new Expirer(this);
+      xthr_->start();
     }
     xsc_ = 0;
     return true;
@@ -793,11 +4679,28 @@ public:
       set_error(kc::BasicDB::Error::INVALID, "not opened");
       return false;
     }
+    if (xthr_) {
+      xthr_->stop();
+      xthr_->join();
+      delete xthr_;
+      xthr_ = NULL;
+    }
     kc::ScopedSpinLock lock(&xlock_);
     bool err = false;
+    delete cache_;
+    cache_ = NULL;
+    delete bloom_;
+    bloom_ = NULL;
+    delete[] xticks_;
+    xticks_ = NULL;
+    xtslots_ = 0;
+    delete xidx_;
+    xidx_ = NULL;
     delete xcur_;
     xcur_ = NULL;
     if (!db_.close()) err = true;
+    delete zcomp_;
+    zcomp_ = NULL;
     omode_ = 0;
     return !err;
   }
@@ -815,9 +4718,19 @@ public:
     _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
     bool err = false;
     int64_t ct = std::time(NULL);
-    TimedVisitor myvisitor(this, visitor, ct, false);
-    if (!db_.accept(kbuf, ksiz, &myvisitor, writable)) err = true;
-    if (xcur_) {
+    if (!writable && bloom_ && !bloom_->check(kbuf, ksiz)) {
+      visitor->visit_before();
+      size_t rsiz;
+      int64_t xt = -1;
+      visitor->visit_empty(kbuf, ksiz, &rsiz, &xt);
+      visitor->visit_after();
+    } else if (!writable && cache_ && cache_->visit(kbuf, ksiz, visitor, ct)) {
+      if (xticks_) touch_record(kbuf, ksiz);
+    } else {
+      TimedVisitor myvisitor(this, visitor, ct, false);
+      if (!db_.accept(kbuf, ksiz, &myvisitor, writable)) err = true;
+    }
+    if (xcur_ && xrate_ < 1) {
       int64_t xtsc = writable ? XTSCUNIT : XTSCUNIT / XTREADFREQ;
       if (!expire_records(xtsc)) err = true;
     }
@@ -840,7 +4753,7 @@ public:
     int64_t ct = std::time(NULL);
     TimedVisitor myvisitor(this, visitor, ct, false);
     if (!db_.accept_bulk(keys, &myvisitor, writable)) err = true;
-    if (xcur_) {
+    if (xcur_ && xrate_ < 1) {
       int64_t xtsc = writable ? XTSCUNIT : XTSCUNIT / XTREADFREQ;
       if (!expire_records(xtsc)) err = true;
     }
@@ -861,7 +4774,7 @@ public:
     int64_t ct = std::time(NULL);
     TimedVisitor myvisitor(this, visitor, ct, true);
     if (!db_.iterate(&myvisitor, writable, checker)) err = true;
-    if (xcur_) {
+    if (xcur_ && xrate_ < 1) {
       int64_t count = db_.count();
       int64_t xtsc = writable ? XTSCUNIT : XTSCUNIT / XTREADFREQ;
       if (count > 0) xtsc *= count / XTITERFREQ;
@@ -943,7 +4856,11 @@ public:
    */
   bool clear() {
     _assert_(true);
-    return db_.clear();
+    if (!db_.clear()) return false;
+    if (cache_) cache_->clear();
+    if (xidx_) xidx_->clear();
+    if (bloom_ && !build_bloom_filter()) return false;
+    return true;
   }
   /**
    * Get the number of records.
@@ -969,6 +4886,25 @@ public:
     _assert_(true);
     return db_.path();
   }
+  /**
+   * Get the marker of the format of record values.
+   * @return the marker of the format, which differs between databases whose stored records
+   * are not interchangeable.
+   * @note The marker is recorded in snapshot files and checked in the replication handshake.
+   */
+  uint8_t format_marker() {
+    _assert_(true);
+    return FMTMARK | (opts_ & (TPERSIST | TCOMPACT | TCOMPRESS));
+  }
+  /**
+   * Check whether the format of record values is incompatible with the legacy format.
+   * @return true if record values have the compact header or the compression flag, or false if
+   * records of the legacy format without the marker can be accepted.
+   */
+  bool strict_format() {
+    _assert_(true);
+    return (opts_ & (TCOMPACT | TCOMPRESS)) != 0;
+  }
   /**
    * Get the miscellaneous status information.
    * @param strmap a string map to contain the result.
@@ -980,6 +4916,10 @@ public:
     (*strmap)["ktopts"] = kc::strprintf("%u", opts_);
     (*strmap)["ktcapcnt"] = kc::strprintf("%lld", (long long)capcnt_);
     (*strmap)["ktcapsiz"] = kc::strprintf("%lld", (long long)capsiz_);
+    (*strmap)["ktxrate"] = kc::strprintf("%lld", (long long)xrate_);
+    if (xidx_) (*strmap)["ktxidx"] = kc::strprintf("%lld", (long long)xidx_->count());
+    if (bloom_) (*strmap)["ktbloomadds"] = kc::strprintf("%lld", (long long)bloom_->adds());
+    if (cache_) (*strmap)["ktcache"] = kc::strprintf("%lld", (long long)cache_->count());
     return true;
   }
   /**
@@ -1150,13 +5090,13 @@ public:
       explicit VisitorImpl(const char* vbuf, size_t vsiz, int64_t xt) :
         vbuf_(vbuf), vsiz_(vsiz), xt_(xt), nbuf_(NULL) {}
       ~VisitorImpl() {
-        if (nbuf_) delete[] nbuf_;
+        if (nbuf_ && nbuf_ != stack_) delete[] nbuf_;
       }
     private:
       const char* visit_full(const char* kbuf, size_t ksiz,
                              const char* vbuf, size_t vsiz, size_t* sp, int64_t* xtp) {
         size_t nsiz = vsiz + vsiz_;
-        nbuf_ = new char[nsiz];
+        nbuf_ = nsiz > sizeof(stack_) ? new char[nsiz] : stack_;
         std::memcpy(nbuf_, vbuf, vsiz);
         std::memcpy(nbuf_ + vsiz, vbuf_, vsiz_);
         *sp = nsiz;
@@ -1172,6 +5112,7 @@ public:
       size_t vsiz_;
       int64_t xt_;
       char* nbuf_;
+      char stack_[VALBUFSIZ];
     };
     VisitorImpl visitor(vbuf, vsiz, xt);
     if (!accept(kbuf, ksiz, &visitor, true)) return false;
@@ -1758,7 +5699,12 @@ public:
    */
   bool load_snapshot(std::istream* src, kc::BasicDB::ProgressChecker* checker = NULL) {
     _assert_(src);
-    return db_.load_snapshot(src, checker);
+    if (xidx_) xidx_->invalidate();
+    bool err = false;
+    if (!db_.load_snapshot(src, checker)) err = true;
+    if (cache_) cache_->clear();
+    if (bloom_ && !build_bloom_filter()) err = true;
+    return !err;
   }
   /**
    * Load records from a file.
@@ -1768,26 +5714,62 @@ public:
    */
   bool load_snapshot(const std::string& src, kc::BasicDB::ProgressChecker* checker = NULL) {
     _assert_(true);
-    return db_.load_snapshot(src, checker);
+    if (xidx_) xidx_->invalidate();
+    bool err = false;
+    if (!db_.load_snapshot(src, checker)) err = true;
+    if (cache_) cache_->clear();
+    if (bloom_ && !build_bloom_filter()) err = true;
+    return !err;
   }
   /**
    * Dump records atomically into a file.
    * @param dest the path of the destination file.
    * @param zcomp the data compressor object.  If it is NULL, no compression is performed.
    * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @param thnum the number of worker threads.  If it is more than 1, the file is written in
+   * the chunked format whose chunks are compressed in parallel and can be loaded in parallel.
    * @return true on success, or false on failure.
+   * @note On-memory databases are dumped by a child process forked while updates are blocked
+   * for a moment, so that the time stamp of the update log recorded in the file matches the
+   * records and updates by other threads are not blocked during the dump.
    */
   bool dump_snapshot_atomic(const std::string& dest, kc::Compressor* zcomp = NULL,
-                            kc::BasicDB::ProgressChecker* checker = NULL);
+                            kc::BasicDB::ProgressChecker* checker = NULL, size_t thnum = 1);
   /**
    * Load records atomically from a file.
    * @param src the path of the source file.
    * @param zcomp the data compressor object.  If it is NULL, no decompression is performed.
    * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @param thnum the number of worker threads to load a file in the chunked format.  Files in
+   * the original format are loaded by the calling thread.
+   * @return true on success, or false on failure.
+   */
+  bool load_snapshot_atomic(const std::string& src, kc::Compressor* zcomp = NULL,
+                            kc::BasicDB::ProgressChecker* checker = NULL, size_t thnum = 1) {
+    _assert_(true);
+    if (xidx_) xidx_->invalidate();
+    bool err = false;
+    if (!load_snapshot_atomic_impl(src, zcomp, checker, thnum)) err = true;
+    if (cache_) cache_->clear();
+    if (bloom_ && !build_bloom_filter()) err = true;
+    return !err;
+  }
+  /**
+   * Write all live records into a sorted table file.
+   * @param dest the path of the destination file.
+   * @param bnum the number of bits of the Bloom filter of the file.  If it is not more than 0,
+   * the filter is not made.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
    * @return true on success, or false on failure.
+   * @note Expired records are skipped and the other records are written with their meta data,
+   * so that the file can be served by a timed database whose path has the extension "ktst".
+   * Records of databases not ordered by the lexical order of keys are sorted through a
+   * temporary B+ tree database file beside the destination.  The file is written under a
+   * temporary name and renamed to the destination at the end, so that a server mapping the
+   * old file keeps reading it safely.
    */
-  bool load_snapshot_atomic(const std::string& src, kc::Compressor* zcomp = NULL,
-                            kc::BasicDB::ProgressChecker* checker = NULL);
+  bool export_sorted_table(const std::string& dest, int64_t bnum = 0,
+                           kc::BasicDB::ProgressChecker* checker = NULL);
   /**
    * Reveal the inner database object.
    * @return the inner database object, or NULL on failure.
@@ -1815,6 +5797,7 @@ public:
         xsc_ = 0;
       }
     }
+    if (!maintain_indexes()) err = true;
     if (!defrag(step)) err = true;
     return !err;
   }
@@ -1855,6 +5838,10 @@ public:
           return false;
         }
         if (!db_.set(kbuf, ksiz, vbuf, vsiz)) err = true;
+        int64_t xt;
+        if (xidx_ && read_record_header(opts_, vbuf, vsiz, &xt) > 0) xidx_->set(kbuf, ksiz, xt);
+        if (cache_) cache_->remove(kbuf, ksiz);
+        if (bloom_) bloom_->add(kbuf, ksiz);
         if (utrigger_) log_update(utrigger_, kbuf, ksiz, vbuf, vsiz);
         break;
       }
@@ -1873,6 +5860,8 @@ public:
           return false;
         }
         if (!db_.remove(kbuf, ksiz) && db_.error() != kc::BasicDB::Error::NOREC) err = true;
+        if (cache_) cache_->remove(kbuf, ksiz);
+        if (xidx_) xidx_->remove(kbuf, ksiz);
         if (utrigger_) log_update(utrigger_, kbuf, ksiz, TimedVisitor::REMOVE, 0);
         break;
       }
@@ -1882,6 +5871,9 @@ public:
           return false;
         }
         if (!db_.clear()) err = true;
+        if (cache_) cache_->clear();
+        if (xidx_) xidx_->clear();
+        if (bloom_ && !build_bloom_filter()) err = true;
         break;
       }
       default: {
@@ -2091,6 +6083,40 @@ public:
     }
     return true;
   }
+  /**
+   * Get the key of the record modified by an update log message.
+   * @param mbuf the pointer to the message region.
+   * @param msiz the size of the message region.
+   * @param sp the pointer to the variable into which the size of the region of the return
+   * value is assigned.
+   * @return the pointer to the region of the key, or NULL if the message does not modify a
+   * single record.
+   */
+  static const char* update_log_key(const char* mbuf, size_t msiz, size_t* sp) {
+    _assert_(mbuf && msiz <= kc::MEMMAXSIZ && sp);
+    if (msiz < 1) return NULL;
+    const char* rp = mbuf;
+    uint8_t op = *(uint8_t*)(rp++);
+    msiz--;
+    if (op != USET && op != UREMOVE) return NULL;
+    if (msiz < 1) return NULL;
+    uint64_t ksiz;
+    size_t step = kc::readvarnum(rp, msiz, &ksiz);
+    if (step < 1) return NULL;
+    rp += step;
+    msiz -= step;
+    if (op == USET) {
+      if (msiz < 1) return NULL;
+      uint64_t vsiz;
+      step = kc::readvarnum(rp, msiz, &vsiz);
+      if (step < 1) return NULL;
+      rp += step;
+      msiz -= step;
+    }
+    if (msiz < ksiz) return NULL;
+    *sp = ksiz;
+    return rp;
+  }
   /**
    * Get status of an atomic snapshot file.
    * @param src the path of the source file.
@@ -2109,7 +6135,18 @@ private:
    * Tuning Options.
    */
   enum Option {
-    TPERSIST = 1 << 1                    ///< disable expiration
+    TPERSIST = 1 << 1,                   ///< disable expiration
+    TCOMPACT = 1 << 2,                   ///< compact expiration header
+    TCOMPRESS = 1 << 3                   ///< compress record values
+  };
+  /**
+   * Compression Algorithms.
+   */
+  enum Compression {
+    ZCDEFAULT = 0,                       ///< not specified
+    ZCZLIB,                              ///< ZLIB raw format
+    ZCLZO,                               ///< LZO raw format
+    ZCLZMA                               ///< LZMA raw format
   };
   /**
    * Update Operations.
@@ -2134,12 +6171,14 @@ private:
   class TimedVisitor : public kc::BasicDB::Visitor {
   public:
     TimedVisitor(TimedDB* db, TimedDB::Visitor* visitor, int64_t ct, bool isiter) :
-      db_(db), visitor_(visitor), ct_(ct), isiter_(isiter), jbuf_(NULL), again_(false) {
+      db_(db), visitor_(visitor), ct_(ct), isiter_(isiter), jbuf_(NULL), zbuf_(NULL),
+      again_(false) {
       _assert_(db && visitor && ct >= 0);
     }
     ~TimedVisitor() {
       _assert_(true);
-      delete[] jbuf_;
+      if (jbuf_ != stack_) delete[] jbuf_;
+      delete[] zbuf_;
     }
     bool again() {
       _assert_(true);
@@ -2154,11 +6193,20 @@ private:
         int64_t xt = kc::INT64MAX;
         const char* rbuf = visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, &rsiz, &xt);
         *sp = rsiz;
+        if (db_->cache_) {
+          if (rbuf != TimedDB::Visitor::NOP) {
+            db_->cache_->remove(kbuf, ksiz);
+          } else if (!isiter_) {
+            db_->cache_->set(kbuf, ksiz, vbuf, vsiz, XTMAX);
+          }
+        }
         if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, rbuf, rsiz);
         return rbuf;
       }
-      if (vsiz < (size_t)XTWIDTH) return NOP;
-      int64_t xt = kc::readfixnum(vbuf, XTWIDTH);
+      int64_t xt;
+      size_t hsiz = read_record_header(db_->opts_, vbuf, vsiz, &xt);
+      if (hsiz < 1) return NOP;
+      if (db_->xticks_ && !isiter_) db_->touch_record(kbuf, ksiz);
       if (ct_ > xt) {
         if (isiter_) {
           again_ = true;
@@ -2169,31 +6217,53 @@ private:
         const char* rbuf = visitor_->visit_empty(kbuf, ksiz, &rsiz, &xt);
         if (rbuf == TimedDB::Visitor::NOP) return NOP;
         if (rbuf == TimedDB::Visitor::REMOVE) {
+          if (db_->cache_) db_->cache_->remove(kbuf, ksiz);
+          if (db_->xidx_) db_->xidx_->remove(kbuf, ksiz);
           if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, REMOVE, 0);
           return REMOVE;
         }
-        delete[] jbuf_;
+        if (jbuf_ != stack_) delete[] jbuf_;
         xt = modify_exptime(xt, ct_);
         size_t jsiz;
-        jbuf_ = make_record_value(rbuf, rsiz, xt, &jsiz);
+        jbuf_ = db_->make_record_value(rbuf, rsiz, xt, stack_, sizeof(stack_), &jsiz);
         *sp = jsiz;
+        if (db_->cache_) db_->cache_->remove(kbuf, ksiz);
+        if (db_->xidx_) db_->xidx_->set(kbuf, ksiz, xt);
         if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, jbuf_, jsiz);
         return jbuf_;
       }
-      vbuf += XTWIDTH;
-      vsiz -= XTWIDTH;
+      vbuf += hsiz;
+      vsiz -= hsiz;
+      if ((db_->opts_ & TimedDB::TCOMPRESS) && *(uint8_t*)(vbuf - 1) == ZDEFLATED) {
+        delete[] zbuf_;
+        size_t zsiz;
+        zbuf_ = db_->zcomp_->decompress(vbuf, vsiz, &zsiz);
+        if (!zbuf_) {
+          db_->set_error(kc::BasicDB::Error::BROKEN, "data decompression failed");
+          return NOP;
+        }
+        vbuf = zbuf_;
+        vsiz = zsiz;
+      }
+      int64_t oxt = xt;
       size_t rsiz;
       const char* rbuf = visitor_->visit_full(kbuf, ksiz, vbuf, vsiz, &rsiz, &xt);
-      if (rbuf == TimedDB::Visitor::NOP) return NOP;
+      if (rbuf == TimedDB::Visitor::NOP) {
+        if (db_->cache_ && !isiter_) db_->cache_->set(kbuf, ksiz, vbuf, vsiz, oxt);
+        return NOP;
+      }
+      if (db_->cache_) db_->cache_->remove(kbuf, ksiz);
       if (rbuf == TimedDB::Visitor::REMOVE) {
+        if (db_->xidx_) db_->xidx_->remove(kbuf, ksiz);
         if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, REMOVE, 0);
         return REMOVE;
       }
-      delete[] jbuf_;
+      if (jbuf_ != stack_) delete[] jbuf_;
       xt = modify_exptime(xt, ct_);
       size_t jsiz;
-      jbuf_ = make_record_value(rbuf, rsiz, xt, &jsiz);
+      jbuf_ = db_->make_record_value(rbuf, rsiz, xt, stack_, sizeof(stack_), &jsiz);
       *sp = jsiz;
+      if (db_->xidx_) db_->xidx_->set(kbuf, ksiz, xt);
       if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, jbuf_, jsiz);
       return jbuf_;
     }
@@ -2203,22 +6273,30 @@ private:
         int64_t xt = kc::INT64MAX;
         const char* rbuf = visitor_->visit_empty(kbuf, ksiz, &rsiz, &xt);
         *sp = rsiz;
+        if (db_->cache_ && rbuf != TimedDB::Visitor::NOP) db_->cache_->remove(kbuf, ksiz);
+        if (db_->bloom_ && rbuf != TimedDB::Visitor::NOP && rbuf != TimedDB::Visitor::REMOVE)
+          db_->bloom_->add(kbuf, ksiz);
         if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, rbuf, rsiz);
         return rbuf;
       }
+      if (db_->xticks_ && !isiter_) db_->touch_record(kbuf, ksiz);
       size_t rsiz;
       int64_t xt = -1;
       const char* rbuf = visitor_->visit_empty(kbuf, ksiz, &rsiz, &xt);
       if (rbuf == TimedDB::Visitor::NOP) return NOP;
+      if (db_->cache_) db_->cache_->remove(kbuf, ksiz);
       if (rbuf == TimedDB::Visitor::REMOVE) {
+        if (db_->xidx_) db_->xidx_->remove(kbuf, ksiz);
         if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, REMOVE, 0);
         return REMOVE;
       }
-      delete[] jbuf_;
+      if (jbuf_ != stack_) delete[] jbuf_;
       xt = modify_exptime(xt, ct_);
       size_t jsiz;
-      jbuf_ = make_record_value(rbuf, rsiz, xt, &jsiz);
+      jbuf_ = db_->make_record_value(rbuf, rsiz, xt, stack_, sizeof(stack_), &jsiz);
       *sp = jsiz;
+      if (db_->xidx_) db_->xidx_->set(kbuf, ksiz, xt);
+      if (db_->bloom_) db_->bloom_->add(kbuf, ksiz);
       if (db_->utrigger_) log_update(db_->utrigger_, kbuf, ksiz, jbuf_, jsiz);
       return jbuf_;
     }
@@ -2235,7 +6313,9 @@ private:
     int64_t ct_;
     bool isiter_;
     char* jbuf_;
+    char* zbuf_;
     bool again_;
+    char stack_[VALBUFSIZ];
   };
   /**
    * Trigger of meta database operations.
@@ -2248,6 +6328,10 @@ private:
   private:
     void trigger(Kind kind, const char* message) {
       _assert_(message);
+      if (kind == ABORTTRAN) {
+        if (db_->cache_) db_->cache_->clear();
+        if (db_->xidx_) db_->xidx_->invalidate();
+      }
       if (!db_->utrigger_) return;
       switch (kind) {
         case CLEAR: {
@@ -2291,6 +6375,443 @@ private:
       return comp->compare(kbuf, ksiz, right.kbuf, right.ksiz) > 0;
     }
   };
+  /**
+   * Index of records ordered by expiration time.
+   * @note Records which never expire are not indexed.  Entries may be stale after the record is
+   * removed by the capacity limitation, so the popped keys must be checked against the database.
+   * Each key is stored only in the map, and the ordered set refers to the entries of the map.
+   * Keys are distributed into independent slots by the hash value so that updates of different
+   * records are not serialized, and popping visits the slots in turn.
+   */
+  class ExpirationIndex {
+  private:
+    typedef std::map<std::string, int64_t> XTMap;
+    typedef std::pair<int64_t, XTMap::iterator> XTEntry;
+    struct XTOrder {
+      bool operator ()(const XTEntry& a, const XTEntry& b) const {
+        if (a.first != b.first) return a.first < b.first;
+        return a.second->first < b.second->first;
+      }
+    };
+    typedef std::set<XTEntry, XTOrder> XTSet;
+    struct Slot {
+      kc::SpinLock lock;
+      XTMap xts;
+      XTSet ords;
+    };
+  public:
+    ExpirationIndex() : slots_(), dirty_(1), pidx_(0) {
+      _assert_(true);
+    }
+    void set(const char* kbuf, size_t ksiz, int64_t xt) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      std::string key(kbuf, ksiz);
+      Slot* slot = get_slot(kbuf, ksiz);
+      kc::ScopedSpinLock lock(&slot->lock);
+      XTMap::iterator it = slot->xts.find(key);
+      if (it != slot->xts.end()) {
+        if (it->second == xt) return;
+        slot->ords.erase(XTEntry(it->second, it));
+        if (xt >= XTMAX) {
+          slot->xts.erase(it);
+          return;
+        }
+        it->second = xt;
+      } else {
+        if (xt >= XTMAX) return;
+        it = slot->xts.insert(std::make_pair(key, xt)).first;
+      }
+      slot->ords.insert(XTEntry(xt, it));
+    }
+    void remove(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      std::string key(kbuf, ksiz);
+      Slot* slot = get_slot(kbuf, ksiz);
+      kc::ScopedSpinLock lock(&slot->lock);
+      XTMap::iterator it = slot->xts.find(key);
+      if (it == slot->xts.end()) return;
+      slot->ords.erase(XTEntry(it->second, it));
+      slot->xts.erase(it);
+    }
+    void clear() {
+      _assert_(true);
+      for (size_t i = 0; i < XTIDXSLOTNUM; i++) {
+        Slot* slot = slots_ + i;
+        kc::ScopedSpinLock lock(&slot->lock);
+        slot->xts.clear();
+        slot->ords.clear();
+      }
+      dirty_.set(0);
+    }
+    void invalidate() {
+      _assert_(true);
+      dirty_.set(1);
+    }
+    bool dirty() {
+      _assert_(true);
+      return dirty_.get() != 0;
+    }
+    int64_t pop(int64_t ct, int64_t max, std::vector<std::string>* keys) {
+      _assert_(max >= 0 && keys);
+      int64_t num = 0;
+      size_t pidx = pidx_.add(1);
+      for (size_t i = 0; i < XTIDXSLOTNUM && num < max; i++) {
+        Slot* slot = slots_ + (pidx + i) % XTIDXSLOTNUM;
+        kc::ScopedSpinLock lock(&slot->lock);
+        while (num < max && !slot->ords.empty()) {
+          XTSet::iterator it = slot->ords.begin();
+          if (it->first >= ct) break;
+          XTMap::iterator mit = it->second;
+          keys->push_back(mit->first);
+          slot->ords.erase(it);
+          slot->xts.erase(mit);
+          num++;
+        }
+      }
+      return num;
+    }
+    int64_t count() {
+      _assert_(true);
+      int64_t sum = 0;
+      for (size_t i = 0; i < XTIDXSLOTNUM; i++) {
+        Slot* slot = slots_ + i;
+        kc::ScopedSpinLock lock(&slot->lock);
+        sum += slot->xts.size();
+      }
+      return sum;
+    }
+  private:
+    Slot* get_slot(const char* kbuf, size_t ksiz) {
+      return slots_ + kc::hashmurmur(kbuf, ksiz) % XTIDXSLOTNUM;
+    }
+    Slot slots_[XTIDXSLOTNUM];
+    kc::AtomicInt64 dirty_;
+    kc::AtomicInt64 pidx_;
+  };
+  /**
+   * Background thread to remove expired records.
+   */
+  class Expirer : public kc::Thread {
+  public:
+    explicit Expirer(TimedDB* db) : db_(db), mutex_(), cond_(), alive_(true) {
+      _assert_(db);
+    }
+    void run() {
+      _assert_(true);
+      double score = 0;
+      while (true) {
+        mutex_.lock();
+        if (alive_) cond_.wait(&mutex_, XTBGWAIT);
+        bool alive = alive_;
+        mutex_.unlock();
+        if (!alive) break;
+        db_->maintain_indexes();
+        if (!db_->xcur_) continue;
+        score += db_->xrate_ * XTBGWAIT * XTSCUNIT;
+        if (score < XTSCUNIT) continue;
+        if (score > kc::INT64MAX / 2) score = kc::INT64MAX / 2;
+        int64_t xtsc = (int64_t)score;
+        score -= xtsc;
+        db_->expire_records(xtsc);
+      }
+    }
+    void stop() {
+      _assert_(true);
+      mutex_.lock();
+      alive_ = false;
+      cond_.signal();
+      mutex_.unlock();
+    }
+  private:
+    TimedDB* db_;
+    kc::Mutex mutex_;
+    kc::CondVar cond_;
+    bool alive_;
+  };
+  /**
+   * Bloom filter of existing keys.
+   * @note Removed keys are not cleared so that the filter is rebuilt when it gets stale.  While
+   * the filter is being rebuilt, every key is regarded as possibly existing.
+   */
+  class BloomFilter {
+  public:
+    explicit BloomFilter(int64_t bnum) :
+      bits_(NULL), mask_(0), locks_(BLOOMLOCKNUM), gen_(0), adds_(0) {
+      _assert_(bnum > 0);
+      uint64_t num = 64;
+      while (num < (uint64_t)bnum && num < (1ULL << 40)) {
+        num <<= 1;
+      }
+      mask_ = num - 1;
+      bits_ = new uint64_t[num / 64];
+      std::memset(bits_, 0, num / 8);
+    }
+    ~BloomFilter() {
+      _assert_(true);
+      delete[] bits_;
+    }
+    void add(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      uint64_t hash = kc::hashmurmur(kbuf, ksiz);
+      uint64_t step = kc::hashfnv(kbuf, ksiz) | 1;
+      for (int32_t i = 0; i < BLOOMHASHNUM; i++) {
+        uint64_t bidx = (hash + step * i) & mask_;
+        size_t widx = bidx >> 6;
+        size_t lidx = widx % BLOOMLOCKNUM;
+        locks_.lock(lidx);
+        bits_[widx] |= 1ULL << (bidx & 63);
+        locks_.unlock(lidx);
+      }
+      adds_ += 1;
+    }
+    bool check(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      int64_t gen = gen_.get();
+      if (gen & 1) return true;
+      uint64_t hash = kc::hashmurmur(kbuf, ksiz);
+      uint64_t step = kc::hashfnv(kbuf, ksiz) | 1;
+      bool hit = true;
+      for (int32_t i = 0; i < BLOOMHASHNUM; i++) {
+        uint64_t bidx = (hash + step * i) & mask_;
+        if (!(bits_[bidx >> 6] & (1ULL << (bidx & 63)))) {
+          hit = false;
+          break;
+        }
+      }
+      return hit || gen_.get() != gen;
+    }
+    void begin_rebuild() {
+      _assert_(true);
+      gen_ += 1;
+      locks_.lock_all();
+      std::memset(bits_, 0, (mask_ + 1) / 8);
+      adds_ = 0;
+      locks_.unlock_all();
+    }
+    void end_rebuild() {
+      _assert_(true);
+      gen_ += 1;
+    }
+    int64_t adds() {
+      _assert_(true);
+      return adds_.get();
+    }
+  private:
+    uint64_t* bits_;
+    uint64_t mask_;
+    kc::SlottedSpinLock locks_;
+    kc::AtomicInt64 gen_;
+    kc::AtomicInt64 adds_;
+  };
+  /**
+   * Cache of decoded record values on memory.
+   * @note Each slot is an independent LRU list whose capacity is the quotient of the whole
+   * capacity by the number of slots.
+   */
+  class RecordCache {
+  private:
+    struct Record {
+      std::string key;
+      std::string value;
+      int64_t xt;
+    };
+    typedef std::list<Record> RecordList;
+    typedef std::map<std::string, RecordList::iterator> RecordMap;
+    struct Slot {
+      kc::Mutex lock;
+      RecordList recs;
+      RecordMap index;
+      int64_t size;
+    };
+  public:
+    explicit RecordCache(int64_t capsiz) : slots_(), capsiz_(0) {
+      _assert_(capsiz > 0);
+      capsiz_ = capsiz / CACHESLOTNUM;
+      if (capsiz_ < 1) capsiz_ = 1;
+      for (size_t i = 0; i < CACHESLOTNUM; i++) {
+        slots_[i].size = 0;
+      }
+    }
+    bool visit(const char* kbuf, size_t ksiz, TimedDB::Visitor* visitor, int64_t ct) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && visitor);
+      Slot* slot = get_slot(kbuf, ksiz);
+      kc::ScopedMutex lock(&slot->lock);
+      RecordMap::iterator it = slot->index.find(std::string(kbuf, ksiz));
+      if (it == slot->index.end()) return false;
+      RecordList::iterator rit = it->second;
+      if (rit->xt < ct) {
+        slot->size -= record_size(*rit);
+        slot->recs.erase(rit);
+        slot->index.erase(it);
+        return false;
+      }
+      slot->recs.splice(slot->recs.begin(), slot->recs, rit);
+      const std::string& value = rit->value;
+      size_t rsiz;
+      int64_t xt = rit->xt;
+      visitor->visit_before();
+      visitor->visit_full(kbuf, ksiz, value.data(), value.size(), &rsiz, &xt);
+      visitor->visit_after();
+      return true;
+    }
+    void set(const char* kbuf, size_t ksiz, const char* vbuf, size_t vsiz, int64_t xt) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ && vbuf && vsiz <= kc::MEMMAXSIZ);
+      int64_t rsiz = ksiz + vsiz + CACHEOVERHEAD;
+      if (rsiz > capsiz_) return;
+      Slot* slot = get_slot(kbuf, ksiz);
+      std::string key(kbuf, ksiz);
+      kc::ScopedMutex lock(&slot->lock);
+      RecordMap::iterator it = slot->index.find(key);
+      if (it != slot->index.end()) {
+        slot->size -= record_size(*it->second);
+        slot->recs.erase(it->second);
+        slot->index.erase(it);
+      }
+      Record rec;
+      rec.xt = xt;
+      slot->recs.push_front(rec);
+      RecordList::iterator rit = slot->recs.begin();
+      rit->key = key;
+      rit->value.assign(vbuf, vsiz);
+      slot->index[key] = rit;
+      slot->size += rsiz;
+      while (slot->size > capsiz_) {
+        const Record& last = slot->recs.back();
+        slot->size -= record_size(last);
+        slot->index.erase(last.key);
+        slot->recs.pop_back();
+      }
+    }
+    void remove(const char* kbuf, size_t ksiz) {
+      _assert_(kbuf && ksiz <= kc::MEMMAXSIZ);
+      Slot* slot = get_slot(kbuf, ksiz);
+      kc::ScopedMutex lock(&slot->lock);
+      RecordMap::iterator it = slot->index.find(std::string(kbuf, ksiz));
+      if (it == slot->index.end()) return;
+      slot->size -= record_size(*it->second);
+      slot->recs.erase(it->second);
+      slot->index.erase(it);
+    }
+    void clear() {
+      _assert_(true);
+      for (size_t i = 0; i < CACHESLOTNUM; i++) {
+        Slot* slot = slots_ + i;
+        kc::ScopedMutex lock(&slot->lock);
+        slot->recs.clear();
+        slot->index.clear();
+        slot->size = 0;
+      }
+    }
+    int64_t count() {
+      _assert_(true);
+      int64_t sum = 0;
+      for (size_t i = 0; i < CACHESLOTNUM; i++) {
+        Slot* slot = slots_ + i;
+        kc::ScopedMutex lock(&slot->lock);
+        sum += slot->index.size();
+      }
+      return sum;
+    }
+  private:
+    Slot* get_slot(const char* kbuf, size_t ksiz) {
+      return slots_ + kc::hashmurmur(kbuf, ksiz) % CACHESLOTNUM;
+    }
+    static int64_t record_size(const Record& rec) {
+      return rec.key.size() + rec.value.size() + CACHEOVERHEAD;
+    }
+    Slot slots_[CACHESLOTNUM];
+    int64_t capsiz_;
+  };
+  /**
+   * Rebuild the Bloom filter by scanning the whole database.
+   * @return true on success, or false on failure.
+   * @note The database is scanned with a cursor, so other threads are not blocked.  Records
+   * added meanwhile are added by themselves.
+   */
+  bool build_bloom_filter() {
+    _assert_(bloom_);
+    class VisitorImpl : public kc::BasicDB::Visitor {
+    public:
+      explicit VisitorImpl(BloomFilter* bloom) : bloom_(bloom) {}
+    private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        bloom_->add(kbuf, ksiz);
+        return NOP;
+      }
+      BloomFilter* bloom_;
+    };
+    kc::ScopedMutex lock(&bmutex_);
+    VisitorImpl visitor(bloom_);
+    bool err = false;
+    bloom_->begin_rebuild();
+    kc::PolyDB::Cursor* cur = db_.cursor();
+    if (cur->jump()) {
+      while (cur->accept(&visitor, false, true)) {}
+    }
+    if (db_.error() != kc::BasicDB::Error::NOREC) err = true;
+    delete cur;
+    bloom_->end_rebuild();
+    return !err;
+  }
+  /**
+   * Rebuild the Bloom filter if it has got stale.
+   * @return true on success, or false on failure.
+   */
+  bool check_bloom_filter() {
+    _assert_(bloom_);
+    int64_t adds = bloom_->adds();
+    if (adds < BLOOMREBMIN || adds < db_.count() * 2) return true;
+    return build_bloom_filter();
+  }
+  /**
+   * Rebuild the expiration index by scanning the whole database.
+   * @return true on success, or false on failure.
+   * @note The database is scanned with a cursor, so other threads are not blocked.  Records
+   * updated meanwhile are indexed by themselves.
+   */
+  bool build_expiration_index() {
+    _assert_(xidx_);
+    class VisitorImpl : public kc::BasicDB::Visitor {
+    public:
+      explicit VisitorImpl(ExpirationIndex* xidx, uint8_t opts) : xidx_(xidx), opts_(opts) {}
+    private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        int64_t xt;
+        if (read_record_header(opts_, vbuf, vsiz, &xt) > 0) xidx_->set(kbuf, ksiz, xt);
+        return NOP;
+      }
+      ExpirationIndex* xidx_;
+      uint8_t opts_;
+    };
+    xidx_->clear();
+    VisitorImpl visitor(xidx_, opts_);
+    bool err = false;
+    kc::PolyDB::Cursor* cur = db_.cursor();
+    if (cur->jump()) {
+      while (cur->accept(&visitor, false, true)) {}
+    }
+    if (db_.error() != kc::BasicDB::Error::NOREC) {
+      xidx_->invalidate();
+      err = true;
+    }
+    delete cur;
+    return !err;
+  }
+  /**
+   * Rebuild the indexes on memory which have got stale.
+   * @return true on success, or false on failure.
+   * @note This is called by the background expirer thread and the vacuum method so that
+   * database operations never scan the whole database.
+   */
+  bool maintain_indexes() {
+    _assert_(true);
+    bool err = false;
+    if (xidx_ && xidx_->dirty() && !build_expiration_index()) err = true;
+    if (bloom_ && !check_bloom_filter()) err = true;
+    return !err;
+  }
   /**
    * Remove expired records.
    * @param score the score of expiration.
@@ -2306,35 +6827,54 @@ private:
     int64_t ct = std::time(NULL);
     class VisitorImpl : public kc::BasicDB::Visitor {
     public:
-      VisitorImpl(int64_t ct) : ct_(ct) {}
+      VisitorImpl(int64_t ct, uint8_t opts) : ct_(ct), opts_(opts) {}
     private:
       const char* visit_full(const char* kbuf, size_t ksiz,
                              const char* vbuf, size_t vsiz, size_t* sp) {
-        if (vsiz < (size_t)XTWIDTH) return NOP;
-        int64_t xt = kc::readfixnum(vbuf, XTWIDTH);
+        int64_t xt;
+        if (read_record_header(opts_, vbuf, vsiz, &xt) < 1) return NOP;
         if (ct_ <= xt) return NOP;
         return REMOVE;
       }
       int64_t ct_;
+      uint8_t opts_;
     };
-    VisitorImpl visitor(ct);
+    VisitorImpl visitor(ct, opts_);
     bool err = false;
-    for (int64_t i = 0; i < step; i++) {
-      if (!xcur_->accept(&visitor, true, true)) {
-        kc::BasicDB::Error::Code code = db_.error().code();
-        if (code == kc::BasicDB::Error::INVALID || code == kc::BasicDB::Error::NOREC) {
-          xcur_->jump();
-        } else {
-          err = true;
+    if (xidx_ && !xidx_->dirty()) {
+      std::vector<std::string> keys;
+      xidx_->pop(ct, step, &keys);
+      std::vector<std::string>::iterator it = keys.begin();
+      std::vector<std::string>::iterator itend = keys.end();
+      while (it != itend) {
+        if (!db_.accept(it->data(), it->size(), &visitor, true)) err = true;
+        ++it;
+      }
+    } else {
+      for (int64_t i = 0; i < step; i++) {
+        if (!xcur_->accept(&visitor, true, true)) {
+          kc::BasicDB::Error::Code code = db_.error().code();
+          if (code == kc::BasicDB::Error::INVALID || code == kc::BasicDB::Error::NOREC) {
+            xcur_->jump();
+          } else {
+            err = true;
+          }
+          xsc_ = 0;
+          break;
         }
-        xsc_ = 0;
-        break;
       }
     }
     if (capcnt_ > 0) {
       int64_t count = db_.count();
       while (count > capcnt_) {
-        if (!xcur_->remove()) {
+        if (xticks_) {
+          bool hit;
+          if (!evict_record(&hit)) {
+            err = true;
+            break;
+          }
+          if (!hit) break;
+        } else if (!remove_at_cursor()) {
           kc::BasicDB::Error::Code code = db_.error().code();
           if (code == kc::BasicDB::Error::INVALID || code == kc::BasicDB::Error::NOREC) {
             xcur_->jump();
@@ -2351,7 +6891,14 @@ private:
       int64_t size = db_.size();
       if (size > capsiz_) {
         for (int64_t i = 0; i < step; i++) {
-          if (!xcur_->remove()) {
+          if (xticks_) {
+            bool hit;
+            if (!evict_record(&hit)) {
+              err = true;
+              break;
+            }
+            if (!hit) break;
+          } else if (!remove_at_cursor()) {
             kc::BasicDB::Error::Code code = db_.error().code();
             if (code == kc::BasicDB::Error::INVALID || code == kc::BasicDB::Error::NOREC) {
               xcur_->jump();
@@ -2367,6 +6914,146 @@ private:
     xlock_.unlock();
     return !err;
   }
+  /**
+   * Read the options from the opaque region of the database file.
+   * @param opq the pointer to the opaque region.
+   * @param snum the number of shards, or 0 if the database is not sharded.
+   * @param zcp the pointer to the variable of the compression algorithm.  If it is the default,
+   * the recorded algorithm is assigned.
+   * @return true on success, or false if the recorded settings mismatch.
+   */
+  bool read_opaque(const char* opq, uint32_t snum, uint8_t* zcp) {
+    _assert_(opq && zcp);
+    opts_ = *(uint8_t*)(opq + 1);
+    uint32_t onum = kc::readfixnum(opq + SHARDNUMOFF, sizeof(onum));
+    if (onum > 0 && onum != snum) {
+      set_error(kc::BasicDB::Error::INVALID, "mismatching number of shards");
+      return false;
+    }
+    uint8_t zcode = *(uint8_t*)(opq + ZCOMPOFF);
+    if ((opts_ & TCOMPRESS) && zcode != ZCDEFAULT) {
+      if (*zcp != ZCDEFAULT && *zcp != zcode) {
+        set_error(kc::BasicDB::Error::INVALID, "mismatching compression algorithm");
+        return false;
+      }
+      *zcp = zcode;
+    }
+    return true;
+  }
+  /**
+   * Write the options into the opaque region of the database file.
+   * @param opq the pointer to the opaque region.
+   * @param snum the number of shards, or 0 if the database is not sharded.
+   * @param zcode the compression algorithm.
+   */
+  void write_opaque(char* opq, uint32_t snum, uint8_t zcode) {
+    _assert_(opq);
+    *(uint8_t*)opq = MAGICDATA;
+    *(uint8_t*)(opq + 1) = opts_;
+    kc::writefixnum(opq + SHARDNUMOFF, snum, sizeof(snum));
+    if ((opts_ & TCOMPRESS) && zcode == ZCDEFAULT) zcode = ZCZLIB;
+    *(uint8_t*)(opq + ZCOMPOFF) = (opts_ & TCOMPRESS) ? zcode : ZCDEFAULT;
+  }
+  /**
+   * Calculate the number of slots of the access time table.
+   * @return the number of slots, which is a power of two.
+   * @note The capacity by record number is preferred, and then the number of buckets of the
+   * internal database, and then the current number of records.
+   */
+  size_t calc_lru_slots() {
+    _assert_(true);
+    int64_t base = capcnt_;
+    if (base < 1) {
+      std::map<std::string, std::string> status;
+      if (db_.status(&status)) base = kc::atoi(status["bnum"].c_str());
+    }
+    if (base < 1) base = db_.count();
+    size_t num = XTLRUMINSLOTS;
+    while (num < (uint64_t)base && num < XTLRUMAXSLOTS) {
+      num <<= 1;
+    }
+    return num;
+  }
+  /**
+   * Record the access time of a record.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   */
+  void touch_record(const char* kbuf, size_t ksiz) {
+    _assert_(xticks_ && kbuf && ksiz <= kc::MEMMAXSIZ);
+    xticks_[kc::hashmurmur(kbuf, ksiz) % xtslots_] = access_tick();
+  }
+  /**
+   * Remove the least recently used record among records sampled by the expiration cursor.
+   * @param hitp the pointer to the variable into which whether a record was removed is assigned.
+   * @return true on success, or false on failure.
+   */
+  bool evict_record(bool* hitp) {
+    _assert_(xticks_ && hitp);
+    *hitp = false;
+    uint32_t now = access_tick();
+    std::string key;
+    uint32_t mage = 0;
+    bool jumped = false;
+    int32_t num = 0;
+    while (num < XTLRUSAMPLE) {
+      size_t ksiz;
+      char* kbuf = xcur_->get_key(&ksiz, true);
+      if (!kbuf) {
+        kc::BasicDB::Error::Code code = db_.error().code();
+        if (code != kc::BasicDB::Error::INVALID && code != kc::BasicDB::Error::NOREC)
+          return false;
+        if (jumped) break;
+        xcur_->jump();
+        jumped = true;
+        continue;
+      }
+      uint32_t age = access_age(xticks_[kc::hashmurmur(kbuf, ksiz) % xtslots_], now);
+      if (num < 1 || age > mage) {
+        key.assign(kbuf, ksiz);
+        mage = age;
+      }
+      delete[] kbuf;
+      num++;
+    }
+    if (num < 1) return true;
+    if (!db_.remove(key.data(), key.size()) && db_.error() != kc::BasicDB::Error::NOREC)
+      return false;
+    if (cache_) cache_->remove(key.data(), key.size());
+    *hitp = true;
+    return true;
+  }
+  /**
+   * Load records atomically from a file.
+   * @param src the path of the source file.
+   * @param zcomp the data compressor object.  If it is NULL, no decompression is performed.
+   * @param checker a progress checker object.  If it is NULL, no checking is performed.
+   * @param thnum the number of worker threads.
+   * @return true on success, or false on failure.
+   */
+  bool load_snapshot_atomic_impl(const std::string& src, kc::Compressor* zcomp,
+                                 kc::BasicDB::ProgressChecker* checker, size_t thnum);
+  /**
+   * Remove the record at the expiration cursor.
+   * @return true on success, or false on failure.
+   */
+  bool remove_at_cursor() {
+    _assert_(xcur_);
+    if (!cache_) return xcur_->remove();
+    class VisitorImpl : public kc::BasicDB::Visitor {
+    public:
+      explicit VisitorImpl(RecordCache* cache) : cache_(cache) {}
+    private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        cache_->remove(kbuf, ksiz);
+        return REMOVE;
+      }
+      RecordCache* cache_;
+    };
+    VisitorImpl visitor(cache_);
+    return xcur_->accept(&visitor, true, false);
+  }
   /**
    * Perform defragmentation of the database file.
    * @param step the number of steps.  If it is not more than 0, the whole region is defraged.
@@ -2384,25 +7071,88 @@ private:
       } else if (info == typeid(kc::TreeDB)) {
         kc::TreeDB* tdb = (kc::TreeDB*)idb;
         if (!tdb->defrag(step)) err = true;
+      } else if (info == typeid(ShardDB) || info == typeid(TieredDB)) {
+        ShardDB* sdb = (ShardDB*)idb;
+        if (!sdb->defrag(step)) err = true;
+      } else if (info == typeid(BufferedDB)) {
+        BufferedDB* bdb = (BufferedDB*)idb;
+        if (!bdb->defrag(step)) err = true;
       }
     }
     return !err;
   }
+  /**
+   * Read the meta data of a record value.
+   * @param opts the options of the database.
+   * @param vbuf the buffer of the record value.
+   * @param vsiz the size of the record value.
+   * @param xtp the pointer to the variable into which the expiration time is assigned.
+   * @return the size of the meta data, or 0 if the record value is broken.
+   * @note With the compression option, the meta data ends with the flag byte of compression.
+   */
+  static size_t read_record_header(uint8_t opts, const char* vbuf, size_t vsiz, int64_t* xtp) {
+    _assert_(vbuf && vsiz <= kc::MEMMAXSIZ && xtp);
+    size_t hsiz;
+    if ((opts & TCOMPACT) && vsiz > 0 && *(uint8_t*)vbuf == XTNONE) {
+      *xtp = XTMAX;
+      hsiz = 1;
+    } else {
+      if (vsiz < (size_t)XTWIDTH) return 0;
+      *xtp = kc::readfixnum(vbuf, XTWIDTH);
+      hsiz = XTWIDTH;
+    }
+    if (opts & TCOMPRESS) {
+      if (vsiz <= hsiz) return 0;
+      hsiz++;
+    }
+    return hsiz;
+  }
   /**
    * Make the record value with meta data.
    * @param vbuf the buffer of the original record value.
    * @param vsiz the size of the original record value.
    * @param xt the expiration time.
+   * @param stack the buffer used if the result fits in it.
+   * @param ssiz the size of the buffer.
    * @param sp the pointer to the variable into which the size of the region of the return
    * value is assigned.
-   * @return the pointer to the result buffer.
-   */
-  static char* make_record_value(const char* vbuf, size_t vsiz, int64_t xt, size_t* sp) {
-    _assert_(vbuf && vsiz <= kc::MEMMAXSIZ);
-    size_t jsiz = vsiz + XTWIDTH;
-    char* jbuf = new char[jsiz];
-    kc::writefixnum(jbuf, xt, XTWIDTH);
-    std::memcpy(jbuf + XTWIDTH, vbuf, vsiz);
+   * @return the pointer to the result buffer.  If it is not the given buffer, it should be
+   * released with the delete[] operator when it is no longer in use.
+   * @note With the compact header option, a record which never expires has the one byte header
+   * and the expiration time is not more than the time whose leading byte is less than XTNONE.
+   * With the compression option, the value is compressed if it is not smaller than the minimum
+   * size and it gets smaller by compression.
+   */
+  char* make_record_value(const char* vbuf, size_t vsiz, int64_t xt,
+                          char* stack, size_t ssiz, size_t* sp) {
+    _assert_(vbuf && vsiz <= kc::MEMMAXSIZ && stack);
+    bool xtnone = (opts_ & TCOMPACT) && xt >= ((int64_t)XTNONE << ((XTWIDTH - 1) * 8));
+    size_t hsiz = xtnone ? 1 : XTWIDTH;
+    char* zbuf = NULL;
+    if (opts_ & TCOMPRESS) {
+      if ((int64_t)vsiz >= zmin_) {
+        size_t zsiz;
+        zbuf = zcomp_->compress(vbuf, vsiz, &zsiz);
+        if (zbuf && zsiz < vsiz) {
+          vbuf = zbuf;
+          vsiz = zsiz;
+        } else {
+          delete[] zbuf;
+          zbuf = NULL;
+        }
+      }
+      hsiz++;
+    }
+    size_t jsiz = vsiz + hsiz;
+    char* jbuf = jsiz > ssiz ? new char[jsiz] : stack;
+    if (xtnone) {
+      *(uint8_t*)jbuf = XTNONE;
+    } else {
+      kc::writefixnum(jbuf, xt, XTWIDTH);
+    }
+    if (opts_ & TCOMPRESS) *(uint8_t*)(jbuf + hsiz - 1) = zbuf ? ZDEFLATED : ZPLAIN;
+    std::memcpy(jbuf + hsiz, vbuf, vsiz);
+    delete[] zbuf;
     *sp = jsiz;
     return jbuf;
   }
@@ -2484,6 +7234,28 @@ private:
   int64_t capsiz_;
   /** The cursor for expiration. */
   kc::PolyDB::Cursor* xcur_;
+  /** The index for expiration. */
+  ExpirationIndex* xidx_;
+  /** The number of records checked per second in background. */
+  int64_t xrate_;
+  /** The background expirer. */
+  Expirer* xthr_;
+  /** The table of access times for eviction. */
+  uint32_t* xticks_;
+  /** The number of slots of the access time table. */
+  size_t xtslots_;
+  /** The Bloom filter of existing keys. */
+  BloomFilter* bloom_;
+  /** The mutex for rebuilding the Bloom filter. */
+  kc::Mutex bmutex_;
+  /** The cache of record values. */
+  RecordCache* cache_;
+  /** The data compressor of record values. */
+  kc::Compressor* zcomp_;
+  /** The compression algorithm of record values. */
+  uint8_t zcode_;
+  /** The minimum size of record values to be compressed. */
+  int64_t zmin_;
   /** The score of expiration. */
   kc::AtomicInt64 xsc_;
 };
@@ -34,6 +34,7 @@ static int32_t runlist(int argc, char** argv);
 static int32_t runclear(int argc, char** argv);
 static int32_t runimport(int argc, char** argv);
 static int32_t runcopy(int argc, char** argv);
+static int32_t runbuild(int argc, char** argv);
 static int32_t rundump(int argc, char** argv);
 static int32_t runload(int argc, char** argv);
 static int32_t runvacuum(int argc, char** argv);
@@ -65,6 +66,7 @@ static int32_t procimport(const char* path, const char* file, int32_t oflags,
                           bool sx, int64_t xt);
 static int32_t proccopy(const char* path, const char* file, int32_t oflags,
                         const char* ulogpath, int64_t ulim, uint16_t sid, uint16_t dbid);
+static int32_t procbuild(const char* path, const char* file, int32_t oflags, int64_t bnum);
 static int32_t procdump(const char* path, const char* file, int32_t oflags,
                         const char* ulogpath, int64_t ulim, uint16_t sid, uint16_t dbid);
 static int32_t procload(const char* path, const char* file, int32_t oflags,
@@ -107,6 +109,8 @@ int main(int argc, char** argv) {
     rv = runimport(argc, argv);
   } else if (!std::strcmp(argv[1], "copy")) {
     rv = runcopy(argc, argv);
+  } else if (!std::strcmp(argv[1], "build")) {
+    rv = runbuild(argc, argv);
   } else if (!std::strcmp(argv[1], "dump")) {
     rv = rundump(argc, argv);
   } else if (!std::strcmp(argv[1], "load")) {
@@ -153,6 +157,7 @@ static void usage() {
           " [-sx] [-xt num] path [file]\n", g_progname);
   eprintf("  %s copy [-onl|-otl|-onr] [-ulog str] [-ulim num] [-sid num] [-dbid num]"
           " path file\n", g_progname);
+  eprintf("  %s build [-onl|-otl|-onr] [-bloom num] path file\n", g_progname);
   eprintf("  %s dump [-onl|-otl|-onr] [-ulog str] [-ulim num] [-sid num] [-dbid num]"
           " path [file]\n", g_progname);
   eprintf("  %s load [-otr] [-onl|-otl|-onr] [-ulog str] [-ulim num] [-sid num] [-dbid num]"
@@ -740,6 +745,44 @@ static int32_t runcopy(int argc, char** argv) {
 }
 
 
+// parse arguments of build command
+static int32_t runbuild(int argc, char** argv) {
+  bool argbrk = false;
+  const char* path = NULL;
+  const char* file = NULL;
+  int32_t oflags = 0;
+  int64_t bnum = 0;
+  for (int32_t i = 2; i < argc; i++) {
+    if (!argbrk && argv[i][0] == '-') {
+      if (!std::strcmp(argv[i], "--")) {
+        argbrk = true;
+      } else if (!std::strcmp(argv[i], "-onl")) {
+        oflags |= kc::BasicDB::ONOLOCK;
+      } else if (!std::strcmp(argv[i], "-otl")) {
+        oflags |= kc::BasicDB::OTRYLOCK;
+      } else if (!std::strcmp(argv[i], "-onr")) {
+        oflags |= kc::BasicDB::ONOREPAIR;
+      } else if (!std::strcmp(argv[i], "-bloom")) {
+        if (++i >= argc) usage();
+        bnum = kc::atoix(argv[i]);
+      } else {
+        usage();
+      }
+    } else if (!path) {
+      argbrk = true;
+      path = argv[i];
+    } else if (!file) {
+      file = argv[i];
+    } else {
+      usage();
+    }
+  }
+  if (!path || !file) usage();
+  int32_t rv = procbuild(path, file, oflags, bnum);
+  return rv;
+}
+
+
 // parse arguments of dump command
 static int32_t rundump(int argc, char** argv) {
   bool argbrk = false;
@@ -1637,6 +1680,30 @@ static int32_t proccopy(const char* path, const char* file, int32_t oflags,
 }
 
 
+// perform build command
+static int32_t procbuild(const char* path, const char* file, int32_t oflags, int64_t bnum) {
+  kt::TimedDB db;
+  db.tune_logger(stddblogger(g_progname, &std::cerr));
+  if (!db.open(path, kc::BasicDB::OREADER | oflags)) {
+    dberrprint(&db, "DB::open failed");
+    return 1;
+  }
+  bool err = false;
+  DotChecker checker(&std::cout, 1000);
+  if (!db.export_sorted_table(file, bnum, &checker)) {
+    dberrprint(&db, "DB::export_sorted_table failed");
+    err = true;
+  }
+  oprintf(" (end)\n");
+  if (!db.close()) {
+    dberrprint(&db, "DB::close failed");
+    err = true;
+  }
+  if (!err) oprintf("%lld records were written successfully\n", (long long)checker.count());
+  return err ? 1 : 0;
+}
+
+
 // perform dump command
 static int32_t procdump(const char* path, const char* file, int32_t oflags,
                         const char* ulogpath, int64_t ulim, uint16_t sid, uint16_t dbid) {
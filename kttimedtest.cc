@@ -21,6 +21,8 @@
 const char* g_progname;                  // program name
 uint32_t g_randseed;                     // random seed
 int64_t g_memusage;                      // memory usage
+kc::AtomicInt64 g_allocnum;              // number of heap allocations
+bool g_alloccnt;                         // whether to count heap allocations
 
 
 // function prototypes
@@ -34,6 +36,7 @@ static int32_t runwicked(int argc, char** argv);
 static int32_t runtran(int argc, char** argv);
 static int32_t runmapred(int argc, char** argv);
 static int32_t runmisc(int argc, char** argv);
+static int32_t runalloc(int argc, char** argv);
 static int32_t procorder(const char* path, int64_t rnum, int32_t thnum, bool rnd, int32_t mode,
                          bool tran, int32_t oflags, const char* ulogpath, int64_t ulim,
                          uint16_t sid, uint16_t dbid, bool lv);
@@ -51,6 +54,32 @@ static int32_t procmapred(const char* path, int64_t rnum, bool rnd, int32_t ofla
                           bool lv, const char* tmpdir, int64_t dbnum,
                           int64_t clim, int64_t cbnum, int32_t opts);
 static int32_t procmisc(const char* path);
+static int32_t procalloc(const char* path, int64_t rnum, int64_t vsiz);
+
+
+// constants
+const size_t ALLOCVSIZMAX = 1000;        // maximum value size to be set without allocation
+
+
+// replacement of the global allocator to count heap allocations
+void* operator new(size_t size) throw(std::bad_alloc) {
+  if (g_alloccnt) g_allocnum += 1;
+  void* ptr = std::malloc(size > 0 ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+void* operator new[](size_t size) throw(std::bad_alloc) {
+  if (g_alloccnt) g_allocnum += 1;
+  void* ptr = std::malloc(size > 0 ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+void operator delete(void* ptr) throw() {
+  std::free(ptr);
+}
+void operator delete[](void* ptr) throw() {
+  std::free(ptr);
+}
 
 
 // main routine
@@ -75,6 +104,8 @@ int main(int argc, char** argv) {
     rv = runmapred(argc, argv);
   } else if (!std::strcmp(argv[1], "misc")) {
     rv = runmisc(argc, argv);
+  } else if (!std::strcmp(argv[1], "alloc")) {
+    rv = runalloc(argc, argv);
   } else {
     usage();
   }
@@ -107,6 +138,7 @@ static void usage() {
           " [-ulog str] [-ulim num] [-sid num] [-dbid num] [-lv] [-tmp str]"
           " [-dbnum num] [-clim num] [-cbnum num] [-xnl] [-xnc] path rnum\n", g_progname);
   eprintf("  %s misc path\n", g_progname);
+  eprintf("  %s alloc [-vsiz num] path rnum\n", g_progname);
   eprintf("\n");
   std::exit(1);
 }
@@ -539,6 +571,39 @@ static int32_t runmisc(int argc, char** argv) {
 }
 
 
+// parse arguments of alloc command
+static int32_t runalloc(int argc, char** argv) {
+  bool argbrk = false;
+  const char* path = NULL;
+  const char* rstr = NULL;
+  int64_t vsiz = 8;
+  for (int32_t i = 2; i < argc; i++) {
+    if (!argbrk && argv[i][0] == '-') {
+      if (!std::strcmp(argv[i], "--")) {
+        argbrk = true;
+      } else if (!std::strcmp(argv[i], "-vsiz")) {
+        if (++i >= argc) usage();
+        vsiz = kc::atoix(argv[i]);
+      } else {
+        usage();
+      }
+    } else if (!path) {
+      argbrk = false;
+      path = argv[i];
+    } else if (!rstr) {
+      rstr = argv[i];
+    } else {
+      usage();
+    }
+  }
+  if (!path || !rstr) usage();
+  int64_t rnum = kc::atoix(rstr);
+  if (rnum < 1 || vsiz < 0) usage();
+  int32_t rv = procalloc(path, rnum, vsiz);
+  return rv;
+}
+
+
 // perform order command
 static int32_t procorder(const char* path, int64_t rnum, int32_t thnum, bool rnd, int32_t mode,
                          bool tran, int32_t oflags, const char* ulogpath, int64_t ulim,
@@ -1375,6 +1440,39 @@ static int32_t procorder(const char* path, int64_t rnum, int32_t thnum, bool rnd
     etime = kc::time();
     dbmetaprint(&db, false);
     oprintf("time: %.3f\n", etime - stime);
+    oprintf("dumping and loading atomic snapshots:\n");
+    stime = kc::time();
+    const std::string sspath = "casket-snapshot";
+    kc::ZLIBCompressor<kc::ZLIB::RAW> sscomp;
+    size_t ssthnum = thnum > 1 ? thnum : 2;
+    for (int32_t i = 0; !err && i < 3; i++) {
+      kc::Compressor* zcomp = i == 2 ? &sscomp : NULL;
+      size_t sthnum = i == 0 ? 1 : ssthnum;
+      if (!db.dump_snapshot_atomic(sspath, zcomp, NULL, sthnum)) {
+        dberrprint(&db, __LINE__, "DB::dump_snapshot_atomic");
+        err = true;
+        break;
+      }
+      int64_t sscount;
+      if (!kt::TimedDB::status_snapshot_atomic(sspath, NULL, &sscount) || sscount != cnt) {
+        dberrprint(&db, __LINE__, "DB::status_snapshot_atomic");
+        err = true;
+        break;
+      }
+      if (!db.clear()) {
+        dberrprint(&db, __LINE__, "DB::clear");
+        err = true;
+        break;
+      }
+      if (!db.load_snapshot_atomic(sspath, zcomp, NULL, sthnum) || db.count() != cnt) {
+        dberrprint(&db, __LINE__, "DB::load_snapshot_atomic");
+        err = true;
+      }
+    }
+    kc::File::remove(sspath);
+    etime = kc::time();
+    dbmetaprint(&db, false);
+    oprintf("time: %.3f\n", etime - stime);
   }
   if (mode == 0 || mode == 'r' || mode == 'e') {
     oprintf("removing records:\n");
@@ -2589,5 +2687,81 @@ static int32_t procmisc(const char* path) {
 }
 
 
+// perform alloc command
+static int32_t procalloc(const char* path, int64_t rnum, int64_t vsiz) {
+  oprintf("<Allocation Test>\n  seed=%u  path=%s  rnum=%lld  vsiz=%lld\n\n",
+          g_randseed, path, (long long)rnum, (long long)vsiz);
+  bool err = false;
+  kt::TimedDB db;
+  oprintf("opening the database:\n");
+  if (!db.open(path, kc::BasicDB::OWRITER | kc::BasicDB::OCREATE | kc::BasicDB::OTRUNCATE)) {
+    dberrprint(&db, __LINE__, "DB::open");
+    err = true;
+  }
+  kc::BasicDB* idb = db.reveal_inner_db();
+  char* vbuf = new char[vsiz + 1];
+  std::memset(vbuf, 'v', vsiz);
+  const char* names[] = { "set", "overwrite", "get", "append", "remove" };
+  int32_t cnum = sizeof(names) / sizeof(*names);
+  for (int32_t c = 0; !err && c < cnum; c++) {
+    int64_t anums[2];
+    double stime = kc::time();
+    for (int32_t t = 0; !err && t < 2; t++) {
+      anums[t] = g_allocnum.get();
+      g_alloccnt = true;
+      for (int64_t i = 1; !err && i <= rnum; i++) {
+        char kbuf[RECBUFSIZ];
+        size_t ksiz = std::sprintf(kbuf, "%c%08lld", t == 0 ? 'i' : 't', (long long)i);
+        char gbuf[RECBUFSIZ];
+        bool ok;
+        switch (c) {
+          case 0: case 1: {
+            ok = t == 0 ? idb->set(kbuf, ksiz, vbuf, vsiz) :
+              db.set(kbuf, ksiz, vbuf, vsiz, c == 0 ? kc::INT64MAX : 3600);
+            break;
+          }
+          case 2: {
+            ok = (t == 0 ? idb->get(kbuf, ksiz, gbuf, sizeof(gbuf)) :
+                  db.get(kbuf, ksiz, gbuf, sizeof(gbuf))) >= 0;
+            break;
+          }
+          case 3: {
+            ok = t == 0 ? idb->append(kbuf, ksiz, "a", 1) : db.append(kbuf, ksiz, "a", 1);
+            break;
+          }
+          default: {
+            ok = t == 0 ? idb->remove(kbuf, ksiz) : db.remove(kbuf, ksiz);
+            break;
+          }
+        }
+        if (!ok) {
+          dberrprint(&db, __LINE__, names[c]);
+          err = true;
+        }
+      }
+      g_alloccnt = false;
+      anums[t] = g_allocnum.get() - anums[t];
+    }
+    double etime = kc::time();
+    int64_t anum = anums[1] - anums[0];
+    oprintf("%s: allocations=%lld inner=%lld (%.3f per operation) time=%.3f\n", names[c],
+            (long long)anums[1], (long long)anums[0], (double)anum / rnum, etime - stime);
+    if (c < 2 && vsiz <= (int64_t)ALLOCVSIZMAX && anum > 0) {
+      oprintf("%s: heap allocations on the write path\n", names[c]);
+      err = true;
+    }
+  }
+  delete[] vbuf;
+  dbmetaprint(&db, false);
+  oprintf("closing the database:\n");
+  if (!db.close()) {
+    dberrprint(&db, __LINE__, "DB::close");
+    err = true;
+  }
+  oprintf("%s\n\n", err ? "error" : "ok");
+  return err ? 1 : 0;
+}
+
+
 
 // END OF FILE
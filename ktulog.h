@@ -49,6 +49,8 @@ private:
   static const uint64_t TSLACC = 1000 * 1000;
   /* The waiting seconds of auto flush. */
   static const double FLUSHWAIT = 0.1;
+  /* The waiting seconds to batch logs for waiting readers. */
+  static const double FLUSHBATCH = 0.001;
 public:
   /**
    * Reader of update logs.
@@ -283,7 +285,8 @@ public:
   explicit UpdateLogger() :
     path_(), limsiz_(0), asi_(0), id_(0), file_(),
     cache_(), csiz_(0), cts_(0), clock_(), flock_(), tslock_(),
-    flusher_(this), tswall_(0), tslogic_(0) {
+    flusher_(this), tswall_(0), tslogic_(0),
+    wmutex_(), fcond_(), wcond_(), freq_(0), fcnt_(0), waiters_(0) {
     _assert_(true);
   }
   /**
@@ -406,7 +409,11 @@ public:
     cache_.push_back(log);
     csiz_ += 2 + sizeof(uint64_t) + sizeof(uint32_t) + msiz;
     if (ts > cts_) cts_ = ts;
-    if (csiz_ > CACHEMAX && !flush()) err = true;
+    if (csiz_ > CACHEMAX) {
+      if (!flush()) err = true;
+    } else if (waiters_.get() > 0) {
+      request_flush();
+    }
     return !err;
   }
   /**
@@ -433,7 +440,11 @@ public:
       if (mts > cts_) cts_ = mts;
       ++it;
     }
-    if (csiz_ > CACHEMAX && !flush()) err = true;
+    if (csiz_ > CACHEMAX) {
+      if (!flush()) err = true;
+    } else if (waiters_.get() > 0) {
+      request_flush();
+    }
     return !err;
   }
   /**
@@ -483,6 +494,37 @@ public:
       ++it;
     }
   }
+  /**
+   * Get the number of times cached logs have been flushed into the files.
+   * @return the number of times cached logs have been flushed.
+   */
+  uint64_t flush_count() {
+    _assert_(true);
+    return fcnt_.get();
+  }
+  /**
+   * Wait for cached logs to be flushed into the files.
+   * @param count the number of flushes known by the caller, which is retrieved by the
+   * flush_count method before reading.
+   * @param timeout the timeout in seconds.
+   * @return true if logs have been flushed since the given number, or false on timeout.
+   * @note Waiting readers make the automatic flusher write cached logs shortly instead of
+   * waiting for the next interval.
+   */
+  bool wait(uint64_t count, double timeout) {
+    _assert_(true);
+    if (path_.empty()) return false;
+    wmutex_.lock();
+    if ((uint64_t)fcnt_.get() == count) {
+      waiters_.add(1);
+      if (freq_.cas(0, 1)) fcond_.signal();
+      wcond_.wait(&wmutex_, timeout);
+      waiters_.add(-1);
+    }
+    bool rv = (uint64_t)fcnt_.get() != count;
+    wmutex_.unlock();
+    return rv;
+  }
   /**
    * Get the current pure clock data for time stamp.
    * @return the current pure clock data for time stamp.
@@ -508,8 +550,17 @@ private:
     void run() {
       double asnext = 0;
       while (alive_ && !error_) {
-        kc::Thread::sleep(FLUSHWAIT);
-        if (ulog_->clock_.lock_try()) {
+        ulog_->wmutex_.lock();
+        if (alive_ && ulog_->freq_.get() < 1) ulog_->fcond_.wait(&ulog_->wmutex_, FLUSHWAIT);
+        bool hurry = ulog_->freq_.get() > 0;
+        ulog_->wmutex_.unlock();
+        if (hurry) {
+          kc::Thread::sleep(FLUSHBATCH);
+          ulog_->clock_.lock();
+          ulog_->freq_.set(0);
+          if (ulog_->csiz_ > 0 && !ulog_->flush()) error_ = true;
+          ulog_->clock_.unlock();
+        } else if (ulog_->clock_.lock_try()) {
           if (ulog_->csiz_ > 0 && !ulog_->flush()) error_ = true;
           ulog_->clock_.unlock();
         }
@@ -522,7 +573,10 @@ private:
       }
     }
     void stop() {
+      ulog_->wmutex_.lock();
       alive_ = false;
+      ulog_->fcond_.signal();
+      ulog_->wmutex_.unlock();
     }
     bool error() {
       return error_;
@@ -637,8 +691,23 @@ private:
     cache_.clear();
     csiz_ = 0;
     flock_.unlock();
+    wmutex_.lock();
+    fcnt_.add(1);
+    wcond_.broadcast();
+    wmutex_.unlock();
     return !err;
   }
+  /**
+   * Request the automatic flusher to flush cached logs shortly.
+   * @note Requests made before the flusher takes the cache are merged into one flush.
+   */
+  void request_flush() {
+    _assert_(true);
+    if (!freq_.cas(0, 1)) return;
+    wmutex_.lock();
+    fcond_.signal();
+    wmutex_.unlock();
+  }
   /**
    * Get the current clock data for time stamp.
    * @return the current clock data for time stamp.
@@ -686,6 +755,18 @@ private:
   uint64_t tswall_;
   /** The logical time stamp. */
   uint64_t tslogic_;
+  /** The mutex for flush notification. */
+  kc::Mutex wmutex_;
+  /** The condition variable to wake the automatic flusher. */
+  kc::CondVar fcond_;
+  /** The condition variable to wake waiting readers. */
+  kc::CondVar wcond_;
+  /** The flag whether immediate flush is requested. */
+  kc::AtomicInt64 freq_;
+  /** The number of flushes. */
+  kc::AtomicInt64 fcnt_;
+  /** The number of waiting readers. */
+  kc::AtomicInt64 waiters_;
 };
 
 
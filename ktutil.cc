@@ -37,6 +37,8 @@ const char* const FEATURES = ""
 "(epoll)"
 #elif defined(_KT_EVENT_KQUEUE)
 "(kqueue)"
+#elif defined(_KT_EVENT_IOURING)
+"(io_uring)"
 #else
 "(select)"
 #endif
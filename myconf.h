@@ -95,7 +95,9 @@
 #define _KT_LIBREV     3
 
 #if ! defined(_MYNOEVENT)
-#if defined(_SYS_LINUX_)
+#if defined(_SYS_LINUX_) && defined(_MYURING)
+#define _KT_EVENT_IOURING
+#elif defined(_SYS_LINUX_)
 #define _KT_EVENT_EPOLL
 #elif defined(_SYS_FREEBSD_) || defined(_SYS_MACOSX_)
 #define _KT_EVENT_KQUEUE